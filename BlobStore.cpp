@@ -0,0 +1,454 @@
+#include "BlobStore.h"
+#include "CryptoManager.h"
+#include "Trace.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+
+namespace {
+
+// Первый байт расшифрованного файла — способ хранения тела
+enum BodyCodec : char {
+    CodecRaw = 0,
+    CodecZlib = 1,
+};
+
+// Меньшие тела не сжимаем: выигрыш не окупает заголовок zlib
+const qsizetype kMinCompressSize = 512;
+
+} // namespace
+
+void BlobStore::setStorage(const QString &directory, const CryptoManager *crypto)
+{
+    if (directory.isEmpty() || !crypto) {
+        // Тела, лежащие только на диске, забираем в память до отключения
+        for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+            if (it->body == Utf8Arena::Null && it->stored) {
+                loadEntry(it.key(), it.value());
+            }
+            it->stored = false;
+        }
+        m_directory.clear();
+        m_crypto = nullptr;
+        m_released.clear();
+        return;
+    }
+
+    m_directory = directory;
+    m_crypto = crypto;
+    QDir().mkpath(m_directory);
+
+    // Всё, что накопилось в памяти без хранилища, дописываем на диск
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (!it->stored && it->body != Utf8Arena::Null) {
+            it->stored = writeBlob(it.key(), residentBody(it.value()));
+        }
+    }
+}
+
+bool BlobStore::hasStorage() const
+{
+    return m_crypto && !m_directory.isEmpty();
+}
+
+void BlobStore::acquire(const QByteArray &digest, const QByteArray &data)
+{
+    m_released.remove(digest);
+
+    auto it = m_entries.find(digest);
+    if (it != m_entries.end()) {
+        ++it->refs;
+        if (it->body != Utf8Arena::Null) {
+            return;
+        }
+    }
+
+    // Сжимаем до копирования в арену, чтобы не занимать её несжатым телом
+    Prepared body;
+    body.data = data;
+    body.size = data.size();
+    if (m_compressionThreshold > 0 && body.size >= m_compressionThreshold) {
+        packBody(body);
+    }
+
+    if (it != m_entries.end()) {
+        storeResident(it.value(), body);
+        return;
+    }
+
+    Entry entry;
+    entry.refs = 1;
+    storeResident(entry, body);
+    entry.stored = hasStorage() && writeBlob(digest, body);
+    m_entries.insert(digest, entry);
+}
+
+void BlobStore::acquireStored(const QByteArray &digest)
+{
+    m_released.remove(digest);
+
+    auto it = m_entries.find(digest);
+    if (it != m_entries.end()) {
+        ++it->refs;
+        return;
+    }
+
+    Entry entry;
+    entry.refs = 1;
+    entry.stored = true;
+    m_entries.insert(digest, entry);
+}
+
+BlobStore::Prepared BlobStore::prepare(const QByteArray &data, const QString &directory,
+                                       const CryptoManager *crypto, qint64 compressionThreshold)
+{
+    Prepared body;
+    body.digest = digest(data);
+    body.data = data;
+    body.size = data.size();
+    if (compressionThreshold > 0 && body.size >= compressionThreshold) {
+        packBody(body);
+    }
+
+    if (!directory.isEmpty() && crypto) {
+        QDir().mkpath(directory);
+        if (writeBlob(directory, crypto, body.digest, body)) {
+            body.directory = directory;
+        }
+    }
+    return body;
+}
+
+void BlobStore::acquirePrepared(const Prepared &body)
+{
+    m_released.remove(body.digest);
+
+    auto it = m_entries.find(body.digest);
+    if (it != m_entries.end()) {
+        ++it->refs;
+        return;
+    }
+
+    Entry entry;
+    entry.refs = 1;
+    entry.size = body.size;
+    entry.incompressible = body.incompressible;
+    // prepare() мог застать на месте файл освобождённого тела, который
+    // collectGarbage() удалил до этого вызова: тогда пишем его заново
+    if (hasStorage() && body.directory == m_directory && QFile::exists(blobPath(body.digest))) {
+        // Файл уже записан: тело поднимется с диска при первом обращении
+        entry.stored = true;
+    } else {
+        // Хранилище включили или выключили, пока тело готовилось, или файла больше нет
+        storeResident(entry, body);
+        entry.stored = hasStorage() && writeBlob(body.digest, body);
+    }
+    m_entries.insert(body.digest, entry);
+}
+
+QString BlobStore::directory() const
+{
+    return m_directory;
+}
+
+void BlobStore::release(const QByteArray &digest)
+{
+    auto it = m_entries.find(digest);
+    if (it == m_entries.end() || --it->refs > 0) {
+        return;
+    }
+
+    dropResident(it.value());
+    if (it->stored) {
+        m_released.insert(digest, m_epoch);
+    }
+    m_entries.erase(it);
+}
+
+bool BlobStore::contains(const QByteArray &digest) const
+{
+    return m_entries.contains(digest);
+}
+
+int BlobStore::refCount(const QByteArray &digest) const
+{
+    const auto it = m_entries.constFind(digest);
+    return (it != m_entries.cend()) ? it->refs : 0;
+}
+
+QByteArray BlobStore::data(const QByteArray &digest) const
+{
+    const auto it = m_entries.find(digest);
+    if (it == m_entries.end()) {
+        return QByteArray();
+    }
+    if (it->body == Utf8Arena::Null && !loadEntry(digest, it.value())) {
+        return QByteArray();
+    }
+    // Сжатое тело распаковываем на каждое обращение, в памяти остаётся сжатым
+    const QByteArrayView resident = m_arena.view(it->body);
+    if (it->compressed) {
+        return qUncompress(reinterpret_cast<const uchar *>(resident.data()), resident.size());
+    }
+    return resident.toByteArray();
+}
+
+bool BlobStore::isResident(const QByteArray &digest) const
+{
+    const auto it = m_entries.constFind(digest);
+    return it != m_entries.cend() && it->body != Utf8Arena::Null;
+}
+
+void BlobStore::evict(const QByteArray &digest) const
+{
+    const auto it = m_entries.find(digest);
+    if (it != m_entries.end() && it->stored && hasStorage()) {
+        dropResident(it.value());
+    }
+}
+
+void BlobStore::setCompressionThreshold(qint64 bytes)
+{
+    if (m_compressionThreshold == bytes) {
+        return;
+    }
+    m_compressionThreshold = bytes;
+    if (bytes <= 0) {
+        return;
+    }
+
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        if (it->body != Utf8Arena::Null && it->size >= bytes) {
+            compressEntry(it.value());
+        }
+    }
+}
+
+qint64 BlobStore::compressionThreshold() const
+{
+    return m_compressionThreshold;
+}
+
+void BlobStore::compress(const QByteArray &digest)
+{
+    const auto it = m_entries.find(digest);
+    if (it != m_entries.end() && it->body != Utf8Arena::Null) {
+        compressEntry(it.value());
+    }
+}
+
+quint64 BlobStore::nextEpoch()
+{
+    return ++m_epoch;
+}
+
+void BlobStore::collectGarbage(quint64 beforeEpoch)
+{
+    for (auto it = m_released.begin(); it != m_released.end();) {
+        if (it.value() < beforeEpoch) {
+            if (hasStorage()) {
+                QFile::remove(blobPath(it.key()));
+            }
+            it = m_released.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+int BlobStore::count() const
+{
+    return int(m_entries.size());
+}
+
+qint64 BlobStore::residentBytes() const
+{
+    return m_residentBytes;
+}
+
+BlobStore::Stats BlobStore::stats() const
+{
+    Stats stats;
+    for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it) {
+        if (it->body == Utf8Arena::Null) {
+            continue;
+        }
+        ++stats.bodies;
+        if (it->compressed) {
+            ++stats.compressedBodies;
+        }
+    }
+    stats.rawBytes = m_rawBytes;
+    stats.residentBytes = m_residentBytes;
+    const Utf8Arena::Stats arena = m_arena.stats();
+    stats.chunks = arena.chunks;
+    stats.reservedBytes = arena.reservedBytes;
+    return stats;
+}
+
+QByteArray BlobStore::digest(const QByteArray &data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+}
+
+bool BlobStore::packBody(Prepared &body)
+{
+    if (body.compressed || body.incompressible || body.data.size() < kMinCompressSize) {
+        return false;
+    }
+
+    const QByteArray packed = qCompress(body.data);
+    if (packed.size() >= body.data.size()) {
+        body.incompressible = true; // Уже сжатые данные, картинки в base64 и т.п.
+        return false;
+    }
+    body.data = packed;
+    body.compressed = true;
+    return true;
+}
+
+BlobStore::Prepared BlobStore::residentBody(const Entry &entry) const
+{
+    Prepared body;
+    body.data = m_arena.bytes(entry.body);
+    body.size = entry.size;
+    body.compressed = entry.compressed;
+    body.incompressible = entry.incompressible;
+    return body;
+}
+
+void BlobStore::storeResident(Entry &entry, const Prepared &body) const
+{
+    entry.body = m_arena.store(body.data);
+    entry.size = body.size;
+    entry.compressed = body.compressed;
+    entry.incompressible = body.incompressible;
+    m_residentBytes += body.data.size();
+    if (entry.body != Utf8Arena::Null) {
+        m_rawBytes += entry.size;
+    }
+}
+
+bool BlobStore::compressEntry(Entry &entry) const
+{
+    if (entry.compressed || entry.incompressible) {
+        return false;
+    }
+
+    Prepared body = residentBody(entry);
+    if (!packBody(body)) {
+        entry.incompressible = body.incompressible;
+        return false;
+    }
+    // Сжатая копия занимает новое место в арене, старое уплотнится позже
+    dropResident(entry);
+    storeResident(entry, body);
+    return true;
+}
+
+bool BlobStore::loadEntry(const QByteArray &digest, Entry &entry) const
+{
+    SMARTCLIP_TRACE("blobs.load");
+    if (!entry.stored || !hasStorage()) {
+        return false;
+    }
+
+    // Ленивая загрузка тела с диска при первом обращении
+    QFile f(blobPath(digest));
+    if (!f.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray payload = m_crypto->decrypt(f.readAll());
+    if (payload.isEmpty()) {
+        return false;
+    }
+
+    Prepared body;
+    body.data = payload.mid(1);
+    body.incompressible = entry.incompressible;
+    if (payload.at(0) == CodecZlib) {
+        if (body.data.size() < qsizetype(sizeof(quint32))) {
+            return false;
+        }
+        // qCompress хранит исходный размер в первых четырёх байтах
+        body.size = qFromBigEndian<quint32>(body.data.constData());
+        if (m_compressionThreshold > 0 && body.size >= m_compressionThreshold) {
+            body.compressed = true;
+        } else {
+            body.data = qUncompress(body.data);
+        }
+    } else if (payload.at(0) == CodecRaw) {
+        body.size = body.data.size();
+    } else {
+        return false;
+    }
+
+    if (body.data.isEmpty()) {
+        return false;
+    }
+    storeResident(entry, body);
+    return true;
+}
+
+void BlobStore::dropResident(Entry &entry) const
+{
+    if (entry.body != Utf8Arena::Null) {
+        m_residentBytes -= m_arena.size(entry.body);
+        m_rawBytes -= entry.size;
+        m_arena.release(entry.body);
+        entry.body = Utf8Arena::Null;
+    }
+    entry.compressed = false;
+}
+
+QString BlobStore::blobPath(const QByteArray &digest) const
+{
+    return blobPath(m_directory, m_crypto, digest);
+}
+
+QString BlobStore::blobPath(const QString &directory, const CryptoManager *crypto, const QByteArray &digest)
+{
+    const QString name = QString::fromLatin1(crypto->keyedDigest(digest).toHex());
+    return directory + QLatin1Char('/') + name.left(2) + QLatin1Char('/') + name;
+}
+
+bool BlobStore::writeBlob(const QByteArray &digest, const Prepared &body) const
+{
+    return writeBlob(m_directory, m_crypto, digest, body);
+}
+
+bool BlobStore::writeBlob(const QString &directory, const CryptoManager *crypto, const QByteArray &digest,
+                          const Prepared &body)
+{
+    SMARTCLIP_TRACE("blobs.write", body.data.size());
+    const QString path = blobPath(directory, crypto, digest);
+    if (QFile::exists(path)) {
+        return true; // Тот же контент уже записан
+    }
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // На диск сжимаем всё, что сжимается, независимо от порога для памяти
+    QByteArray payload;
+    if (body.compressed) {
+        payload = char(CodecZlib) + body.data;
+    } else {
+        const QByteArray packed = (body.incompressible || body.data.size() < kMinCompressSize)
+            ? QByteArray() : qCompress(body.data);
+        if (!packed.isEmpty() && packed.size() < body.data.size()) {
+            payload = char(CodecZlib) + packed;
+        } else {
+            payload = char(CodecRaw) + body.data;
+        }
+    }
+
+    QSaveFile f(path);
+    if (!f.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    f.write(crypto->encrypt(payload));
+    f.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    return f.commit();
+}
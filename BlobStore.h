@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Utf8Arena.h"
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+class CryptoManager;
+
+// Content-addressed store for clip bodies, keyed by the SHA-256 of the body.
+// Identical bodies are kept once and reference-counted. With storage enabled
+// every body is also written encrypted to <directory>/<xx>/<name>, where the
+// file name is a keyed hash of the digest so it does not reveal the content.
+// Bodies of loaded history stay on disk until data() asks for them.
+// Large or cold bodies are kept zlib-compressed, in memory and on disk;
+// data() always returns the original bytes. Resident bodies live in a
+// Utf8Arena rather than in one heap block each.
+class BlobStore final
+{
+public:
+    BlobStore() = default;
+
+    // An empty directory disables persistence; bodies that were only on disk
+    // are read back into memory first.
+    void setStorage(const QString &directory, const CryptoManager *crypto);
+    bool hasStorage() const;
+
+    // Adds a reference; a new body is kept in memory and written to disk
+    void acquire(const QByteArray &digest, const QByteArray &data);
+    // Adds a reference to a body that is already on disk
+    void acquireStored(const QByteArray &digest);
+
+    // A body hashed, compressed and written to disk off the GUI thread by
+    // prepare(); acquirePrepared() only does the bookkeeping.
+    struct Prepared {
+        QByteArray digest;
+        QByteArray data;     // compressed when compressed is set
+        qint64 size = 0;     // uncompressed size
+        bool compressed = false;
+        bool incompressible = false;
+        QString directory;   // where the file was written, empty if it was not
+    };
+    // Thread-safe: touches no store state. directory and crypto are the
+    // storage settings at the time of the call; an empty directory skips the write.
+    static Prepared prepare(const QByteArray &data, const QString &directory, const CryptoManager *crypto,
+                            qint64 compressionThreshold);
+    // Adds a reference; the body stays on disk when its file is still in this
+    // store's directory, otherwise it is kept in memory and written again.
+    // The file may be gone even though prepare() found it: a released body's
+    // file can be collected between prepare() and this call.
+    void acquirePrepared(const Prepared &body);
+    QString directory() const;
+    void release(const QByteArray &digest);
+    bool contains(const QByteArray &digest) const;
+    int refCount(const QByteArray &digest) const;
+    QByteArray data(const QByteArray &digest) const;
+    // Whether data() can answer without reading the disk
+    bool isResident(const QByteArray &digest) const;
+    // Drops the cached copy of a body that is also on disk; the next data()
+    // reads it again. Bodies held only in memory are kept.
+    void evict(const QByteArray &digest) const;
+
+    // Bodies of at least this many bytes stay compressed in memory; 0 disables
+    void setCompressionThreshold(qint64 bytes);
+    qint64 compressionThreshold() const;
+    // Compresses a resident body regardless of its size (cold items)
+    void compress(const QByteArray &digest);
+
+    // Files of bodies released before the epoch returned for a snapshot are
+    // deleted by collectGarbage() once that snapshot has been written.
+    quint64 nextEpoch();
+    void collectGarbage(quint64 beforeEpoch);
+
+    struct Stats {
+        int bodies = 0;            // resident bodies
+        int compressedBodies = 0;
+        qint64 rawBytes = 0;       // their size before compression
+        qint64 residentBytes = 0;  // memory they actually take
+        int chunks = 0;            // arena blocks holding them
+        qint64 reservedBytes = 0;  // capacity of those blocks
+    };
+
+    int count() const;
+    qint64 residentBytes() const;
+    Stats stats() const;
+
+    static QByteArray digest(const QByteArray &data);
+
+private:
+    struct Entry {
+        int refs = 0;
+        Utf8Arena::Handle body = Utf8Arena::Null; // Null while the body is only on disk
+        qint64 size = 0;  // uncompressed size of a resident body
+        bool compressed = false;
+        bool incompressible = false; // compression did not pay off, don't retry
+        bool stored = false;
+    };
+
+    static bool packBody(Prepared &body);
+    static QString blobPath(const QString &directory, const CryptoManager *crypto, const QByteArray &digest);
+    static bool writeBlob(const QString &directory, const CryptoManager *crypto, const QByteArray &digest,
+                          const Prepared &body);
+    Prepared residentBody(const Entry &entry) const;
+    void storeResident(Entry &entry, const Prepared &body) const;
+    bool compressEntry(Entry &entry) const;
+    bool loadEntry(const QByteArray &digest, Entry &entry) const;
+    void dropResident(Entry &entry) const;
+    QString blobPath(const QByteArray &digest) const;
+    bool writeBlob(const QByteArray &digest, const Prepared &body) const;
+
+    mutable QHash<QByteArray, Entry> m_entries; // data() caches bodies read from disk
+    mutable Utf8Arena m_arena;
+    mutable qint64 m_residentBytes = 0;
+    mutable qint64 m_rawBytes = 0;
+    qint64 m_compressionThreshold = 0;
+    QHash<QByteArray, quint64> m_released; // digest -> epoch of the release
+    QString m_directory;
+    const CryptoManager *m_crypto = nullptr;
+    quint64 m_epoch = 0;
+};
@@ -0,0 +1,419 @@
+#include "ChaCha20Poly1305.h"
+#include <cstring>
+
+// SMARTCLIP_CHACHA_PORTABLE оставляет только скалярный путь, чтобы тесты
+// проверяли оба на одной машине
+#if defined(SMARTCLIP_CHACHA_PORTABLE)
+#elif defined(__SSE2__) || defined(_M_X64)
+ #include <emmintrin.h>
+ #define SMARTCLIP_CHACHA_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+ #include <arm_neon.h>
+ #define SMARTCLIP_CHACHA_NEON 1
+#endif
+
+namespace {
+
+const quint32 kSigma[4] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574}; // "expand 32-byte k"
+const int kBlockSize = 64;
+
+inline quint32 load32(const quint8 *p)
+{
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+inline void store32(quint8 *p, quint32 v)
+{
+    p[0] = quint8(v);
+    p[1] = quint8(v >> 8);
+    p[2] = quint8(v >> 16);
+    p[3] = quint8(v >> 24);
+}
+
+inline quint32 rotl(quint32 v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+#define CHACHA_QR(a, b, c, d)                    \
+    a += b; d ^= a; d = rotl(d, 16);             \
+    c += d; b ^= c; b = rotl(b, 12);             \
+    a += b; d ^= a; d = rotl(d, 8);              \
+    c += d; b ^= c; b = rotl(b, 7);
+
+void initState(quint32 state[16], const quint32 key[8], quint32 counter, const quint8 *nonce)
+{
+    std::memcpy(state, kSigma, sizeof(kSigma));
+    std::memcpy(state + 4, key, 8 * sizeof(quint32));
+    state[12] = counter;
+    state[13] = load32(nonce);
+    state[14] = load32(nonce + 4);
+    state[15] = load32(nonce + 8);
+}
+
+void chachaBlock(const quint32 state[16], quint8 out[kBlockSize])
+{
+    quint32 x[16];
+    std::memcpy(x, state, sizeof(x));
+    for (int i = 0; i < 10; ++i) {
+        CHACHA_QR(x[0], x[4], x[8], x[12]);
+        CHACHA_QR(x[1], x[5], x[9], x[13]);
+        CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CHACHA_QR(x[2], x[7], x[8], x[13]);
+        CHACHA_QR(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) {
+        store32(out + 4 * i, x[i] + state[i]);
+    }
+}
+
+#if defined(SMARTCLIP_CHACHA_SSE2)
+
+inline __m128i rotlVec(__m128i v, int n)
+{
+    return _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n));
+}
+
+#define CHACHA_QR_VEC(a, b, c, d)                                                   \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = rotlVec(d, 16);           \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = rotlVec(b, 12);           \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = rotlVec(d, 8);            \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = rotlVec(b, 7);
+
+// Четыре блока за проход: v[i] хранит слово i всех четырёх блоков
+void xorBlocks4(quint32 state[16], const quint8 *in, quint8 *out)
+{
+    __m128i s[16];
+    for (int i = 0; i < 16; ++i) {
+        s[i] = _mm_set1_epi32(int(state[i]));
+    }
+    s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+
+    __m128i v[16];
+    std::memcpy(v, s, sizeof(v));
+    for (int i = 0; i < 10; ++i) {
+        CHACHA_QR_VEC(v[0], v[4], v[8], v[12]);
+        CHACHA_QR_VEC(v[1], v[5], v[9], v[13]);
+        CHACHA_QR_VEC(v[2], v[6], v[10], v[14]);
+        CHACHA_QR_VEC(v[3], v[7], v[11], v[15]);
+        CHACHA_QR_VEC(v[0], v[5], v[10], v[15]);
+        CHACHA_QR_VEC(v[1], v[6], v[11], v[12]);
+        CHACHA_QR_VEC(v[2], v[7], v[8], v[13]);
+        CHACHA_QR_VEC(v[3], v[4], v[9], v[14]);
+    }
+
+    for (int g = 0; g < 4; ++g) {
+        // Транспонируем четвёрку слов 4g..4g+3 из «по словам» в «по блокам»
+        const __m128i a = _mm_add_epi32(v[4 * g], s[4 * g]);
+        const __m128i b = _mm_add_epi32(v[4 * g + 1], s[4 * g + 1]);
+        const __m128i c = _mm_add_epi32(v[4 * g + 2], s[4 * g + 2]);
+        const __m128i d = _mm_add_epi32(v[4 * g + 3], s[4 * g + 3]);
+        const __m128i t0 = _mm_unpacklo_epi32(a, b);
+        const __m128i t1 = _mm_unpacklo_epi32(c, d);
+        const __m128i t2 = _mm_unpackhi_epi32(a, b);
+        const __m128i t3 = _mm_unpackhi_epi32(c, d);
+        const __m128i rows[4] = {
+            _mm_unpacklo_epi64(t0, t1),
+            _mm_unpackhi_epi64(t0, t1),
+            _mm_unpacklo_epi64(t2, t3),
+            _mm_unpackhi_epi64(t2, t3),
+        };
+        for (int block = 0; block < 4; ++block) {
+            const int offset = block * kBlockSize + g * 16;
+            const __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + offset));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + offset), _mm_xor_si128(data, rows[block]));
+        }
+    }
+    state[12] += 4;
+}
+
+#elif defined(SMARTCLIP_CHACHA_NEON)
+
+#define ROTL_VEC(v, n) vsriq_n_u32(vshlq_n_u32(v, n), v, 32 - n)
+
+#define CHACHA_QR_VEC(a, b, c, d)                                           \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); d = ROTL_VEC(d, 16);          \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = ROTL_VEC(b, 12);          \
+    a = vaddq_u32(a, b); d = veorq_u32(d, a); d = ROTL_VEC(d, 8);           \
+    c = vaddq_u32(c, d); b = veorq_u32(b, c); b = ROTL_VEC(b, 7);
+
+// Четыре блока за проход: v[i] хранит слово i всех четырёх блоков
+void xorBlocks4(quint32 state[16], const quint8 *in, quint8 *out)
+{
+    static const quint32 kLanes[4] = {0, 1, 2, 3};
+
+    uint32x4_t s[16];
+    for (int i = 0; i < 16; ++i) {
+        s[i] = vdupq_n_u32(state[i]);
+    }
+    s[12] = vaddq_u32(s[12], vld1q_u32(kLanes));
+
+    uint32x4_t v[16];
+    for (int i = 0; i < 16; ++i) {
+        v[i] = s[i];
+    }
+    for (int i = 0; i < 10; ++i) {
+        CHACHA_QR_VEC(v[0], v[4], v[8], v[12]);
+        CHACHA_QR_VEC(v[1], v[5], v[9], v[13]);
+        CHACHA_QR_VEC(v[2], v[6], v[10], v[14]);
+        CHACHA_QR_VEC(v[3], v[7], v[11], v[15]);
+        CHACHA_QR_VEC(v[0], v[5], v[10], v[15]);
+        CHACHA_QR_VEC(v[1], v[6], v[11], v[12]);
+        CHACHA_QR_VEC(v[2], v[7], v[8], v[13]);
+        CHACHA_QR_VEC(v[3], v[4], v[9], v[14]);
+    }
+
+    for (int g = 0; g < 4; ++g) {
+        // Транспонируем четвёрку слов 4g..4g+3 из «по словам» в «по блокам»
+        const uint32x4x2_t ab = vtrnq_u32(vaddq_u32(v[4 * g], s[4 * g]), vaddq_u32(v[4 * g + 1], s[4 * g + 1]));
+        const uint32x4x2_t cd = vtrnq_u32(vaddq_u32(v[4 * g + 2], s[4 * g + 2]), vaddq_u32(v[4 * g + 3], s[4 * g + 3]));
+        const uint32x4_t rows[4] = {
+            vcombine_u32(vget_low_u32(ab.val[0]), vget_low_u32(cd.val[0])),
+            vcombine_u32(vget_low_u32(ab.val[1]), vget_low_u32(cd.val[1])),
+            vcombine_u32(vget_high_u32(ab.val[0]), vget_high_u32(cd.val[0])),
+            vcombine_u32(vget_high_u32(ab.val[1]), vget_high_u32(cd.val[1])),
+        };
+        for (int block = 0; block < 4; ++block) {
+            const int offset = block * kBlockSize + g * 16;
+            const uint8x16_t data = vld1q_u8(in + offset);
+            vst1q_u8(out + offset, veorq_u8(data, vreinterpretq_u8_u32(rows[block])));
+        }
+    }
+    state[12] += 4;
+}
+
+#endif
+
+void xorKeystream(const quint32 key[8], quint32 counter, const quint8 *nonce,
+                  const quint8 *in, qsizetype length, quint8 *out)
+{
+    quint32 state[16];
+    initState(state, key, counter, nonce);
+
+#if defined(SMARTCLIP_CHACHA_SSE2) || defined(SMARTCLIP_CHACHA_NEON)
+    while (length >= 4 * kBlockSize) {
+        xorBlocks4(state, in, out);
+        in += 4 * kBlockSize;
+        out += 4 * kBlockSize;
+        length -= 4 * kBlockSize;
+    }
+#endif
+
+    quint8 block[kBlockSize];
+    while (length > 0) {
+        chachaBlock(state, block);
+        ++state[12];
+        const qsizetype n = qMin<qsizetype>(length, kBlockSize);
+        for (qsizetype i = 0; i < n; ++i) {
+            out[i] = in[i] ^ block[i];
+        }
+        in += n;
+        out += n;
+        length -= n;
+    }
+
+    std::memset(state, 0, sizeof(state));
+    std::memset(block, 0, sizeof(block));
+}
+
+// Poly1305 на 26-битных лимбах (poly1305-donna-32), без ветвлений по данным
+class Poly1305
+{
+public:
+    explicit Poly1305(const quint8 key[32])
+    {
+        r[0] = load32(key) & 0x3ffffff;
+        r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+        r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+        r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+        r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+        for (int i = 0; i < 4; ++i) {
+            pad[i] = load32(key + 16 + 4 * i);
+        }
+    }
+
+    ~Poly1305()
+    {
+        std::memset(r, 0, sizeof(r));
+        std::memset(h, 0, sizeof(h));
+        std::memset(pad, 0, sizeof(pad));
+    }
+
+    // Добавляет данные, дополняя последний неполный блок нулями (pad16 из RFC 8439)
+    void updatePadded(const quint8 *data, qsizetype length)
+    {
+        while (length >= 16) {
+            block(data);
+            data += 16;
+            length -= 16;
+        }
+        if (length > 0) {
+            quint8 last[16] = {};
+            std::memcpy(last, data, size_t(length));
+            block(last);
+        }
+    }
+
+    void update(const quint8 data[16])
+    {
+        block(data);
+    }
+
+    void finish(quint8 tag[16])
+    {
+        const quint32 mask = 0x3ffffff;
+        quint32 h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+        quint32 c = h1 >> 26; h1 &= mask;
+        h2 += c; c = h2 >> 26; h2 &= mask;
+        h3 += c; c = h3 >> 26; h3 &= mask;
+        h4 += c; c = h4 >> 26; h4 &= mask;
+        h0 += c * 5; c = h0 >> 26; h0 &= mask;
+        h1 += c;
+
+        // g = h + 5 - 2^130; берём g, если h >= p
+        quint32 g0 = h0 + 5; c = g0 >> 26; g0 &= mask;
+        quint32 g1 = h1 + c; c = g1 >> 26; g1 &= mask;
+        quint32 g2 = h2 + c; c = g2 >> 26; g2 &= mask;
+        quint32 g3 = h3 + c; c = g3 >> 26; g3 &= mask;
+        quint32 g4 = h4 + c - (1u << 26);
+
+        quint32 select = (g4 >> 31) - 1;
+        g0 &= select; g1 &= select; g2 &= select; g3 &= select; g4 &= select;
+        select = ~select;
+        h0 = (h0 & select) | g0;
+        h1 = (h1 & select) | g1;
+        h2 = (h2 & select) | g2;
+        h3 = (h3 & select) | g3;
+        h4 = (h4 & select) | g4;
+
+        h0 = h0 | (h1 << 26);
+        h1 = (h1 >> 6) | (h2 << 20);
+        h2 = (h2 >> 12) | (h3 << 14);
+        h3 = (h3 >> 18) | (h4 << 8);
+
+        quint64 f = quint64(h0) + pad[0];
+        store32(tag, quint32(f));
+        f = quint64(h1) + pad[1] + (f >> 32);
+        store32(tag + 4, quint32(f));
+        f = quint64(h2) + pad[2] + (f >> 32);
+        store32(tag + 8, quint32(f));
+        f = quint64(h3) + pad[3] + (f >> 32);
+        store32(tag + 12, quint32(f));
+    }
+
+private:
+    void block(const quint8 *m)
+    {
+        const quint32 mask = 0x3ffffff;
+        const quint32 s1 = r[1] * 5, s2 = r[2] * 5, s3 = r[3] * 5, s4 = r[4] * 5;
+
+        quint32 h0 = h[0] + (load32(m) & mask);
+        quint32 h1 = h[1] + ((load32(m + 3) >> 2) & mask);
+        quint32 h2 = h[2] + ((load32(m + 6) >> 4) & mask);
+        quint32 h3 = h[3] + ((load32(m + 9) >> 6) & mask);
+        quint32 h4 = h[4] + ((load32(m + 12) >> 8) | (1u << 24));
+
+        const quint64 d0 = quint64(h0) * r[0] + quint64(h1) * s4 + quint64(h2) * s3 + quint64(h3) * s2 + quint64(h4) * s1;
+        quint64 d1 = quint64(h0) * r[1] + quint64(h1) * r[0] + quint64(h2) * s4 + quint64(h3) * s3 + quint64(h4) * s2;
+        quint64 d2 = quint64(h0) * r[2] + quint64(h1) * r[1] + quint64(h2) * r[0] + quint64(h3) * s4 + quint64(h4) * s3;
+        quint64 d3 = quint64(h0) * r[3] + quint64(h1) * r[2] + quint64(h2) * r[1] + quint64(h3) * r[0] + quint64(h4) * s4;
+        quint64 d4 = quint64(h0) * r[4] + quint64(h1) * r[3] + quint64(h2) * r[2] + quint64(h3) * r[1] + quint64(h4) * r[0];
+
+        quint32 c = quint32(d0 >> 26); h0 = quint32(d0) & mask;
+        d1 += c; c = quint32(d1 >> 26); h1 = quint32(d1) & mask;
+        d2 += c; c = quint32(d2 >> 26); h2 = quint32(d2) & mask;
+        d3 += c; c = quint32(d3 >> 26); h3 = quint32(d3) & mask;
+        d4 += c; c = quint32(d4 >> 26); h4 = quint32(d4) & mask;
+        h0 += c * 5; c = h0 >> 26; h0 &= mask;
+        h1 += c;
+
+        h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+    }
+
+    quint32 r[5];
+    quint32 h[5] = {};
+    quint32 pad[4];
+};
+
+} // namespace
+
+ChaCha20Poly1305::ChaCha20Poly1305(const quint8 *key)
+{
+    for (int i = 0; i < 8; ++i) {
+        m_key[i] = load32(key + 4 * i);
+    }
+}
+
+ChaCha20Poly1305::~ChaCha20Poly1305()
+{
+    // volatile, чтобы компилятор не выбросил затирание ключа
+    volatile quint32 *key = m_key;
+    for (int i = 0; i < 8; ++i) {
+        key[i] = 0;
+    }
+}
+
+void ChaCha20Poly1305::computeTag(const quint8 *nonce, const quint8 *aad, qsizetype aadLength,
+                                  const quint8 *ciphertext, qsizetype length, quint8 *tag) const
+{
+    // Одноразовый ключ Poly1305 — первые 32 байта блока с нулевым счётчиком
+    quint32 state[16];
+    quint8 block[kBlockSize];
+    initState(state, m_key, 0, nonce);
+    chachaBlock(state, block);
+
+    Poly1305 mac(block);
+    mac.updatePadded(aad, aadLength);
+    mac.updatePadded(ciphertext, length);
+    quint8 lengths[16];
+    store32(lengths, quint32(quint64(aadLength)));
+    store32(lengths + 4, quint32(quint64(aadLength) >> 32));
+    store32(lengths + 8, quint32(quint64(length)));
+    store32(lengths + 12, quint32(quint64(length) >> 32));
+    mac.update(lengths);
+    mac.finish(tag);
+
+    std::memset(state, 0, sizeof(state));
+    std::memset(block, 0, sizeof(block));
+}
+
+void ChaCha20Poly1305::seal(const quint8 *nonce, const quint8 *aad, qsizetype aadLength,
+                            const quint8 *in, qsizetype length, quint8 *out, quint8 *tag) const
+{
+    xorKeystream(m_key, 1, nonce, in, length, out);
+    computeTag(nonce, aad, aadLength, out, length, tag);
+}
+
+bool ChaCha20Poly1305::open(const quint8 *nonce, const quint8 *aad, qsizetype aadLength,
+                            const quint8 *in, qsizetype length, const quint8 *tag, quint8 *out) const
+{
+    quint8 expected[TagSize];
+    computeTag(nonce, aad, aadLength, in, length, expected);
+
+    // Сравнение за постоянное время
+    quint8 diff = 0;
+    for (int i = 0; i < TagSize; ++i) {
+        diff |= quint8(expected[i] ^ tag[i]);
+    }
+    if (diff != 0) {
+        return false;
+    }
+
+    xorKeystream(m_key, 1, nonce, in, length, out);
+    return true;
+}
+
+const char *ChaCha20Poly1305::implementation()
+{
+#if defined(SMARTCLIP_CHACHA_SSE2)
+    return "sse2";
+#elif defined(SMARTCLIP_CHACHA_NEON)
+    return "neon";
+#else
+    return "portable";
+#endif
+}
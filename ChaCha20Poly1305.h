@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QtGlobal>
+
+// ChaCha20-Poly1305 AEAD (RFC 8439). The keystream is generated four blocks
+// at a time with SSE2 on x86-64 and NEON on ARM64, both baseline on these
+// targets; other CPUs, and builds with SMARTCLIP_CHACHA_PORTABLE defined, use
+// the portable scalar path. Instances are immutable after construction and
+// safe to share between threads.
+class ChaCha20Poly1305 final
+{
+public:
+    static constexpr int KeySize = 32;
+    static constexpr int NonceSize = 12;
+    static constexpr int TagSize = 16;
+
+    explicit ChaCha20Poly1305(const quint8 *key);
+    ~ChaCha20Poly1305();
+
+    ChaCha20Poly1305(const ChaCha20Poly1305 &) = delete;
+    ChaCha20Poly1305 &operator=(const ChaCha20Poly1305 &) = delete;
+
+    // out receives length bytes of ciphertext, tag receives TagSize bytes.
+    // in and out may point to the same buffer.
+    void seal(const quint8 *nonce, const quint8 *aad, qsizetype aadLength,
+              const quint8 *in, qsizetype length, quint8 *out, quint8 *tag) const;
+    // Returns false, leaving out untouched, when the tag does not match
+    bool open(const quint8 *nonce, const quint8 *aad, qsizetype aadLength,
+              const quint8 *in, qsizetype length, const quint8 *tag, quint8 *out) const;
+
+    // Name of the keystream implementation compiled in, for diagnostics
+    static const char *implementation();
+
+private:
+    void computeTag(const quint8 *nonce, const quint8 *aad, qsizetype aadLength,
+                    const quint8 *ciphertext, qsizetype length, quint8 *tag) const;
+
+    quint32 m_key[8];
+};
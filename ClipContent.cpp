@@ -0,0 +1,161 @@
+#include "ClipContent.h"
+#include <QBuffer>
+#include <QFileInfo>
+#include <QHash>
+#include <QImageReader>
+#include <QMimeData>
+#include <QRegularExpression>
+#include <QUrl>
+
+namespace {
+
+// Столько байт с каждого края попадает в отпечаток крупного содержимого
+const qsizetype kFingerprintSample = 64 * 1024;
+const size_t kFingerprintSeed = 0x5c1f;
+
+size_t sampledHash(QByteArrayView bytes)
+{
+    if (bytes.size() <= 2 * kFingerprintSample) {
+        return qHashMulti(kFingerprintSeed, bytes.size(), qHash(bytes, kFingerprintSeed));
+    }
+    return qHashMulti(kFingerprintSeed, bytes.size(), qHash(bytes.first(kFingerprintSample), kFingerprintSeed),
+                      qHash(bytes.last(kFingerprintSample), kFingerprintSeed));
+}
+
+} // namespace
+
+bool ClipContent::isRich(const QMimeData *mime)
+{
+    return mime && (mime->hasImage() || mime->hasUrls() || mime->hasHtml());
+}
+
+ClipContent ClipContent::capture(const QMimeData *mime)
+{
+    ClipContent content;
+    if (!mime) {
+        return content;
+    }
+
+    if (mime->hasText()) {
+        content.text = mime->text();
+    }
+    if (mime->hasHtml()) {
+        content.formats.push_back({QString::fromLatin1(HtmlType), mime->data(QString::fromLatin1(HtmlType))});
+    }
+    if (mime->hasUrls()) {
+        content.formats.push_back({QString::fromLatin1(UriListType), mime->data(QString::fromLatin1(UriListType))});
+        // У скопированных файлов картинка — это их иконка, её не храним
+        return content;
+    }
+
+    // Готовый PNG берём как есть; декодированную картинку кодирует рабочий поток
+    if (mime->hasFormat(QString::fromLatin1(PngType))) {
+        content.formats.push_back({QString::fromLatin1(PngType), mime->data(QString::fromLatin1(PngType))});
+    } else if (mime->hasImage()) {
+        content.image = qvariant_cast<QImage>(mime->imageData());
+    }
+    return content;
+}
+
+QMimeData *ClipContent::toMimeData(const QVector<Format> &parts)
+{
+    auto *mime = new QMimeData;
+    for (const Format &part : parts) {
+        if (part.first == QLatin1String(TextType)) {
+            mime->setText(QString::fromUtf8(part.second));
+            continue;
+        }
+        mime->setData(part.first, part.second);
+        if (part.first == QLatin1String(PngType)) {
+            // Конвертеры платформ надёжно отдают другим приложениям только
+            // декодированную картинку; тело декодируется лишь при вставке
+            mime->setImageData(QImage::fromData(part.second, "PNG"));
+        }
+    }
+    return mime;
+}
+
+bool ClipContent::isRich() const
+{
+    return !formats.isEmpty() || !image.isNull();
+}
+
+void ClipContent::encode()
+{
+    if (image.isNull()) {
+        return;
+    }
+
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+    if (image.save(&buffer, "PNG")) {
+        formats.push_back({QString::fromLatin1(PngType), png});
+    }
+    image = QImage();
+}
+
+QString ClipContent::describe() const
+{
+    for (const Format &format : formats) {
+        if (format.first == QLatin1String(PngType)) {
+            // Размер читается из заголовка, картинка не декодируется
+            QBuffer buffer;
+            buffer.setData(format.second);
+            buffer.open(QIODevice::ReadOnly);
+            const QSize size = QImageReader(&buffer, "PNG").size();
+            return QStringLiteral("Image %1×%2").arg(size.width()).arg(size.height());
+        }
+    }
+    if (!image.isNull()) {
+        return QStringLiteral("Image %1×%2").arg(image.width()).arg(image.height());
+    }
+
+    for (const Format &format : formats) {
+        if (format.first == QLatin1String(UriListType)) {
+            QStringList names;
+            for (const QByteArray &line : format.second.split('\n')) {
+                const QByteArray trimmed = line.trimmed();
+                if (!trimmed.isEmpty() && !trimmed.startsWith('#')) {
+                    const QUrl url = QUrl::fromEncoded(trimmed);
+                    names.push_back(url.isLocalFile() ? QFileInfo(url.toLocalFile()).fileName() : url.toString());
+                }
+            }
+            if (names.size() == 1) {
+                return names.first();
+            }
+            return QStringLiteral("%1 files: %2").arg(names.size()).arg(names.join(QStringLiteral(", ")));
+        }
+    }
+
+    for (const Format &format : formats) {
+        if (format.first == QLatin1String(HtmlType)) {
+            static const QRegularExpression tags(QStringLiteral("<[^>]*>"));
+            return QString::fromUtf8(format.second).remove(tags).simplified();
+        }
+    }
+    return QString();
+}
+
+size_t ClipContent::fingerprint() const
+{
+    size_t hash = qHashMulti(kFingerprintSeed, text.size(),
+                             qHash(QStringView(text).left(kFingerprintSample), kFingerprintSeed));
+    for (const Format &format : formats) {
+        hash = qHashMulti(hash, format.first, sampledHash(format.second));
+    }
+    if (!image.isNull()) {
+        hash = qHashMulti(hash, image.width(), image.height(),
+                          sampledHash(QByteArrayView(image.constBits(), image.sizeInBytes())));
+    }
+    return hash;
+}
+
+qint64 ClipContent::byteSize() const
+{
+    qint64 size = text.size() * qint64(sizeof(QChar));
+    for (const Format &format : formats) {
+        size += format.second.size();
+    }
+    return size + image.sizeInBytes();
+}
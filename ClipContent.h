@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <utility>
+
+class QMimeData;
+
+// Clipboard content beyond plain text: HTML, file URLs and images.
+// capture() runs on the GUI thread and only copies the bytes the platform
+// hands out. When the clipboard offers a decoded image and no PNG, encoding
+// it is left to encode(), which ClipIngestor calls on its worker thread.
+class ClipContent final
+{
+public:
+    using Format = std::pair<QString, QByteArray>; // MIME type, bytes
+
+    static constexpr const char *TextType = "text/plain";
+    static constexpr const char *HtmlType = "text/html";
+    static constexpr const char *UriListType = "text/uri-list";
+    static constexpr const char *PngType = "image/png";
+
+    QString text;            // text/plain, may be empty
+    QVector<Format> formats; // everything but text/plain, in the order above
+    QImage image;            // decoded image still waiting for encode()
+
+    // Whether the clipboard holds more than plain text worth keeping
+    static bool isRich(const QMimeData *mime);
+    static ClipContent capture(const QMimeData *mime);
+    // Built from stored parts when an item is pasted; the caller owns the result
+    static QMimeData *toMimeData(const QVector<Format> &parts);
+
+    bool isRich() const;
+    // Turns image into a PNG format; call off the GUI thread
+    void encode();
+    // Menu preview for content without text: image size or file names
+    QString describe() const;
+    // Cheap identity for change detection: sizes plus sampled bytes, so a
+    // screenshot is not hashed in full on the GUI thread
+    size_t fingerprint() const;
+    qint64 byteSize() const;
+};
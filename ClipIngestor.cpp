@@ -0,0 +1,175 @@
+#include "ClipIngestor.h"
+#include "Trace.h"
+#include <QMutexLocker>
+#include <algorithm>
+
+ClipIngestor::ClipIngestor(const CryptoManager *crypto, QObject *parent)
+    : QObject(parent)
+    , m_crypto(crypto)
+{
+    m_thread.reset(QThread::create([this]() {
+        run();
+    }));
+    m_thread->setObjectName(QStringLiteral("SmartClip ingestion"));
+    m_thread->start(QThread::LowPriority);
+}
+
+ClipIngestor::~ClipIngestor()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+    // Начатый клип доводится до конца, очередь отбрасывается
+    m_thread->wait();
+}
+
+void ClipIngestor::ingest(const QString &text, qint64 addedAtMs, const QString &blobDirectory,
+                          qint64 compressionThreshold)
+{
+    ClipContent content;
+    content.text = text; // Неявно разделяемая копия: O(1)
+    ingest(content, addedAtMs, blobDirectory, compressionThreshold);
+}
+
+void ClipIngestor::ingest(const ClipContent &content, qint64 addedAtMs, const QString &blobDirectory,
+                          qint64 compressionThreshold)
+{
+    Job job;
+    job.content = content; // Байты и картинка разделяются неявно
+    job.addedAtMs = addedAtMs;
+    job.blobDirectory = blobDirectory;
+    job.compressionThreshold = compressionThreshold;
+
+    QMutexLocker locker(&m_mutex);
+    m_jobs.enqueue(job);
+    m_wake.wakeOne();
+}
+
+QVector<ClipIngestor::Result> ClipIngestor::takeResults()
+{
+    QMutexLocker locker(&m_mutex);
+    QVector<Result> results;
+    results.swap(m_results);
+    return results;
+}
+
+void ClipIngestor::waitForIdle()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_jobs.isEmpty() || m_working) {
+        m_idle.wait(&m_mutex);
+    }
+}
+
+bool ClipIngestor::isBusy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return !m_jobs.isEmpty() || m_working;
+}
+
+void ClipIngestor::run()
+{
+    for (;;) {
+        Job job;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_jobs.isEmpty() && !m_stopping) {
+                m_wake.wait(&m_mutex);
+            }
+            if (m_stopping) {
+                return;
+            }
+            job = m_jobs.dequeue();
+            m_working = true;
+        }
+
+        const Result result = job.content.isRich() ? prepareRich(job) : prepareText(job);
+        const bool blank = result.item.digest.isEmpty();
+
+        bool notify = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!blank) {
+                notify = m_results.isEmpty(); // Один сигнал на пачку результатов
+                m_results.push_back(result);
+            }
+            m_working = false;
+            if (m_jobs.isEmpty()) {
+                m_idle.wakeAll();
+            }
+        }
+        if (notify) {
+            emit ready();
+        }
+    }
+}
+
+ClipIngestor::Result ClipIngestor::prepareText(Job &job) const
+{
+    SMARTCLIP_TRACE("ingest.text", job.content.text.size());
+    Result result;
+    const QString &text = job.content.text;
+    // Пустой клип узнаётся по первому непробельному символу, без trimmed()
+    const bool blank = std::all_of(text.cbegin(), text.cend(), [](QChar ch) {
+        return ch.isSpace();
+    });
+    if (blank) {
+        return result;
+    }
+
+    result.item.preview = HistoryManager::makePreview(text);
+    result.item.length = text.size();
+    result.item.addedAtMs = job.addedAtMs;
+    QByteArray utf8 = text.toUtf8();
+    job.content.text.clear(); // Дальше нужна только UTF-8 копия
+    result.body = BlobStore::prepare(utf8, job.blobDirectory, m_crypto, job.compressionThreshold);
+    result.item.digest = result.body.digest;
+    return result;
+}
+
+ClipIngestor::Result ClipIngestor::prepareRich(Job &job) const
+{
+    SMARTCLIP_TRACE("ingest.rich", job.content.byteSize());
+    Result result;
+    ClipContent &content = job.content;
+    content.encode();
+
+    const bool hasText = std::any_of(content.text.cbegin(), content.text.cend(), [](QChar ch) {
+        return !ch.isSpace();
+    });
+    result.item.preview = HistoryManager::makePreview(hasText ? content.text : content.describe());
+    // Пустой клип отбрасывается до записи частей: иначе их файлы остались бы
+    // в каталоге тел без единой ссылки
+    if (result.item.preview.isEmpty()) {
+        return result;
+    }
+    result.item.length = hasText ? content.text.size() : 0;
+    result.item.addedAtMs = job.addedAtMs;
+
+    QVector<ClipContent::Format> formats;
+    if (hasText) {
+        formats.push_back({QString::fromLatin1(ClipContent::TextType), content.text.toUtf8()});
+    }
+    formats += content.formats;
+    content = ClipContent(); // Исходные байты больше не нужны
+
+    // Каждая часть — отдельное тело: одна картинка в разных клипах хранится один раз
+    for (const ClipContent::Format &format : std::as_const(formats)) {
+        if (format.second.isEmpty()) {
+            continue;
+        }
+        HistoryManager::Part part;
+        part.mimeType = format.first;
+        part.size = format.second.size();
+        result.parts.push_back(
+            BlobStore::prepare(format.second, job.blobDirectory, m_crypto, job.compressionThreshold));
+        part.digest = result.parts.last().digest;
+        result.item.parts.push_back(part);
+    }
+    if (!result.item.parts.isEmpty()) {
+        result.item.digest = HistoryManager::partsDigest(result.item.parts);
+    }
+    return result;
+}
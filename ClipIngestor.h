@@ -0,0 +1,76 @@
+#pragma once
+
+#include "BlobStore.h"
+#include "ClipContent.h"
+#include "HistoryManager.h"
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <memory>
+
+class CryptoManager;
+
+// Ingests large clips on a dedicated thread. The blank check, UTF-8
+// conversion, SHA-256, compression, encryption and the blob file write all
+// happen there. The GUI thread only gets back a digest, a bounded preview
+// and, when storage is off, the compressed body, and hands them to
+// HistoryManager::addPrepared(). Rich clips always come through here: the
+// image is encoded to PNG and every MIME part is stored as its own blob.
+// Clips are processed in copy order.
+class ClipIngestor final : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result {
+        HistoryManager::HistoryItem item; // digest, preview, length, addedAtMs and parts
+        BlobStore::Prepared body;         // plain text clips
+        QVector<BlobStore::Prepared> parts; // rich clips, one per item.parts entry
+    };
+
+    explicit ClipIngestor(const CryptoManager *crypto, QObject *parent = nullptr);
+    ~ClipIngestor() override;
+
+    // blobDirectory and compressionThreshold are the blob store settings at
+    // the time of the copy; an empty directory keeps the body in memory
+    void ingest(const QString &text, qint64 addedAtMs, const QString &blobDirectory,
+                qint64 compressionThreshold);
+    void ingest(const ClipContent &content, qint64 addedAtMs, const QString &blobDirectory,
+                qint64 compressionThreshold);
+    // Finished clips in copy order; call after ready()
+    QVector<Result> takeResults();
+    // Blocks until every queued clip is finished
+    void waitForIdle();
+    bool isBusy() const;
+
+signals:
+    // Emitted from the worker thread when results are waiting
+    void ready();
+
+private:
+    struct Job {
+        ClipContent content; // only text is set for plain clips
+        qint64 addedAtMs = 0;
+        QString blobDirectory;
+        qint64 compressionThreshold = 0;
+    };
+
+    void run();
+    Result prepareText(Job &job) const;
+    Result prepareRich(Job &job) const;
+
+    const CryptoManager *m_crypto = nullptr;
+    std::unique_ptr<QThread> m_thread;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_idle;
+    QQueue<Job> m_jobs;
+    QVector<Result> m_results;
+    bool m_working = false;
+    bool m_stopping = false;
+};
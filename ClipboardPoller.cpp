@@ -0,0 +1,138 @@
+#include "ClipboardPoller.h"
+#include "ClipboardWatcher.h"
+#include "Trace.h"
+
+#if defined(Q_OS_MAC)
+ #include <CoreGraphics/CoreGraphics.h>
+#elif defined(Q_OS_WIN)
+ #include <windows.h>
+#endif
+
+namespace {
+
+// Сколько длится учащённый опрос после изменения
+const int kBurstWindowMs = 2000;
+
+} // namespace
+
+ClipboardPoller::ClipboardPoller(ClipboardWatcher *watcher, QObject *parent)
+    : QObject(parent)
+    , m_watcher(watcher)
+{
+    // Грубый таймер: система может совмещать пробуждения с другими
+    m_timer.setTimerType(Qt::CoarseTimer);
+    m_timer.setInterval(m_baseMs);
+    connect(&m_timer, &QTimer::timeout, this, &ClipboardPoller::poll);
+    connect(m_watcher, &ClipboardWatcher::textChanged, this, &ClipboardPoller::notifyChange);
+}
+
+void ClipboardPoller::setIntervals(int burstMs, int baseMs, int maxIdleMs)
+{
+    m_burstMs = qMax(10, burstMs);
+    m_baseMs = qMax(m_burstMs, baseMs);
+    m_maxIdleMs = qMax(m_baseMs, maxIdleMs);
+    m_pausedMs = qMax(m_maxIdleMs, m_pausedMs);
+    setInterval(m_baseMs);
+}
+
+void ClipboardPoller::setIdleThreshold(int idleMs)
+{
+    m_idleThresholdMs = qMax(0, idleMs);
+}
+
+void ClipboardPoller::start()
+{
+    m_timer.start();
+}
+
+void ClipboardPoller::stop()
+{
+    m_timer.stop();
+}
+
+int ClipboardPoller::interval() const
+{
+    return m_timer.interval();
+}
+
+ClipboardPoller::Counters ClipboardPoller::counters() const
+{
+    return m_counters;
+}
+
+void ClipboardPoller::notifyChange()
+{
+    m_burstPollsLeft = qMax(1, kBurstWindowMs / m_burstMs);
+    setInterval(m_burstMs);
+}
+
+void ClipboardPoller::poll()
+{
+    SMARTCLIP_TRACE("clipboard.poll");
+    // Экран заблокирован или пользователь отошёл: копировать некому
+    if (isSessionInactive()) {
+        ++m_counters.pausedTicks;
+        if (!m_paused) {
+            m_paused = true;
+            m_burstPollsLeft = 0;
+            setInterval(m_pausedMs);
+        }
+        return;
+    }
+    if (m_paused) {
+        // Возвращение пользователя: проверяем сразу и начинаем с базового интервала
+        m_paused = false;
+        setInterval(m_baseMs);
+    }
+
+    ++m_counters.polls;
+    const int changes = m_watcher->check();
+    if (changes > 0) {
+        ++m_counters.hits;
+        m_counters.missedChanges += quint64(changes - 1);
+        notifyChange();
+    } else if (m_burstPollsLeft > 0) {
+        if (--m_burstPollsLeft == 0) {
+            setInterval(m_baseMs);
+        }
+    } else {
+        setInterval(qMin(m_timer.interval() * 2, m_maxIdleMs));
+    }
+}
+
+void ClipboardPoller::setInterval(int ms)
+{
+    if (m_timer.interval() != ms) {
+        m_timer.setInterval(ms);
+    }
+}
+
+bool ClipboardPoller::isSessionInactive() const
+{
+#if defined(Q_OS_MAC)
+    CFDictionaryRef session = CGSessionCopyCurrentDictionary();
+    if (session) {
+        const auto locked = static_cast<CFBooleanRef>(CFDictionaryGetValue(session, CFSTR("CGSSessionScreenIsLocked")));
+        const bool isLocked = locked && CFBooleanGetValue(locked);
+        CFRelease(session);
+        if (isLocked) {
+            return true;
+        }
+    }
+    if (m_idleThresholdMs > 0) {
+        const double idleSeconds = CGEventSourceSecondsSinceLastEventType(
+            kCGEventSourceStateCombinedSessionState, kCGAnyInputEventType);
+        return idleSeconds * 1000.0 >= m_idleThresholdMs;
+    }
+    return false;
+#elif defined(Q_OS_WIN)
+    if (m_idleThresholdMs <= 0) {
+        return false;
+    }
+    LASTINPUTINFO input = {};
+    input.cbSize = sizeof(input);
+    return GetLastInputInfo(&input) && GetTickCount() - input.dwTime >= DWORD(m_idleThresholdMs);
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+
+class ClipboardWatcher;
+
+// Drives ClipboardWatcher::check() where clipboard signals are not reliable.
+// The interval tightens to the burst interval after a change, so a script
+// or a user copying several clips in a row is followed closely. It falls
+// back to the base interval once the burst window passes without changes,
+// then doubles on every empty poll up to the idle maximum. While the screen
+// is locked or there was no user input for a while, the clipboard is not
+// read at all. Only the session state is re-checked, at the paused
+// interval.
+class ClipboardPoller final : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Counters {
+        quint64 polls = 0;         // checks of the clipboard
+        quint64 hits = 0;          // checks that found a change
+        quint64 missedChanges = 0; // changes overwritten between two checks
+        quint64 pausedTicks = 0;   // ticks skipped while the session was inactive
+    };
+
+    explicit ClipboardPoller(ClipboardWatcher *watcher, QObject *parent = nullptr);
+
+    void setIntervals(int burstMs, int baseMs, int maxIdleMs);
+    // A session without input for this long counts as inactive; 0 disables
+    void setIdleThreshold(int idleMs);
+
+    void start();
+    void stop();
+    int interval() const;
+    Counters counters() const;
+
+public slots:
+    // A change was seen by other means (a clipboard signal); enter burst mode
+    void notifyChange();
+
+private:
+    void poll();
+    void setInterval(int ms);
+    bool isSessionInactive() const;
+
+    ClipboardWatcher *m_watcher = nullptr;
+    QTimer m_timer;
+    int m_burstMs = 100;
+    int m_baseMs = 500;
+    int m_maxIdleMs = 4000;
+    int m_pausedMs = 5000;
+    int m_idleThresholdMs = 5 * 60 * 1000;
+    int m_burstPollsLeft = 0;
+    bool m_paused = false;
+    Counters m_counters;
+};
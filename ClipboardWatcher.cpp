@@ -0,0 +1,176 @@
+#include "ClipboardWatcher.h"
+#include "Trace.h"
+#include <QClipboard>
+#include <QHash>
+#include <QMimeData>
+#include <climits>
+
+namespace {
+
+// Текст длиннее сравнивается только по счётчику изменений, если он есть
+const qsizetype kHashedTextLimit = 1024 * 1024;
+
+} // namespace
+
+#if defined(Q_OS_MAC)
+ #include <objc/message.h>
+ #include <objc/runtime.h>
+#elif defined(Q_OS_WIN)
+ #include <windows.h>
+#endif
+
+ClipboardWatcher::ClipboardWatcher(QClipboard *clipboard, QObject *parent)
+    : QObject(parent)
+    , m_clipboard(clipboard)
+{
+    // Все сигналы одного прохода цикла событий сводятся в одну проверку
+    m_coalesceTimer.setSingleShot(true);
+    m_coalesceTimer.setInterval(0);
+    connect(&m_coalesceTimer, &QTimer::timeout, this, &ClipboardWatcher::check);
+
+    if (m_clipboard) {
+        connect(m_clipboard, &QClipboard::dataChanged, this, &ClipboardWatcher::scheduleCheck);
+        connect(m_clipboard, &QClipboard::changed, this, [this](QClipboard::Mode mode) {
+            if (mode == QClipboard::Clipboard) {
+                scheduleCheck();
+            }
+        });
+    }
+}
+
+void ClipboardWatcher::setText(const QString &text)
+{
+    if (!m_clipboard) {
+        return;
+    }
+    m_clipboard->setText(text, QClipboard::Clipboard);
+
+    // Собственная запись считается уже прочитанной
+    m_lastCounter = changeCounter();
+    m_lastHash = textHash(text);
+    m_lastLength = text.size();
+}
+
+void ClipboardWatcher::setMimeData(QMimeData *mime)
+{
+    if (!m_clipboard || !mime) {
+        delete mime;
+        return;
+    }
+    // Отпечаток снимаем до передачи: дальше данными владеет буфер
+    const ClipContent content = ClipContent::capture(mime);
+    m_clipboard->setMimeData(mime, QClipboard::Clipboard);
+
+    m_lastCounter = changeCounter();
+    m_lastHash = content.fingerprint();
+    m_lastLength = content.byteSize();
+}
+
+bool ClipboardWatcher::hasChangeCounter()
+{
+#if defined(Q_OS_MAC) || defined(Q_OS_WIN)
+    return true;
+#else
+    return false;
+#endif
+}
+
+int ClipboardWatcher::check()
+{
+    SMARTCLIP_TRACE("clipboard.check");
+    m_coalesceTimer.stop();
+    if (!m_clipboard) {
+        return 0;
+    }
+
+    // Счётчик не сдвинулся — буфер не читаем вовсе
+    int changes = 1;
+    if (hasChangeCounter()) {
+        const quint64 counter = changeCounter();
+        if (counter == m_lastCounter && m_lastLength >= 0) {
+            return 0;
+        }
+        if (m_lastLength >= 0 && counter > m_lastCounter) {
+            changes = int(qMin<quint64>(counter - m_lastCounter, INT_MAX));
+        }
+        m_lastCounter = counter;
+    }
+
+    // Картинки, HTML и файлы читаются как есть и сравниваются по отпечатку
+    const QMimeData *mime = m_clipboard->mimeData(QClipboard::Clipboard);
+    if (ClipContent::isRich(mime)) {
+        const ClipContent content = ClipContent::capture(mime);
+        const size_t hash = content.fingerprint();
+        if (content.byteSize() == m_lastLength && hash == m_lastHash) {
+            return hasChangeCounter() ? changes : 0;
+        }
+        m_lastHash = hash;
+        m_lastLength = content.byteSize();
+        emit contentChanged(content);
+        return changes;
+    }
+
+    const QString text = m_clipboard->text(QClipboard::Clipboard);
+    if (hasChangeCounter() && text.size() >= kHashedTextLimit) {
+        // Счётчику можно верить: огромный текст не хешируем в GUI-потоке
+        m_lastHash = 0;
+    } else {
+        const size_t hash = textHash(text);
+        if (text.size() == m_lastLength && hash == m_lastHash) {
+            return hasChangeCounter() ? changes : 0;
+        }
+        m_lastHash = hash;
+    }
+    m_lastLength = text.size();
+
+    if (!isBlank(text)) {
+        emit textChanged(text);
+    }
+    return changes;
+}
+
+void ClipboardWatcher::scheduleCheck()
+{
+    if (!m_coalesceTimer.isActive()) {
+        m_coalesceTimer.start();
+    }
+}
+
+quint64 ClipboardWatcher::changeCounter()
+{
+#if defined(Q_OS_MAC)
+    // [[NSPasteboard generalPasteboard] changeCount] через рантайм Objective-C,
+    // чтобы не заводить ради одного вызова файл на Objective-C++
+    using SendObject = id (*)(id, SEL);
+    using SendInteger = long (*)(id, SEL);
+    static const SEL generalPasteboard = sel_registerName("generalPasteboard");
+    static const SEL changeCount = sel_registerName("changeCount");
+
+    id pasteboardClass = reinterpret_cast<id>(objc_getClass("NSPasteboard"));
+    if (!pasteboardClass) {
+        return 0;
+    }
+    id pasteboard = reinterpret_cast<SendObject>(objc_msgSend)(pasteboardClass, generalPasteboard);
+    return pasteboard ? quint64(reinterpret_cast<SendInteger>(objc_msgSend)(pasteboard, changeCount)) : 0;
+#elif defined(Q_OS_WIN)
+    return GetClipboardSequenceNumber();
+#else
+    return 0;
+#endif
+}
+
+bool ClipboardWatcher::isBlank(const QString &text)
+{
+    // В отличие от trimmed(), не копирует строку и останавливается на первом символе текста
+    for (const QChar ch : text) {
+        if (!ch.isSpace()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t ClipboardWatcher::textHash(const QString &text)
+{
+    return qHash(text, size_t(0x5c1f));
+}
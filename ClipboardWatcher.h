@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ClipContent.h"
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+class QClipboard;
+class QMimeData;
+
+// Single source of clipboard changes. QClipboard::dataChanged and
+// QClipboard::changed usually fire together; both only schedule a check,
+// and all signals of one event loop pass end in a single check().
+//
+// A check first asks the platform for the clipboard's change counter
+// (NSPasteboard changeCount on macOS, GetClipboardSequenceNumber on
+// Windows) and returns without reading the clipboard when it has not moved.
+// Elsewhere the text is read and compared by hash. Images, HTML and file
+// URLs are reported as ClipContent, compared by a sampled fingerprint.
+// What the app puts on the clipboard itself through setText() or
+// setMimeData() is not reported back.
+class ClipboardWatcher final : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ClipboardWatcher(QClipboard *clipboard, QObject *parent = nullptr);
+
+    // Puts text on the clipboard without reporting it as a new clip
+    void setText(const QString &text);
+    // Same for rich content; the clipboard takes ownership of mime
+    void setMimeData(QMimeData *mime);
+
+    // Whether the platform exposes a change counter
+    static bool hasChangeCounter();
+
+public slots:
+    // Reads the clipboard if it may have changed; safe to call from a poll
+    // timer. Returns how many clipboard changes happened since the previous
+    // check: more than one means intermediate clips were overwritten unseen.
+    // Without a change counter it is 1 for new text and 0 otherwise.
+    int check();
+
+signals:
+    // New non-blank text on the clipboard, once per change
+    void textChanged(const QString &text);
+    // New content with formats beyond plain text, images not yet encoded
+    void contentChanged(const ClipContent &content);
+
+private:
+    void scheduleCheck();
+    static quint64 changeCounter();
+    static bool isBlank(const QString &text);
+    static size_t textHash(const QString &text);
+
+    QClipboard *m_clipboard = nullptr;
+    QTimer m_coalesceTimer;
+    quint64 m_lastCounter = 0;
+    size_t m_lastHash = 0;
+    qsizetype m_lastLength = -1; // -1 until the first read
+};
@@ -0,0 +1,284 @@
+#include "ControlServer.h"
+#include "Trace.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QtEndian>
+
+namespace {
+
+// tag и op/status после длины
+const quint32 kFrameHeader = sizeof(quint32) + sizeof(quint8);
+// Ответ на List и Search без лимита не собирается больше этого числа элементов
+const quint32 kMaxListedItems = 100000;
+
+template<typename T>
+void put(QByteArray &out, T value)
+{
+    const T be = qToBigEndian(value);
+    out.append(reinterpret_cast<const char *>(&be), sizeof(T));
+}
+
+void putString(QByteArray &out, const QByteArray &utf8)
+{
+    put<quint32>(out, quint32(utf8.size()));
+    out.append(utf8);
+}
+
+void putItem(QByteArray &out, const HistoryManager::HistoryItem &item)
+{
+    quint8 flags = 0;
+    flags |= item.isFavorite ? 0x1 : 0;
+    flags |= item.isMasked ? 0x2 : 0;
+    flags |= item.parts.isEmpty() ? 0 : 0x4;
+    put<quint64>(out, item.id);
+    put<quint8>(out, flags);
+    put<qint8>(out, qint8(item.colorIndex));
+    put<quint32>(out, quint32(qMax(item.usageCount, 0)));
+    put<qint64>(out, item.addedAtMs);
+    put<qint64>(out, item.length);
+    // Маскированный элемент не раскрываем даже превью
+    putString(out, item.isMasked ? QByteArray() : item.preview.toUtf8());
+}
+
+// Разбор аргументов запроса; после выхода за конец ok() ложно
+class Reader
+{
+public:
+    explicit Reader(const QByteArray &data, qsizetype pos)
+        : m_data(data)
+        , m_pos(pos)
+    {
+    }
+
+    template<typename T>
+    T take()
+    {
+        if (!m_ok || m_pos + qsizetype(sizeof(T)) > m_data.size()) {
+            m_ok = false;
+            return T();
+        }
+        const T value = qFromBigEndian<T>(m_data.constData() + m_pos);
+        m_pos += sizeof(T);
+        return value;
+    }
+
+    QByteArray takeString()
+    {
+        const quint32 length = take<quint32>();
+        if (!m_ok || m_pos + qsizetype(length) > m_data.size()) {
+            m_ok = false;
+            return QByteArray();
+        }
+        const QByteArray value = m_data.mid(m_pos, length);
+        m_pos += length;
+        return value;
+    }
+
+    bool ok() const { return m_ok; }
+
+private:
+    const QByteArray &m_data;
+    qsizetype m_pos;
+    bool m_ok = true;
+};
+
+QByteArray frame(quint32 tag, quint8 code, const QByteArray &body)
+{
+    QByteArray out;
+    out.reserve(sizeof(quint32) + kFrameHeader + body.size());
+    put<quint32>(out, quint32(kFrameHeader + body.size()));
+    put<quint32>(out, tag);
+    put<quint8>(out, code);
+    out.append(body);
+    return out;
+}
+
+} // namespace
+
+ControlServer::ControlServer(const HistoryManager *history, QObject *parent)
+    : QObject(parent)
+    , m_history(history)
+    , m_server(new QLocalServer(this))
+{
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    connect(m_server, &QLocalServer::newConnection, this, &ControlServer::onNewConnection);
+}
+
+ControlServer::~ControlServer() = default;
+
+bool ControlServer::listen(const InstanceLock &instanceLock)
+{
+    const QString name = serverName();
+#if !defined(Q_OS_WIN)
+    QDir().mkpath(QFileInfo(name).absolutePath());
+#endif
+    if (m_server->listen(name)) {
+        return true;
+    }
+    // Замок у нас, значит прежний владелец сокета мёртв; без замка сокет
+    // может принадлежать живому экземпляру, который ещё запускается
+    if (m_server->serverError() == QAbstractSocket::AddressInUseError && instanceLock.isLocked()) {
+        QLocalServer::removeServer(name);
+        return m_server->listen(name);
+    }
+    return false;
+}
+
+QString ControlServer::serverName()
+{
+#if defined(Q_OS_WIN)
+    // Именованные каналы общие для всей машины, поэтому имя с пользователем
+    return QStringLiteral("smartclip-control-") + qEnvironmentVariable("USERNAME");
+#else
+    return QDir::homePath() + QLatin1String("/.smartclip/control.sock");
+#endif
+}
+
+bool ControlServer::activateRunning(int timeoutMs)
+{
+    QLocalSocket socket;
+    socket.connectToServer(serverName());
+    if (!socket.waitForConnected(timeoutMs)) {
+        return false;
+    }
+    socket.write(frame(0, quint8(Op::Show), QByteArray()));
+    socket.waitForBytesWritten(timeoutMs);
+    // Ответ подтверждает, что на том конце живой экземпляр, а не чужой сокет
+    while (socket.bytesAvailable() < qint64(sizeof(quint32) + kFrameHeader)) {
+        if (!socket.waitForReadyRead(timeoutMs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ControlServer::onNewConnection()
+{
+    while (QLocalSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+            onReadyRead(socket);
+        });
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+void ControlServer::onReadyRead(QLocalSocket *socket)
+{
+    // Несколько запросов за одно чтение отвечаются по порядку одной записью
+    QByteArray responses;
+    while (socket->bytesAvailable() >= qint64(sizeof(quint32))) {
+        char header[sizeof(quint32)];
+        socket->peek(header, sizeof(header));
+        const quint32 length = qFromBigEndian<quint32>(header);
+        if (length < kFrameHeader || length > MaxRequestBytes) {
+            socket->abort();
+            return;
+        }
+        if (socket->bytesAvailable() < qint64(sizeof(quint32) + length)) {
+            break; // Запрос пришёл не целиком
+        }
+        const QByteArray request = socket->read(sizeof(quint32) + length);
+        responses.append(respond(request));
+    }
+    if (!responses.isEmpty()) {
+        socket->write(responses);
+    }
+}
+
+QByteArray ControlServer::respond(const QByteArray &request)
+{
+    Reader args(request, sizeof(quint32));
+    const quint32 tag = args.take<quint32>();
+    const quint8 op = args.take<quint8>();
+    SMARTCLIP_TRACE("control.request", op);
+
+    QByteArray body;
+    Status status = Status::Ok;
+    switch (Op(op)) {
+    case Op::List: {
+        const quint32 offset = args.take<quint32>();
+        const quint32 limit = args.take<quint32>();
+        if (!args.ok()) {
+            status = Status::BadRequest;
+            break;
+        }
+        // Обходится только запрошенная страница порядка меню
+        const quint32 total = quint32(m_history->size());
+        const quint32 first = qMin(offset, total);
+        const quint32 count = qMin(total - first, limit == 0 ? kMaxListedItems : qMin(limit, kMaxListedItems));
+        put<quint32>(body, total);
+        put<quint32>(body, count);
+        for (quint64 id : m_history->orderedIds(int(first), int(count))) {
+            putItem(body, *m_history->item(id));
+        }
+        break;
+    }
+    case Op::Search: {
+        const bool fuzzy = args.take<quint8>() != 0;
+        const quint32 requested = args.take<quint32>();
+        const quint32 limit = requested == 0 ? kMaxListedItems : qMin(requested, kMaxListedItems);
+        const QString query = QString::fromUtf8(args.takeString());
+        if (!args.ok()) {
+            status = Status::BadRequest;
+            break;
+        }
+        const QVector<quint64> ids = fuzzy ? m_history->fuzzySearch(query, int(limit))
+                                           : m_history->search(query, int(limit));
+        put<quint32>(body, quint32(ids.size()));
+        for (quint64 id : ids) {
+            putItem(body, *m_history->item(id));
+        }
+        break;
+    }
+    case Op::Get: {
+        const quint64 id = args.take<quint64>();
+        if (!args.ok()) {
+            status = Status::BadRequest;
+            break;
+        }
+        const HistoryManager::HistoryItem *item = m_history->item(id);
+        if (!item) {
+            status = Status::NotFound;
+            break;
+        }
+        putItem(body, *item);
+        // Маскированный текст наружу не отдаём: клиент видит флаг и пустую строку
+        putString(body, item->isMasked ? QByteArray() : m_history->text(id).toUtf8());
+        break;
+    }
+    case Op::Paste: {
+        const quint64 id = args.take<quint64>();
+        if (!args.ok()) {
+            status = Status::BadRequest;
+        } else if (!m_history->item(id)) {
+            status = Status::NotFound;
+        } else {
+            emit pasteRequested(id);
+        }
+        break;
+    }
+    case Op::Stats: {
+        const BlobStore::Stats stats = m_history->compressionStats();
+        put<quint32>(body, quint32(m_history->size()));
+        put<quint64>(body, quint64(m_history->textBytes()));
+        put<quint32>(body, quint32(stats.bodies));
+        put<quint32>(body, quint32(stats.compressedBodies));
+        put<quint64>(body, quint64(stats.rawBytes));
+        put<quint64>(body, quint64(stats.residentBytes));
+        break;
+    }
+    case Op::Show:
+        emit showRequested();
+        break;
+    default:
+        status = Status::UnknownOp;
+        break;
+    }
+
+    if (status != Status::Ok) {
+        body.clear();
+    }
+    return frame(tag, quint8(status), body);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "HistoryManager.h"
+#include "InstanceLock.h"
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+
+class QLocalServer;
+class QLocalSocket;
+
+// Local-socket API of the running instance for editor and terminal
+// integrations, and the single-instance check: a second launch finds the
+// InstanceLock taken, asks the server to show the quick picker and exits
+// instead of starting its own tray. Answers come from HistoryManager's
+// in-memory order and search indexes; only Get may read a body from the
+// blob store, and never that of a masked item.
+//
+// The socket lives in ~/.smartclip (a per-user named pipe on Windows) and is
+// accessible to its owner only. Every message is a frame, integers big-endian:
+//   request   u32 length | u32 tag | u8 op     | arguments
+//   response  u32 length | u32 tag | u8 status | body
+// length counts the bytes after itself; the tag is echoed back. Requests may
+// be pipelined and are answered in order.
+//
+//   List    u32 offset, u32 limit (0: all)  -> u32 total, u32 count, count x item
+//   Search  u8 fuzzy, u32 limit, str query   -> u32 count, count x item
+//   Get     u64 id                           -> item, str text
+//   Paste   u64 id                           -> (empty) puts the item on the clipboard
+//   Stats                                    -> u32 items, u64 text bytes,
+//                                               u32 resident bodies, u32 compressed,
+//                                               u64 raw bytes, u64 resident bytes
+//   Show                                     -> (empty) opens the quick picker
+//
+//   str   u32 byte length | UTF-8
+//   item  u64 id | u8 flags (1 favorite, 2 masked, 4 rich) | i8 color |
+//         u32 usage count | i64 added at, ms | i64 length | str preview
+// The preview and the Get text of a masked item are sent empty; Paste still
+// puts such an item on the clipboard, as the tray menu does.
+class ControlServer final : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Op : quint8 {
+        List = 1,
+        Search = 2,
+        Get = 3,
+        Paste = 4,
+        Stats = 5,
+        Show = 6,
+    };
+
+    enum class Status : quint8 {
+        Ok = 0,
+        NotFound = 1,
+        BadRequest = 2,
+        UnknownOp = 3,
+    };
+
+    // Larger requests close the connection
+    static constexpr quint32 MaxRequestBytes = 64 * 1024;
+
+    explicit ControlServer(const HistoryManager *history, QObject *parent = nullptr);
+    ~ControlServer() override;
+
+    // A socket found while the instance lock is held was left behind by a
+    // crashed instance and is taken over; without the lock it is never touched
+    bool listen(const InstanceLock &instanceLock);
+    static QString serverName();
+    // Sends Show to a running instance; false when none answers in time.
+    // The instance may still be starting up, hence the generous default
+    static bool activateRunning(int timeoutMs = 3000);
+
+signals:
+    void pasteRequested(quint64 id);
+    void showRequested();
+
+private:
+    void onNewConnection();
+    void onReadyRead(QLocalSocket *socket);
+    // Response frame to one complete request frame
+    QByteArray respond(const QByteArray &request);
+
+    const HistoryManager *m_history = nullptr;
+    QLocalServer *m_server = nullptr;
+};
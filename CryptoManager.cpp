@@ -0,0 +1,229 @@
+#include "CryptoManager.h"
+#include "ChaCha20Poly1305.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QDebug>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+ #include <sys/mman.h>
+#elif defined(Q_OS_WIN)
+ #include <windows.h>
+#endif
+
+namespace {
+
+const char kFormatVersion = 0x02;
+const int kKeySize = 32;
+const int kLegacyChecksumSize = 8;
+const int kOverhead = 1 + ChaCha20Poly1305::NonceSize + ChaCha20Poly1305::TagSize;
+
+// Ключ не должен попадать в swap
+void lockMemory(const void *data, size_t size)
+{
+#if defined(Q_OS_UNIX)
+    if (mlock(data, size) != 0) {
+        qDebug() << "Could not lock key memory";
+    }
+#elif defined(Q_OS_WIN)
+    VirtualLock(const_cast<void *>(data), size);
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+#endif
+}
+
+void unlockMemory(const void *data, size_t size)
+{
+#if defined(Q_OS_UNIX)
+    munlock(data, size);
+#elif defined(Q_OS_WIN)
+    VirtualUnlock(const_cast<void *>(data), size);
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+#endif
+}
+
+void wipe(void *data, size_t size)
+{
+    volatile char *p = static_cast<volatile char *>(data);
+    while (size--) {
+        *p++ = 0;
+    }
+}
+
+// Новый ключ из системного CSPRNG
+QByteArray generateKey()
+{
+    QByteArray key(kKeySize, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(key.data()), kKeySize / 4);
+    return key;
+}
+
+} // namespace
+
+CryptoManager::CryptoManager(QObject *parent)
+    : QObject(parent)
+    , m_key(loadOrCreateKey())
+{
+    setupCipher();
+}
+
+CryptoManager::~CryptoManager()
+{
+    releaseKey();
+}
+
+void CryptoManager::setupCipher()
+{
+    // Ключ шифра выводится из основного, основной остаётся для HMAC имён файлов
+    QByteArray cipherKey = QMessageAuthenticationCode::hash(QByteArrayLiteral("SmartClip ChaCha20-Poly1305"),
+                                                            m_key, QCryptographicHash::Sha256);
+    m_cipher = std::make_unique<ChaCha20Poly1305>(reinterpret_cast<const quint8 *>(cipherKey.constData()));
+    wipe(cipherKey.data(), size_t(cipherKey.size()));
+
+    lockMemory(m_key.constData(), size_t(m_key.size()));
+    lockMemory(m_cipher.get(), sizeof(ChaCha20Poly1305));
+}
+
+void CryptoManager::releaseKey()
+{
+    unlockMemory(m_cipher.get(), sizeof(ChaCha20Poly1305));
+    m_cipher.reset(); // Деструктор шифра сам затирает ключ
+    wipe(m_key.data(), size_t(m_key.size()));
+    unlockMemory(m_key.constData(), size_t(m_key.size()));
+}
+
+bool CryptoManager::rotateKey()
+{
+    QByteArray newKey = generateKey();
+    if (!storeKey(newKey)) {
+        wipe(newKey.data(), size_t(newKey.size()));
+        return false;
+    }
+
+    // Файл со старым ключом уже заменён, осталось затереть его в памяти
+    releaseKey();
+    m_key = std::move(newKey);
+    setupCipher();
+    return true;
+}
+
+QString CryptoManager::keyPath() const
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/.key");
+}
+
+QByteArray CryptoManager::loadOrCreateKey() const
+{
+    QFile keyFile(keyPath());
+
+    // Если ключ существует, читаем его
+    if (keyFile.open(QIODevice::ReadOnly)) {
+        const QByteArray storedKey = QByteArray::fromBase64(keyFile.readAll().trimmed());
+        keyFile.close();
+        if (storedKey.size() == kKeySize) {
+            return storedKey;
+        }
+    }
+
+    const QByteArray newKey = generateKey();
+    storeKey(newKey);
+    return newKey;
+}
+
+bool CryptoManager::storeKey(const QByteArray &key) const
+{
+    const QFileInfo fi(keyPath());
+    if (!fi.dir().exists()) {
+        QDir().mkpath(fi.dir().absolutePath());
+    }
+
+    // Прежний файл заменяется целиком только после записи нового;
+    // права выставляются до того, как в файл попадёт ключ
+    QSaveFile keyFile(fi.filePath());
+    if (!keyFile.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    keyFile.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    QByteArray encoded = key.toBase64();
+    keyFile.write(encoded);
+    wipe(encoded.data(), size_t(encoded.size()));
+    return keyFile.commit();
+}
+
+QByteArray CryptoManager::encrypt(const QByteArray &data) const
+{
+    // Один буфер на весь результат, шифрование идёт прямо в него
+    QByteArray out(kOverhead + data.size(), Qt::Uninitialized);
+    quint8 *p = reinterpret_cast<quint8 *>(out.data());
+    p[0] = quint8(kFormatVersion);
+    quint8 *nonce = p + 1;
+    quint32 nonceWords[ChaCha20Poly1305::NonceSize / 4];
+    QRandomGenerator::system()->fillRange(nonceWords);
+    std::memcpy(nonce, nonceWords, sizeof(nonceWords));
+
+    quint8 *ciphertext = nonce + ChaCha20Poly1305::NonceSize;
+    // Байт версии входит в аутентифицируемые данные
+    m_cipher->seal(nonce, p, 1, reinterpret_cast<const quint8 *>(data.constData()), data.size(),
+                   ciphertext, ciphertext + data.size());
+    return out;
+}
+
+QByteArray CryptoManager::decrypt(const QByteArray &data) const
+{
+    // Старый формат здесь не принимается: его контрольную сумму может подделать кто угодно
+    if (data.size() < kOverhead || data.at(0) != kFormatVersion) {
+        return QByteArray();
+    }
+
+    const quint8 *p = reinterpret_cast<const quint8 *>(data.constData());
+    const quint8 *nonce = p + 1;
+    const quint8 *ciphertext = nonce + ChaCha20Poly1305::NonceSize;
+    const qsizetype length = data.size() - kOverhead;
+
+    QByteArray plain(length, Qt::Uninitialized);
+    if (!m_cipher->open(nonce, p, 1, ciphertext, length, ciphertext + length,
+                        reinterpret_cast<quint8 *>(plain.data()))) {
+        return QByteArray();
+    }
+    return plain;
+}
+
+// Только для однократного переноса history.yml и metadata.yml
+QByteArray CryptoManager::decryptLegacy(const QByteArray &data) const
+{
+    if (data.size() < kLegacyChecksumSize) {
+        return QByteArray(); // Слишком короткие данные
+    }
+
+    // Отделяем данные от контрольной суммы
+    const QByteArray encrypted = data.left(data.size() - kLegacyChecksumSize);
+    const QByteArray storedHash = data.right(kLegacyChecksumSize);
+
+    // Проверяем целостность
+    const QByteArray calculatedHash = QCryptographicHash::hash(encrypted, QCryptographicHash::Sha256)
+                                          .left(kLegacyChecksumSize);
+    if (storedHash != calculatedHash) {
+        qDebug() << "Data integrity check failed!";
+        return QByteArray(); // Данные повреждены
+    }
+
+    // Расшифровываем
+    QByteArray decrypted = encrypted;
+    for (int i = 0; i < decrypted.size(); ++i) {
+        decrypted[i] = decrypted[i] ^ m_key[i % m_key.size()];
+    }
+    return decrypted;
+}
+
+QByteArray CryptoManager::keyedDigest(const QByteArray &data) const
+{
+    return QMessageAuthenticationCode::hash(data, m_key, QCryptographicHash::Sha256);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <memory>
+
+class ChaCha20Poly1305;
+
+// Encrypts history files with the per-user key stored in ~/.smartclip/.key.
+// The key is read once, kept in locked memory and wiped on destruction.
+// encrypt()/decrypt() are const and safe to call from worker threads.
+class CryptoManager final : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CryptoManager(QObject *parent = nullptr);
+    ~CryptoManager() override;
+
+    // ChaCha20-Poly1305: version byte, random 96-bit nonce, ciphertext, tag
+    QByteArray encrypt(const QByteArray &data) const;
+    // Empty result when the data was tampered with, encrypted with another key
+    // or is not in the current format.
+    QByteArray decrypt(const QByteArray &data) const;
+    // The pre-AEAD XOR scheme, whose checksum is unkeyed and proves nothing.
+    // Only for the one-time migration of history.yml and metadata.yml.
+    QByteArray decryptLegacy(const QByteArray &data) const;
+    // HMAC-SHA256 under the history key, for names that must not reveal content
+    QByteArray keyedDigest(const QByteArray &data) const;
+
+    // Replaces the key file with a fresh random key and switches to it.
+    // Everything encrypted before becomes unreadable, so the caller re-encrypts
+    // it first and makes sure no worker thread uses the manager meanwhile.
+    // On failure the old key stays in use.
+    bool rotateKey();
+
+private:
+    QByteArray loadOrCreateKey() const;
+    bool storeKey(const QByteArray &key) const;
+    void setupCipher();
+    void releaseKey();
+    QString keyPath() const;
+
+    QByteArray m_key;
+    std::unique_ptr<ChaCha20Poly1305> m_cipher;
+};
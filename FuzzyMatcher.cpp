@@ -0,0 +1,338 @@
+#include "FuzzyMatcher.h"
+#include <QChar>
+#include <QtAlgorithms>
+
+#if defined(__SSE2__) || defined(_M_X64)
+ #include <emmintrin.h>
+ #define SMARTCLIP_FUZZY_SSE2 1
+ // Только при сборке с SMARTCLIP_ENABLE_AVX2: без флага компилятора __AVX2__ не определён
+ #if defined(__AVX2__)
+  #include <immintrin.h>
+  #define SMARTCLIP_FUZZY_AVX2 1
+ #endif
+#elif (defined(__ARM_NEON) && defined(__aarch64__)) || defined(_M_ARM64)
+ #include <arm_neon.h>
+ #define SMARTCLIP_FUZZY_NEON 1
+#endif
+
+namespace {
+
+// Веса как в fzf: совпадение +16, начало пропуска -3, каждый следующий символ пропуска -1
+const int kScoreMatch = 16;
+const int kScoreGapStart = -3;
+const int kScoreGapExtension = -1;
+const int kBonusBoundary = kScoreMatch / 2;
+const int kBonusBoundaryWhite = kBonusBoundary + 2;
+const int kBonusNonWord = kScoreMatch / 2;
+const int kBonusCamel123 = kBonusBoundary + kScoreGapExtension;
+const int kBonusConsecutive = -(kScoreGapStart + kScoreGapExtension);
+const int kBonusFirstCharMultiplier = 2;
+
+// Порядок важен: всё после ClassNonWord — символы слова
+enum CharClass {
+    ClassWhite,
+    ClassNonWord,
+    ClassLower,
+    ClassUpper,
+    ClassLetter,
+    ClassNumber,
+};
+
+CharClass charClass(char16_t c)
+{
+    if (c < 0x80) {
+        if (c >= 'a' && c <= 'z') {
+            return ClassLower;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            return ClassUpper;
+        }
+        if (c >= '0' && c <= '9') {
+            return ClassNumber;
+        }
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            return ClassWhite;
+        }
+        return ClassNonWord;
+    }
+
+    const QChar ch(c);
+    if (ch.isSpace()) {
+        return ClassWhite;
+    }
+    if (ch.isLower()) {
+        return ClassLower;
+    }
+    if (ch.isUpper()) {
+        return ClassUpper;
+    }
+    if (ch.isNumber()) {
+        return ClassNumber;
+    }
+    return ch.isLetter() ? ClassLetter : ClassNonWord;
+}
+
+int bonusFor(CharClass previous, CharClass current)
+{
+    if (current > ClassNonWord) {
+        if (previous == ClassWhite) {
+            return kBonusBoundaryWhite;
+        }
+        if (previous == ClassNonWord) {
+            return kBonusBoundary;
+        }
+    }
+    if ((previous == ClassLower && current == ClassUpper)
+        || (previous != ClassNumber && current == ClassNumber)) {
+        return kBonusCamel123;
+    }
+    if (current == ClassNonWord) {
+        return kBonusNonWord;
+    }
+    return (current == ClassWhite) ? kBonusBoundaryWhite : 0;
+}
+
+// Для Latin-1 регистр меняется сдвигом на 0x20; µ, ß и ÿ уходят за пределы
+// Latin-1 и в шаблоне такого вида не встречаются
+inline bool hasLatin1Upper(char16_t c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 0xE0 && c <= 0xFE && c != 0xF7);
+}
+
+struct Latin1Fold {
+    char16_t operator()(char16_t c) const
+    {
+        return ((c >= 'A' && c <= 'Z') || (c >= 0xC0 && c <= 0xDE && c != 0xD7)) ? char16_t(c + 0x20) : c;
+    }
+};
+
+struct UnicodeFold {
+    char16_t operator()(char16_t c) const
+    {
+        return char16_t(QChar::toCaseFolded(char32_t(c)));
+    }
+};
+
+bool isLatin1(const char16_t *text, qsizetype length)
+{
+    qsizetype i = 0;
+#if defined(SMARTCLIP_FUZZY_SSE2)
+    __m128i any = _mm_setzero_si128();
+    for (; i + 8 <= length; i += 8) {
+        any = _mm_or_si128(any, _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i)));
+    }
+    const __m128i high = _mm_srli_epi16(any, 8);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+#elif defined(SMARTCLIP_FUZZY_NEON)
+    uint16x8_t any = vdupq_n_u16(0);
+    for (; i + 8 <= length; i += 8) {
+        any = vorrq_u16(any, vld1q_u16(reinterpret_cast<const uint16_t *>(text + i)));
+    }
+    if (vmaxvq_u16(any) > 0xFF) {
+        return false;
+    }
+#endif
+    for (; i < length; ++i) {
+        if (text[i] > 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Первая позиция не раньше from, где стоит a или b; -1 если такой нет
+qsizetype findLatin1(const char16_t *text, qsizetype from, qsizetype length, char16_t a, char16_t b)
+{
+    qsizetype i = from;
+#if defined(SMARTCLIP_FUZZY_AVX2)
+    const __m256i wideA = _mm256_set1_epi16(short(a));
+    const __m256i wideB = _mm256_set1_epi16(short(b));
+    for (; i + 16 <= length; i += 16) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+        const __m256i eq = _mm256_or_si256(_mm256_cmpeq_epi16(v, wideA), _mm256_cmpeq_epi16(v, wideB));
+        const quint32 mask = quint32(_mm256_movemask_epi8(eq));
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask) / 2;
+        }
+    }
+#endif
+#if defined(SMARTCLIP_FUZZY_SSE2)
+    const __m128i va = _mm_set1_epi16(short(a));
+    const __m128i vb = _mm_set1_epi16(short(b));
+    for (; i + 8 <= length; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        const __m128i eq = _mm_or_si128(_mm_cmpeq_epi16(v, va), _mm_cmpeq_epi16(v, vb));
+        const quint32 mask = quint32(_mm_movemask_epi8(eq));
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask) / 2;
+        }
+    }
+#elif defined(SMARTCLIP_FUZZY_NEON)
+    const uint16x8_t va = vdupq_n_u16(a);
+    const uint16x8_t vb = vdupq_n_u16(b);
+    for (; i + 8 <= length; i += 8) {
+        const uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t *>(text + i));
+        const uint16x8_t eq = vorrq_u16(vceqq_u16(v, va), vceqq_u16(v, vb));
+        // Сужаем до байта на элемент, чтобы найти первое совпадение через ctz
+        const quint64 mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(eq, 4)), 0);
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask) / 8;
+        }
+    }
+#endif
+    for (; i < length; ++i) {
+        if (text[i] == a || text[i] == b) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Алгоритм fzf v1: жадный проход вперёд находит конец вхождения, проход
+// назад — самое позднее начало, и только это окно оценивается
+template<typename Fold, typename Find>
+int scoreWindow(const char16_t *text, qsizetype length, const QVector<char16_t> &pattern,
+                Fold fold, Find find, QVector<int> *positions)
+{
+    const qsizetype patternLength = pattern.size();
+
+    qsizetype first = -1;
+    qsizetype pos = 0;
+    for (qsizetype p = 0; p < patternLength; ++p) {
+        pos = find(text, pos, length, p);
+        if (pos < 0) {
+            return FuzzyMatcher::NoMatch;
+        }
+        if (p == 0) {
+            first = pos;
+        }
+        ++pos;
+    }
+    const qsizetype end = pos;
+
+    qsizetype start = first;
+    for (qsizetype i = end - 1, p = patternLength - 1; i >= first; --i) {
+        if (fold(text[i]) == pattern.at(p)) {
+            if (p == 0) {
+                start = i;
+                break;
+            }
+            --p;
+        }
+    }
+
+    int score = 0;
+    int consecutive = 0;
+    int firstBonus = 0;
+    bool inGap = false;
+    CharClass previous = (start > 0) ? charClass(text[start - 1]) : ClassWhite;
+    qsizetype p = 0;
+    for (qsizetype i = start; i < end && p < patternLength; ++i) {
+        const CharClass current = charClass(text[i]);
+        if (fold(text[i]) == pattern.at(p)) {
+            int bonus = bonusFor(previous, current);
+            if (consecutive == 0) {
+                firstBonus = bonus;
+            } else {
+                // Серия наследует бонус своего начала
+                if (bonus >= kBonusBoundary && bonus > firstBonus) {
+                    firstBonus = bonus;
+                }
+                bonus = qMax(qMax(bonus, firstBonus), kBonusConsecutive);
+            }
+            score += kScoreMatch + ((p == 0) ? bonus * kBonusFirstCharMultiplier : bonus);
+            if (positions) {
+                positions->push_back(int(i));
+            }
+            inGap = false;
+            ++consecutive;
+            ++p;
+        } else {
+            score += inGap ? kScoreGapExtension : kScoreGapStart;
+            inGap = true;
+            consecutive = 0;
+            firstBonus = 0;
+        }
+        previous = current;
+    }
+    return score;
+}
+
+} // namespace
+
+FuzzyMatcher::FuzzyMatcher(const QString &pattern)
+{
+    // Пробелы в шаблоне игнорируются: «foo bar» ищет «foobar» как подпоследовательность
+    m_folded.reserve(pattern.size());
+    for (const QChar ch : pattern) {
+        if (ch.isSpace()) {
+            continue;
+        }
+        const char16_t folded = UnicodeFold()(ch.unicode());
+        m_folded.push_back(folded);
+        if (folded > 0xFF) {
+            m_latin1 = false;
+        }
+    }
+
+    if (m_latin1) {
+        m_other.reserve(m_folded.size());
+        for (char16_t c : m_folded) {
+            m_other.push_back(hasLatin1Upper(c) ? char16_t(c - 0x20) : c);
+        }
+    }
+}
+
+bool FuzzyMatcher::isEmpty() const
+{
+    return m_folded.isEmpty();
+}
+
+int FuzzyMatcher::score(QStringView text, QVector<int> *positions) const
+{
+    if (positions) {
+        positions->clear();
+    }
+    if (m_folded.isEmpty()) {
+        return 0;
+    }
+    const qsizetype length = text.size();
+    if (length < m_folded.size()) {
+        return NoMatch;
+    }
+
+    const char16_t *data = text.utf16();
+    if (m_latin1 && isLatin1(data, length)) {
+        const auto find = [this](const char16_t *t, qsizetype from, qsizetype n, qsizetype p) {
+            return findLatin1(t, from, n, m_folded.at(p), m_other.at(p));
+        };
+        return scoreWindow(data, length, m_folded, Latin1Fold(), find, positions);
+    }
+
+    const UnicodeFold fold;
+    const auto find = [this, fold](const char16_t *t, qsizetype from, qsizetype n, qsizetype p) {
+        const char16_t target = m_folded.at(p);
+        for (qsizetype i = from; i < n; ++i) {
+            if (fold(t[i]) == target) {
+                return i;
+            }
+        }
+        return qsizetype(-1);
+    };
+    return scoreWindow(data, length, m_folded, fold, find, positions);
+}
+
+const char *FuzzyMatcher::implementation()
+{
+#if defined(SMARTCLIP_FUZZY_AVX2)
+    return "avx2";
+#elif defined(SMARTCLIP_FUZZY_SSE2)
+    return "sse2";
+#elif defined(SMARTCLIP_FUZZY_NEON)
+    return "neon";
+#else
+    return "portable";
+#endif
+}
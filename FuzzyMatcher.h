@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QString>
+#include <QStringView>
+#include <QVector>
+
+// fzf-style fuzzy matcher: the pattern must occur in the text as a
+// case-insensitive subsequence, and the shortest such window is scored with
+// bonuses for matches at word boundaries, camelCase humps and runs of
+// consecutive characters, and penalties for gaps.
+//
+// When both pattern and text are Latin-1, the scan for the next pattern
+// character compares 8 or 16 UTF-16 units at a time (SSE2, AVX2 when
+// configured with SMARTCLIP_ENABLE_AVX2, NEON on ARM64). Other text takes the scalar path, which
+// folds case with QChar. Instances are immutable after construction and safe
+// to share between threads.
+class FuzzyMatcher final
+{
+public:
+    static constexpr int NoMatch = -1;
+
+    explicit FuzzyMatcher(const QString &pattern);
+
+    bool isEmpty() const;
+
+    // Higher is better; NoMatch when text does not contain the pattern.
+    // positions, if given, receives the matched indices in text.
+    int score(QStringView text, QVector<int> *positions = nullptr) const;
+
+    // Name of the scan implementation compiled in, for diagnostics
+    static const char *implementation();
+
+private:
+    QVector<char16_t> m_folded; // pattern folded with QChar::toCaseFolded
+    QVector<char16_t> m_other;  // other-case twin of each unit, Latin-1 patterns only
+    bool m_latin1 = true;
+};
@@ -0,0 +1,270 @@
+#include "HistoryJournal.h"
+#include "CryptoManager.h"
+#include "Trace.h"
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QtEndian>
+
+namespace {
+
+QByteArray encodeRecord(const HistoryJournal::Record &record)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_6_0);
+    out << quint8(record.op) << record.sequence << record.digest << record.timestampMs;
+    if (record.op == HistoryJournal::Op::Add) {
+        out << record.preview << record.length;
+        // Записи простых клипов не меняются: части дописываются только при наличии
+        if (!record.parts.isEmpty()) {
+            out << quint32(record.parts.size());
+            for (const HistoryManager::Part &part : record.parts) {
+                out << part.mimeType << part.digest << part.size;
+            }
+        }
+    }
+    return payload;
+}
+
+bool decodeRecord(const QByteArray &payload, HistoryJournal::Record &record)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_6_0);
+    quint8 op = 0;
+    in >> op >> record.sequence >> record.digest >> record.timestampMs;
+    if (op < quint8(HistoryJournal::Op::Add) || op > quint8(HistoryJournal::Op::Clear)) {
+        return false;
+    }
+    record.op = HistoryJournal::Op(op);
+    if (record.op == HistoryJournal::Op::Add) {
+        in >> record.preview >> record.length;
+        if (!in.atEnd()) {
+            quint32 count = 0;
+            in >> count;
+            for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+                HistoryManager::Part part;
+                in >> part.mimeType >> part.digest >> part.size;
+                record.parts.push_back(part);
+            }
+        }
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+} // namespace
+
+HistoryJournal::HistoryJournal(const QString &filePath, const CryptoManager *crypto, QObject *parent)
+    : QObject(parent)
+    , m_filePath(filePath)
+    , m_crypto(crypto)
+{
+}
+
+HistoryJournal::~HistoryJournal()
+{
+    m_file.close();
+}
+
+bool HistoryJournal::openForAppend()
+{
+    if (m_file.isOpen()) {
+        return true;
+    }
+
+    const QFileInfo fi(m_filePath);
+    if (!fi.dir().exists()) {
+        QDir().mkpath(fi.dir().absolutePath());
+    }
+
+    m_file.setFileName(m_filePath);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        return false;
+    }
+    m_file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    return true;
+}
+
+bool HistoryJournal::append(Record record)
+{
+    SMARTCLIP_TRACE("journal.append");
+    if (!m_crypto || !openForAppend()) {
+        return false;
+    }
+    record.sequence = ++m_lastSequence;
+
+    const QByteArray encrypted = m_crypto->encrypt(encodeRecord(record));
+    const quint32 length = qToBigEndian<quint32>(quint32(encrypted.size()));
+
+    QByteArray frame;
+    frame.reserve(int(sizeof(length)) + encrypted.size());
+    frame.append(reinterpret_cast<const char *>(&length), sizeof(length));
+    frame.append(encrypted);
+
+    // Одна запись — один write(), сразу в ядро: переживает падение процесса
+    const bool ok = m_file.write(frame) == frame.size();
+    m_file.flush();
+    ++m_pendingRecords;
+    return ok;
+}
+
+QVector<HistoryJournal::Record> HistoryJournal::readAll()
+{
+    QVector<Record> records;
+    readSegment(rotatedPath(), records);
+    readSegment(m_filePath, records);
+    for (const Record &record : records) {
+        advanceSequence(record.sequence);
+    }
+    return records;
+}
+
+void HistoryJournal::readSegment(const QString &path, QVector<Record> &records) const
+{
+    QFile f(path);
+    if (!m_crypto || !f.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const QByteArray data = f.readAll();
+    qsizetype pos = 0;
+    while (pos + qsizetype(sizeof(quint32)) <= data.size()) {
+        const quint32 length = qFromBigEndian<quint32>(data.constData() + pos);
+        pos += sizeof(quint32);
+        if (length == 0 || pos + qsizetype(length) > data.size()) {
+            break; // Оборванная запись в конце файла
+        }
+
+        Record record;
+        const QByteArray payload = m_crypto->decrypt(data.mid(pos, length));
+        pos += length;
+        if (payload.isEmpty() || !decodeRecord(payload, record)) {
+            break;
+        }
+        records.push_back(record);
+    }
+}
+
+qint64 HistoryJournal::size() const
+{
+    if (m_file.isOpen()) {
+        return m_file.size();
+    }
+    return QFileInfo(m_filePath).size();
+}
+
+int HistoryJournal::pendingRecords() const
+{
+    return m_pendingRecords;
+}
+
+quint64 HistoryJournal::lastSequence() const
+{
+    return m_lastSequence;
+}
+
+void HistoryJournal::advanceSequence(quint64 sequence)
+{
+    // Номера никогда не уменьшаются, даже после clear(): иначе новые записи
+    // оказались бы «старше» уже записанного снимка
+    m_lastSequence = qMax(m_lastSequence, sequence);
+}
+
+bool HistoryJournal::replay(const QVector<Record> &records, quint64 snapshotSequence, HistoryManager *history,
+                            const std::function<void(quint64 id)> &toggleFavorite)
+{
+    SMARTCLIP_TRACE("journal.replay", records.size());
+    advanceSequence(snapshotSequence);
+    bool replayed = false;
+    for (const Record &record : records) {
+        advanceSequence(record.sequence);
+        // Записи до снимка уже в нём: сегмент мог не успеть удалиться
+        if (record.sequence <= snapshotSequence) {
+            continue;
+        }
+        replayed = true;
+
+        if (record.op == Op::Add) {
+            HistoryManager::HistoryItem added;
+            added.digest = record.digest;
+            added.preview = record.preview;
+            added.length = record.length;
+            added.addedAtMs = record.timestampMs;
+            added.parts = record.parts;
+            history->addStored(added);
+            continue;
+        }
+        if (record.op == Op::Clear) {
+            history->clearHistory();
+            continue;
+        }
+
+        const HistoryManager::HistoryItem *item = history->findByDigest(record.digest);
+        if (!item) {
+            continue;
+        }
+        const quint64 id = item->id;
+        switch (record.op) {
+        case Op::Use:
+            history->incrementUsageCount(id);
+            break;
+        case Op::ToggleFavorite:
+            if (toggleFavorite) {
+                toggleFavorite(id);
+            } else {
+                history->toggleFavorite(id);
+            }
+            break;
+        case Op::ToggleMask:
+            history->setMasked(id, !item->isMasked);
+            break;
+        default:
+            break;
+        }
+    }
+    return replayed;
+}
+
+void HistoryJournal::rotate()
+{
+    m_file.close();
+    m_pendingRecords = 0;
+
+    if (!QFile::exists(m_filePath)) {
+        return;
+    }
+
+    const QString oldPath = rotatedPath();
+    if (!QFile::exists(oldPath)) {
+        QFile::rename(m_filePath, oldPath);
+        return;
+    }
+
+    // Предыдущий снимок не был записан: дописываем активный сегмент к старому
+    QFile current(m_filePath);
+    QFile old(oldPath);
+    if (current.open(QIODevice::ReadOnly) && old.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        if (old.write(current.readAll()) >= 0) {
+            current.close();
+            QFile::remove(m_filePath);
+        }
+    }
+}
+
+void HistoryJournal::removeRotated()
+{
+    QFile::remove(rotatedPath());
+}
+
+void HistoryJournal::clear()
+{
+    m_file.close();
+    m_pendingRecords = 0;
+    QFile::remove(m_filePath);
+    QFile::remove(rotatedPath());
+}
+
+QString HistoryJournal::rotatedPath() const
+{
+    return m_filePath + QLatin1String(".old");
+}
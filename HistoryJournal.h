@@ -0,0 +1,76 @@
+#pragma once
+
+#include "HistoryManager.h"
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+class CryptoManager;
+
+// Append-only log of history mutations written between snapshots.
+// Every record is encrypted on its own and framed by a 4-byte length, so a
+// torn write at the tail only loses that record.
+class HistoryJournal final : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Op : quint8 {
+        Add = 1,
+        Use = 2,
+        ToggleFavorite = 3,
+        ToggleMask = 4,
+        Clear = 5,
+    };
+
+    struct Record {
+        Op op = Op::Add;
+        quint64 sequence = 0;   // assigned by append(), grows for the journal's lifetime
+        QByteArray digest;      // body digest of the item, empty for Clear
+        qint64 timestampMs = 0; // addedAtMs for Add
+        QString preview;        // Add only; the body itself is in the blob store
+        qint64 length = 0;      // Add only
+        QVector<HistoryManager::Part> parts; // Add of a rich clip
+    };
+
+    HistoryJournal(const QString &filePath, const CryptoManager *crypto, QObject *parent = nullptr);
+    ~HistoryJournal() override;
+
+    bool append(Record record);
+    // Records of the rotated segment followed by the active one; later
+    // append() calls continue after the highest sequence found
+    QVector<Record> readAll();
+    qint64 size() const;
+    // Records appended since the last rotate() or clear()
+    int pendingRecords() const;
+    // Sequence of the last appended record. A snapshot stores it, so replay
+    // can skip records that the snapshot already contains.
+    quint64 lastSequence() const;
+    void advanceSequence(quint64 sequence);
+
+    // Applies the records newer than snapshotSequence to history and advances
+    // past every record seen. Favorite toggles go through toggleFavorite when
+    // it is given, so the app can assign colors. True if anything was applied.
+    bool replay(const QVector<Record> &records, quint64 snapshotSequence, HistoryManager *history,
+                const std::function<void(quint64 id)> &toggleFavorite = {});
+
+    // Moves the active segment aside before a snapshot is taken; the rotated
+    // segment is dropped once that snapshot has been written.
+    void rotate();
+    void removeRotated();
+    void clear();
+
+private:
+    bool openForAppend();
+    void readSegment(const QString &path, QVector<Record> &records) const;
+    QString rotatedPath() const;
+
+    QString m_filePath;
+    const CryptoManager *m_crypto = nullptr;
+    QFile m_file;
+    quint64 m_lastSequence = 0;
+    int m_pendingRecords = 0;
+};
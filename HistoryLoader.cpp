@@ -0,0 +1,77 @@
+#include "HistoryLoader.h"
+#include "HistoryStorage.h"
+#include "Trace.h"
+#include <QMutexLocker>
+#include <utility>
+
+HistoryLoader::HistoryLoader(const QString &historyPath, const QString &journalPath, const CryptoManager *crypto,
+                             QObject *parent)
+    : QObject(parent)
+    , m_historyPath(historyPath)
+    , m_journalPath(journalPath)
+    , m_crypto(crypto)
+{
+}
+
+HistoryLoader::~HistoryLoader()
+{
+    // Чтение не прерывается: снимок открыт через map и читается недолго
+    waitForFinished();
+}
+
+void HistoryLoader::start()
+{
+    if (m_thread) {
+        return;
+    }
+    m_thread.reset(QThread::create([this]() {
+        run();
+    }));
+    m_thread->setObjectName(QStringLiteral("SmartClip history load"));
+    m_thread->start();
+}
+
+void HistoryLoader::waitForFinished()
+{
+    if (m_thread) {
+        m_thread->wait();
+    }
+}
+
+bool HistoryLoader::isFinished() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_finished;
+}
+
+HistoryLoader::Result HistoryLoader::takeResult()
+{
+    QMutexLocker locker(&m_mutex);
+    return std::exchange(m_result, Result());
+}
+
+void HistoryLoader::run()
+{
+    SMARTCLIP_TRACE("history.load");
+    Result result;
+
+    // Расшифровываются только таблица записей и превью; тела — по требованию
+    HistoryStorage storage(m_historyPath, m_crypto);
+    if (storage.open()) {
+        result.hasSnapshot = true;
+        result.items = storage.items();
+        result.snapshotSequence = storage.journalSequence();
+        storage.close();
+    }
+
+    // Свой экземпляр журнала только для чтения: дописывает в файл GUI-поток
+    HistoryJournal journal(m_journalPath, m_crypto);
+    result.journal = journal.readAll();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_result = std::move(result);
+        m_finished = true;
+    }
+    emit finished();
+}
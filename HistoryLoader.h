@@ -0,0 +1,58 @@
+#pragma once
+
+#include "HistoryJournal.h"
+#include "HistoryManager.h"
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <memory>
+
+class CryptoManager;
+
+// Reads the history snapshot and the journal on a dedicated thread, so the
+// tray icon shows up before a large history is decrypted. The GUI thread
+// gets back plain items and records and applies them in one pass with
+// HistoryManager::bulkLoad() and a journal replay.
+//
+// One load per instance; the thread ends once finished() is emitted.
+class HistoryLoader final : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Result {
+        bool hasSnapshot = false;
+        QVector<HistoryManager::HistoryItem> items; // in menu order, without ids
+        quint64 snapshotSequence = 0;               // last journal record in the snapshot
+        QVector<HistoryJournal::Record> journal;    // both segments, oldest first
+    };
+
+    HistoryLoader(const QString &historyPath, const QString &journalPath, const CryptoManager *crypto,
+                  QObject *parent = nullptr);
+    ~HistoryLoader() override;
+
+    void start();
+    // Blocks until the load is over; returns at once if it never started
+    void waitForFinished();
+    bool isFinished() const;
+    // The loaded history; valid once after finished()
+    Result takeResult();
+
+signals:
+    // Emitted from the worker thread; connections to GUI objects are queued
+    void finished();
+
+private:
+    void run();
+
+    const QString m_historyPath;
+    const QString m_journalPath;
+    const CryptoManager *m_crypto = nullptr;
+    std::unique_ptr<QThread> m_thread;
+
+    mutable QMutex m_mutex;
+    Result m_result;
+    bool m_finished = false;
+};
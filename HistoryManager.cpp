@@ -1,20 +1,118 @@
 #include "HistoryManager.h"
-#include <QFile>
-#include <QFileInfo>
-#include <QDir>
-#include <QTextStream>
-#include <QRegularExpression>
+#include "FuzzyMatcher.h"
+#include "Trace.h"
+#include <QIODevice>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QByteArray>
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <QtConcurrentMap>
 #include <algorithm>
+#include <iterator>
+
+namespace {
+
+// Ниже этого размера раздача задач пулу потоков дороже самой оценки
+const qsizetype kParallelScoreThreshold = 16384;
+const qsizetype kScoreChunk = 4096;
+
+// Заголовок выгрузки JSON Lines; более новую версию импорт не читает
+const char kJsonlFormat[] = "smartclip-history";
+const int kJsonlVersion = 1;
+// Строки читаются такими порциями
+const qint64 kReadChunkBytes = 64 * 1024;
+
+bool writeJsonLine(QIODevice *device, const QJsonObject &object)
+{
+    const QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+    return device->write(line) == line.size();
+}
+
+// Следующая строка в line, порциями через chunk: память растёт с длиной
+// строки, а не с пределом записи. Строку длиннее maxBytes дочитывает до
+// конца, не накапливая, и оставляет line пустой с *oversized. Ложь — конец файла
+bool readJsonlLine(QIODevice *device, QByteArray &chunk, QByteArray &line, qint64 maxBytes, bool *oversized)
+{
+    // resize(0) в Qt 6 сохраняет выделенную память для следующих строк
+    line.resize(0);
+    *oversized = false;
+    bool read = false;
+    for (;;) {
+        const qint64 n = device->readLine(chunk.data(), chunk.size());
+        if (n <= 0) {
+            return read;
+        }
+        read = true;
+        if (!*oversized) {
+            if (line.size() + n > maxBytes) {
+                *oversized = true;
+                line.resize(0);
+            } else {
+                line.append(chunk.constData(), n);
+            }
+        }
+        if (chunk.at(n - 1) == '\n') {
+            return true;
+        }
+    }
+}
+
+} // namespace
 
 HistoryManager::HistoryManager(QObject *parent)
     : QObject(parent)
 {
 }
 
-const QVector<HistoryManager::HistoryItem> &HistoryManager::history() const
+template<typename Fn>
+void HistoryManager::updateItem(quint64 id, Fn &&fn)
 {
-    return m_history;
+    // Переставляем только изменённый элемент: O(log n)
+    const auto it = m_items.find(id);
+    if (it == m_items.end()) {
+        return;
+    }
+
+    HistoryItem &item = it.value();
+    m_order.erase(orderKey(item));
+    m_byAge.erase(AgeKey(item.addedAtMs, id));
+    fn(item);
+    m_order.insert(orderKey(item));
+    m_byAge.emplace(item.addedAtMs, id);
+    compressCold(item);
+}
+
+QVector<quint64> HistoryManager::orderedIds(int offset, int limit) const
+{
+    QVector<quint64> ids;
+    if (offset < 0 || offset >= int(m_order.size())) {
+        return ids;
+    }
+    const int available = int(m_order.size()) - offset;
+    const int count = (limit < 0) ? available : qMin(limit, available);
+    ids.reserve(count);
+    auto it = std::next(m_order.begin(), offset);
+    for (int i = 0; i < count; ++i, ++it) {
+        ids.push_back(it->id);
+    }
+    return ids;
+}
+
+QVector<HistoryManager::HistoryItem> HistoryManager::snapshot() const
+{
+    SMARTCLIP_TRACE("history.snapshot", m_items.size());
+    QVector<HistoryItem> items;
+    items.reserve(m_items.size());
+    for (const OrderKey &key : m_order) {
+        items.push_back(m_items.value(key.id));
+    }
+    return items;
+}
+
+int HistoryManager::size() const
+{
+    return int(m_items.size());
 }
 
 int HistoryManager::maxItems() const
@@ -27,220 +125,825 @@ void HistoryManager::setMaxItems(int maxItems)
     if (m_maxItems != maxItems) {
         m_maxItems = maxItems;
         trimToMaxItems();
-        m_dirty = true;
+        markDirty(DirtyItems);
     }
 }
 
+qint64 HistoryManager::maxTextBytes() const
+{
+    return m_maxTextBytes;
+}
+
+void HistoryManager::setMaxTextBytes(qint64 bytes)
+{
+    if (m_maxTextBytes != bytes) {
+        m_maxTextBytes = bytes;
+        trimToMaxItems();
+        markDirty(DirtyItems);
+    }
+}
+
+qint64 HistoryManager::textBytes() const
+{
+    return m_textBytes;
+}
+
 bool HistoryManager::isDirty() const
+{
+    return m_dirty.toInt() != 0;
+}
+
+HistoryManager::DirtyFields HistoryManager::dirtyFields() const
 {
     return m_dirty;
 }
 
 void HistoryManager::clearDirty()
 {
-    m_dirty = false;
+    m_dirty = {};
+}
+
+void HistoryManager::markDirty(DirtyFields fields)
+{
+    m_dirty |= fields;
+    emit changed(fields);
 }
 
-void HistoryManager::addToHistory(const QString &text)
+quint64 HistoryManager::addToHistory(const QString &text, qint64 addedAtMs)
 {
+    SMARTCLIP_TRACE("history.add", text.size());
     if (text.trimmed().isEmpty()) {
-        return;
+        return 0;
     }
 
-    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
-    auto it = std::find_if(m_history.begin(), m_history.end(), [&text](const HistoryItem &item) {
-        return item.text == text;
-    });
-
-    if (it == m_history.end()) {
-        HistoryItem item;
-        item.text = text;
-        item.usageCount = 0;
-        item.addedAtMs = nowMs;
-        m_history.push_back(item);
-    } else {
-        it->addedAtMs = nowMs;
-    }
+    HistoryItem item;
+    item.addedAtMs = addedAtMs > 0 ? addedAtMs : QDateTime::currentMSecsSinceEpoch();
+    const quint64 firstNewId = m_nextId;
+    const quint64 id = insertText(text, item);
 
     trimToMaxItems();
-    sortHistory(); // Сортируем после добавления
-    m_dirty = true;
+    // Повторное копирование меняет только время добавления
+    markDirty(id >= firstNewId ? DirtyItems : DirtyCounters);
+    return m_items.contains(id) ? id : 0;
 }
 
-void HistoryManager::trimToMaxItems()
+quint64 HistoryManager::addStored(const HistoryItem &item)
+{
+    return addExternal(item, {});
+}
+
+quint64 HistoryManager::addPrepared(const HistoryItem &item, const BlobStore::Prepared &body)
+{
+    return addExternal(item, {body});
+}
+
+quint64 HistoryManager::addPrepared(const HistoryItem &item, const QVector<BlobStore::Prepared> &bodies)
 {
-    while (m_history.size() > m_maxItems) {
-        int oldestIndex = 0;
-        qint64 oldestTs = m_history.at(0).addedAtMs;
-        for (int i = 1; i < m_history.size(); ++i) {
-            const qint64 ts = m_history.at(i).addedAtMs;
-            if (ts < oldestTs) {
-                oldestTs = ts;
-                oldestIndex = i;
+    return addExternal(item, bodies);
+}
+
+quint64 HistoryManager::addExternal(const HistoryItem &item, const QVector<BlobStore::Prepared> &bodies)
+{
+    SMARTCLIP_TRACE("history.add_external");
+    if (item.digest.isEmpty()) {
+        return 0;
+    }
+
+    const qint64 nowMs = item.addedAtMs > 0 ? item.addedAtMs : QDateTime::currentMSecsSinceEpoch();
+    quint64 id = findId(item.digest);
+    const bool isNew = id == 0;
+    if (isNew) {
+        HistoryItem added;
+        added.digest = item.digest;
+        added.preview = item.preview;
+        added.length = item.length;
+        added.addedAtMs = nowMs;
+        added.parts = item.parts;
+        if (bodies.isEmpty()) {
+            acquireStored(added);
+        } else {
+            for (const BlobStore::Prepared &body : bodies) {
+                m_blobs.acquirePrepared(body);
             }
         }
-        m_history.removeAt(oldestIndex);
+        insertItem(added);
+        id = added.id;
+    } else {
+        updateItem(id, [nowMs](HistoryItem &existing) {
+            existing.addedAtMs = nowMs;
+        });
     }
+
+    trimToMaxItems();
+    markDirty(isNew ? DirtyItems : DirtyCounters);
+    return m_items.contains(id) ? id : 0;
 }
 
-void HistoryManager::loadHistory(const QString &filePath)
+void HistoryManager::restoreItem(const HistoryItem &item)
 {
-    QFile f(filePath);
-    if (!f.exists()) {
+    if (item.digest.isEmpty()) {
         return;
     }
-    if (!f.open(QIODevice::ReadOnly | QIODevice::Text)) {
+
+    // Поисковый индекс после массовой загрузки строится при первом поиске
+    m_searchValid = false;
+    m_search.clear();
+    restoreOne(item);
+    trimToMaxItems();
+}
+
+void HistoryManager::bulkLoad(const QVector<HistoryItem> &items)
+{
+    SMARTCLIP_TRACE("history.bulk_load", items.size());
+    m_searchValid = false;
+    m_search.clear();
+    m_items.reserve(m_items.size() + items.size());
+    m_index.reserve(m_index.size() + items.size());
+    for (const HistoryItem &item : items) {
+        restoreOne(item);
+    }
+    // Лишнее снимается один раз, а не после каждого элемента
+    trimToMaxItems();
+}
+
+void HistoryManager::restoreOne(const HistoryItem &item)
+{
+    if (item.digest.isEmpty()) {
         return;
     }
 
-    QVector<HistoryItem> loaded;
-    HistoryItem current;
-    bool inItem = false;
+    // Тело остаётся на диске до первого обращения
+    const quint64 id = findId(item.digest);
+    if (id == 0) {
+        HistoryItem restored = item;
+        acquireStored(restored);
+        insertItem(restored);
+    } else {
+        updateItem(id, [&item](HistoryItem &target) {
+            target.usageCount = item.usageCount;
+            target.addedAtMs = item.addedAtMs;
+            target.isFavorite = item.isFavorite;
+            target.isMasked = item.isMasked;
+            target.colorIndex = item.colorIndex;
+        });
+    }
+}
 
-    auto parseKeyValue = [&current](const QString &line) {
-        const int idx = line.indexOf(QLatin1Char(':'));
-        if (idx <= 0) {
-            return;
+void HistoryManager::trimToMaxItems()
+{
+    Trace::Span span("history.trim");
+    const int before = int(m_items.size());
+    // Самые старые элементы в начале m_byAge, удаление O(log n)
+    while (m_items.size() > m_maxItems && !m_byAge.empty()) {
+        removeItem(m_byAge.begin()->second);
+    }
+
+    // Бюджет объёма текста: снимаем с конца меню, то есть наименее ценные элементы.
+    // Избранное стоит в начале: если последний элемент избранный, то и все
+    if (m_maxTextBytes > 0) {
+        while (m_textBytes > m_maxTextBytes && !m_order.empty()) {
+            const OrderKey &last = *m_order.rbegin();
+            if (last.isFavorite) {
+                break;
+            }
+            removeItem(last.id);
         }
+    }
+    span.setValue(before - int(m_items.size()));
+}
 
-        const QString key = line.left(idx).trimmed();
-        const QString val = line.mid(idx + 1).trimmed();
+qint64 HistoryManager::exportJsonl(QIODevice *device) const
+{
+    SMARTCLIP_TRACE("history.export_jsonl", m_items.size());
+    QJsonObject header;
+    header.insert(QStringLiteral("format"), QLatin1String(kJsonlFormat));
+    header.insert(QStringLiteral("version"), kJsonlVersion);
+    if (!writeJsonLine(device, header)) {
+        return -1;
+    }
 
-        if (key == QLatin1String("text_b64")) {
-            current.text = QString::fromUtf8(QByteArray::fromBase64(val.toUtf8()));
-        } else if (key == QLatin1String("usage_count")) {
-            bool ok = false;
-            const int v = val.toInt(&ok);
-            if (ok && v >= 0) {
-                current.usageCount = v;
-            }
-        } else if (key == QLatin1String("added_at_ms")) {
-            bool ok = false;
-            const qint64 v = val.toLongLong(&ok);
-            if (ok && v >= 0) {
-                current.addedAtMs = v;
-            }
-        } else if (key == QLatin1String("is_favorite")) {
-            current.isFavorite = (val == QLatin1String("true"));
+    // Старые первыми: при импорте с меньшим лимитом вытесняются они же
+    qint64 written = 0;
+    for (const AgeKey &key : m_byAge) {
+        const HistoryItem &item = m_items.constFind(key.second).value();
+        const QByteArray digest = textDigest(item);
+        if (digest.isEmpty()) {
+            continue; // Картинка или файлы без текстового представления
         }
-    };
 
-    QTextStream in(&f);
-    while (!in.atEnd()) {
-        const QString line = in.readLine();
-        const QString t = line.trimmed();
+        // Тело, поднятое с диска ради выгрузки, сразу отпускаем: память не растёт с историей
+        const bool resident = m_blobs.isResident(digest);
+        const QByteArray utf8 = m_blobs.data(digest);
+        if (!resident) {
+            m_blobs.evict(digest);
+        }
+        if (utf8.isEmpty()) {
+            continue;
+        }
 
-        if (t.startsWith(QLatin1Char('-'))) {
-            if (inItem && !current.text.isEmpty()) {
-                loaded.push_back(current);
-            }
-            current = HistoryItem{};
-            inItem = true;
+        QJsonObject record;
+        record.insert(QStringLiteral("text"), QString::fromUtf8(utf8));
+        record.insert(QStringLiteral("usage_count"), item.usageCount);
+        record.insert(QStringLiteral("added_at_ms"), item.addedAtMs);
+        record.insert(QStringLiteral("favorite"), item.isFavorite);
+        record.insert(QStringLiteral("masked"), item.isMasked);
+        record.insert(QStringLiteral("color"), item.colorIndex);
+        if (!writeJsonLine(device, record)) {
+            return -1;
+        }
+        ++written;
+    }
+    return written;
+}
+
+qint64 HistoryManager::importJsonl(QIODevice *device, qint64 *skipped)
+{
+    SMARTCLIP_TRACE("history.import_jsonl");
+    qint64 imported = 0;
+    qint64 rejected = 0;
+    m_searchValid = false;
+    m_search.clear();
 
-            const QString rest = t.mid(1).trimmed();
-            if (!rest.isEmpty()) {
-                parseKeyValue(rest);
+    // Буфер ограничен одной записью: файл любого размера читается построчно
+    QByteArray chunk(kReadChunkBytes, Qt::Uninitialized);
+    QByteArray line;
+    bool oversized = false;
+    while (readJsonlLine(device, chunk, line, MaxJsonlRecordBytes, &oversized)) {
+        if (oversized) {
+            ++rejected;
+            continue;
+        }
+        if (line.trimmed().isEmpty()) {
+            continue;
+        }
+
+        QJsonParseError error;
+        const QJsonDocument document = QJsonDocument::fromJson(line, &error);
+        if (error.error != QJsonParseError::NoError || !document.isObject()) {
+            ++rejected;
+            continue;
+        }
+        const QJsonObject record = document.object();
+        if (record.contains(QStringLiteral("format"))) {
+            if (record.value(QStringLiteral("version")).toInt() > kJsonlVersion) {
+                return -1;
             }
             continue;
         }
 
-        if (!inItem) {
+        const QString text = record.value(QStringLiteral("text")).toString();
+        if (text.trimmed().isEmpty()) {
+            ++rejected;
             continue;
         }
+        HistoryItem item;
+        item.usageCount = qMax(0, record.value(QStringLiteral("usage_count")).toInt());
+        item.addedAtMs = qint64(record.value(QStringLiteral("added_at_ms")).toDouble());
+        if (item.addedAtMs <= 0) {
+            item.addedAtMs = QDateTime::currentMSecsSinceEpoch();
+        }
+        item.isFavorite = record.value(QStringLiteral("favorite")).toBool();
+        item.isMasked = record.value(QStringLiteral("masked")).toBool();
+        item.colorIndex = item.isFavorite ? record.value(QStringLiteral("color")).toInt(-1) : -1;
 
-        parseKeyValue(t);
+        const QByteArray utf8 = text.toUtf8();
+        const QByteArray digest = BlobStore::digest(utf8);
+        const quint64 existing = findId(digest);
+        if (existing != 0) {
+            updateItem(existing, [&item](HistoryItem &target) {
+                target.usageCount = item.usageCount;
+                target.addedAtMs = item.addedAtMs;
+                target.isFavorite = item.isFavorite;
+                target.isMasked = item.isMasked;
+                target.colorIndex = item.colorIndex;
+            });
+        } else {
+            m_blobs.acquire(digest, utf8);
+            // Записанное на диск тело в памяти не держим
+            m_blobs.evict(digest);
+            item.digest = digest;
+            item.preview = makePreview(text);
+            item.length = text.size();
+            insertItem(item);
+        }
+        // Лимиты соблюдаются по ходу, а не после чтения всего файла
+        trimToMaxItems();
+        ++imported;
     }
 
-    if (inItem && !current.text.isEmpty()) {
-        loaded.push_back(current);
+    if (skipped) {
+        *skipped = rejected;
     }
+    if (imported > 0) {
+        markDirty(DirtyItems | DirtyCounters | DirtyFlags);
+    }
+    return imported;
+}
 
-    m_history = loaded;
-    sortHistory(); // Сортируем после загрузки
-    trimToMaxItems();
-    m_dirty = false;
+const HistoryManager::HistoryItem *HistoryManager::item(quint64 id) const
+{
+    const auto it = m_items.constFind(id);
+    return (it != m_items.cend()) ? &it.value() : nullptr;
+}
+
+QString HistoryManager::text(quint64 id) const
+{
+    const HistoryItem *found = item(id);
+    if (!found) {
+        return QString();
+    }
+    // Тело может лежать только на диске: хранилище подгрузит его по требованию
+    const QByteArray digest = textDigest(*found);
+    return digest.isEmpty() ? QString() : QString::fromUtf8(m_blobs.data(digest));
 }
 
-void HistoryManager::saveHistory(const QString &filePath) const
+QVector<std::pair<QString, QByteArray>> HistoryManager::partData(quint64 id) const
 {
-    const QFileInfo fi(filePath);
-    if (!fi.dir().exists()) {
-        QDir().mkpath(fi.dir().absolutePath());
+    QVector<std::pair<QString, QByteArray>> data;
+    const HistoryItem *found = item(id);
+    if (!found) {
+        return data;
+    }
+    data.reserve(found->parts.size());
+    for (const Part &part : found->parts) {
+        data.push_back({part.mimeType, m_blobs.data(part.digest)});
     }
+    return data;
+}
 
-    QFile f(filePath);
-    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+BlobStore *HistoryManager::blobStore()
+{
+    return &m_blobs;
+}
+
+void HistoryManager::setCompression(qint64 thresholdBytes, int coldAfter)
+{
+    m_blobs.setCompressionThreshold(thresholdBytes);
+    if (m_coldAfter == coldAfter) {
+        return;
+    }
+    m_coldAfter = coldAfter;
+    if (m_coldAfter <= 0 || int(m_order.size()) <= m_coldAfter) {
         return;
     }
 
-    QTextStream out(&f);
-    out << "version: 1\n";
-    out << "items:\n";
-    for (const HistoryItem &item : m_history) {
-        const QByteArray b64 = item.text.toUtf8().toBase64();
-        out << "  - text_b64: " << b64 << "\n";
-        out << "    usage_count: " << item.usageCount << "\n";
-        out << "    added_at_ms: " << item.addedAtMs << "\n";
-        out << "    is_favorite: " << (item.isFavorite ? "true" : "false") << "\n";
+    // Полный проход только при смене настройки; дальше сжимается по одному элементу
+    for (auto it = std::next(m_order.begin(), m_coldAfter); it != m_order.end(); ++it) {
+        const auto found = m_items.constFind(it->id);
+        if (found != m_items.cend()) {
+            compressBodies(found.value());
+        }
     }
 }
 
-void HistoryManager::toggleFavorite(const QString &text)
+BlobStore::Stats HistoryManager::compressionStats() const
 {
-    auto it = std::find_if(m_history.begin(), m_history.end(),
-                          [&text](HistoryItem &item) {
-                              return item.text == text;
-                          });
-    if (it != m_history.end()) {
-        it->isFavorite = !it->isFavorite;
-        m_dirty = true;
-        sortHistory(); // Пересортировываем после изменения
+    return m_blobs.stats();
+}
+
+void HistoryManager::toggleFavorite(quint64 id)
+{
+    SMARTCLIP_TRACE("history.toggle_favorite");
+    if (!m_items.contains(id)) {
+        return;
     }
+    updateItem(id, [](HistoryItem &item) {
+        item.isFavorite = !item.isFavorite;
+    });
+    markDirty(DirtyFlags);
+}
+
+void HistoryManager::toggleFavorite(const QString &text)
+{
+    toggleFavorite(findId(contentDigest(text)));
 }
 
 bool HistoryManager::isFavorite(const QString &text) const
 {
-    auto it = std::find_if(m_history.begin(), m_history.end(),
-                          [&text](const HistoryItem &item) {
-                              return item.text == text;
-                          });
-    return (it != m_history.end()) ? it->isFavorite : false;
+    const HistoryItem *found = item(findId(contentDigest(text)));
+    return found ? found->isFavorite : false;
+}
+
+void HistoryManager::setColorIndex(quint64 id, int colorIndex)
+{
+    const auto it = m_items.find(id);
+    if (it != m_items.end() && it->colorIndex != colorIndex) {
+        it->colorIndex = colorIndex;
+        markDirty(DirtyFlags);
+    }
+}
+
+void HistoryManager::setMasked(quint64 id, bool masked)
+{
+    SMARTCLIP_TRACE("history.set_masked");
+    const auto it = m_items.find(id);
+    if (it != m_items.end() && it->isMasked != masked) {
+        it->isMasked = masked;
+        // Маскированный текст не должен находиться поиском
+        if (m_searchValid) {
+            if (masked) {
+                m_search.remove(id);
+            } else {
+                indexItem(it.value());
+            }
+        }
+        markDirty(DirtyFlags);
+    }
 }
 
 void HistoryManager::sortHistory()
 {
-    std::sort(m_history.begin(), m_history.end(), [](const HistoryItem &a, const HistoryItem &b) {
-        // Сначала избранные элементы
-        if (a.isFavorite != b.isFavorite) {
-            return a.isFavorite > b.isFavorite;
+    SMARTCLIP_TRACE("history.sort", m_items.size());
+    // Полная перестройка упорядоченных индексов; мутаторы обновляют их точечно
+    m_order.clear();
+    m_byAge.clear();
+    for (auto it = m_items.cbegin(); it != m_items.cend(); ++it) {
+        m_order.insert(orderKey(it.value()));
+        m_byAge.emplace(it.value().addedAtMs, it.key());
+    }
+}
+
+void HistoryManager::incrementUsageCount(quint64 id)
+{
+    SMARTCLIP_TRACE("history.increment_usage");
+    if (!m_items.contains(id)) {
+        return;
+    }
+    updateItem(id, [](HistoryItem &item) {
+        item.usageCount++;
+    });
+    markDirty(DirtyCounters);
+}
+
+void HistoryManager::incrementUsageCount(const QString &text)
+{
+    incrementUsageCount(findId(contentDigest(text)));
+}
+
+void HistoryManager::clearHistory()
+{
+    SMARTCLIP_TRACE("history.clear", m_items.size());
+    for (auto it = m_items.cbegin(); it != m_items.cend(); ++it) {
+        releaseBodies(it.value());
+    }
+    m_items.clear();
+    m_index.clear();
+    m_order.clear();
+    m_byAge.clear();
+    m_search.clear();
+    m_searchValid = true;
+    m_textBytes = 0;
+    markDirty(DirtyItems);
+}
+
+QVector<quint64> HistoryManager::search(const QString &query, int limit) const
+{
+    SMARTCLIP_TRACE("history.search", query.size());
+    ensureSearchIndex();
+    const QString folded = TrigramIndex::fold(query);
+    if (folded.isEmpty()) {
+        return {};
+    }
+    if (!TrigramIndex::covers(folded)) {
+        return searchShort(folded, limit);
+    }
+    const QVector<quint64> ids = m_search.search(query);
+
+    // Сначала совпадения с начала текста, затем порядок меню
+    struct Ranked {
+        bool prefix;
+        OrderKey key;
+    };
+    QVector<Ranked> ranked;
+    ranked.reserve(ids.size());
+    for (quint64 id : ids) {
+        const auto it = m_items.constFind(id);
+        if (it != m_items.cend()) {
+            ranked.push_back({m_search.matchPosition(id, folded) == 0, orderKey(it.value())});
+        }
+    }
+
+    const auto less = [](const Ranked &a, const Ranked &b) {
+        if (a.prefix != b.prefix) {
+            return a.prefix;
         }
-        // Затем по количеству использований
-        if (a.usageCount != b.usageCount) {
-            return a.usageCount > b.usageCount;
+        return OrderLess()(a.key, b.key);
+    };
+    const qsizetype count = (limit > 0) ? qMin<qsizetype>(limit, ranked.size()) : ranked.size();
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(), less);
+
+    QVector<quint64> result;
+    result.reserve(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        result.push_back(ranked.at(i).key.id);
+    }
+    return result;
+}
+
+QVector<quint64> HistoryManager::searchShort(const QString &folded, int limit) const
+{
+    // Одна-две буквы встречаются почти везде: обход в порядке меню набирает
+    // limit совпадений за несколько десятков элементов вместо всей истории
+    QVector<quint64> prefixed;
+    QVector<quint64> others;
+    for (const OrderKey &key : m_order) {
+        if (limit > 0 && prefixed.size() + others.size() >= limit) {
+            break;
         }
-        // Затем по дате создания
-        if (a.addedAtMs != b.addedAtMs) {
-            return a.addedAtMs > b.addedAtMs;
+        // Маскированных элементов в индексе нет: для них -1
+        const qsizetype pos = m_search.matchPosition(key.id, folded);
+        if (pos == 0) {
+            prefixed.push_back(key.id);
+        } else if (pos > 0) {
+            others.push_back(key.id);
         }
-        return a.text < b.text;
-    });
+    }
+    return prefixed + others;
 }
 
-void HistoryManager::incrementUsageCount(const QString &text)
+QVector<quint64> HistoryManager::fuzzySearch(const QString &pattern, int limit) const
 {
-    auto it = std::find_if(m_history.begin(), m_history.end(),
-                          [&text](HistoryItem &item) {
-                              return item.text == text;
-                          });
-    if (it != m_history.end()) {
-        it->usageCount++;
-        m_dirty = true;
-        sortHistory(); // Пересортировываем после изменения счетчика
+    SMARTCLIP_TRACE("history.fuzzy_search", pattern.size());
+    // Указатели в порядке меню: оценки пишутся по индексу, элементы не копируются
+    QVector<const HistoryItem *> items;
+    items.reserve(m_items.size());
+    for (const OrderKey &key : m_order) {
+        items.push_back(&m_items.constFind(key.id).value());
+    }
+    const FuzzyMatcher matcher(pattern);
+    const qsizetype n = items.size();
+
+    // Оценки пишутся по индексу меню, поэтому части можно считать независимо
+    QVector<int> scores(n, FuzzyMatcher::NoMatch);
+    const auto scoreRange = [&](qsizetype begin, qsizetype end) {
+        for (qsizetype i = begin; i < end; ++i) {
+            const HistoryItem *item = items.at(i);
+            if (!item->isMasked) {
+                scores[i] = matcher.score(item->preview);
+            }
+        }
+    };
+    if (n < kParallelScoreThreshold) {
+        scoreRange(0, n);
+    } else {
+        QVector<std::pair<qsizetype, qsizetype>> chunks;
+        for (qsizetype begin = 0; begin < n; begin += kScoreChunk) {
+            chunks.push_back({begin, qMin(begin + kScoreChunk, n)});
+        }
+        QtConcurrent::blockingMap(chunks, [&](const std::pair<qsizetype, qsizetype> &chunk) {
+            scoreRange(chunk.first, chunk.second);
+        });
     }
+
+    // Больший балл выше; при равенстве меньший индекс, то есть порядок меню
+    QVector<std::pair<int, qsizetype>> matches;
+    for (qsizetype i = 0; i < n; ++i) {
+        if (scores.at(i) != FuzzyMatcher::NoMatch) {
+            matches.push_back({-scores.at(i), i});
+        }
+    }
+    const qsizetype count = (limit > 0) ? qMin<qsizetype>(limit, matches.size()) : matches.size();
+    std::partial_sort(matches.begin(), matches.begin() + count, matches.end());
+
+    QVector<quint64> result;
+    result.reserve(count);
+    for (qsizetype i = 0; i < count; ++i) {
+        result.push_back(items.at(matches.at(i).second)->id);
+    }
+    return result;
 }
 
-void HistoryManager::clearHistory()
+const HistoryManager::HistoryItem *HistoryManager::findByDigest(const QByteArray &digest) const
+{
+    return item(findId(digest));
+}
+
+QByteArray HistoryManager::contentDigest(const QString &text)
+{
+    return BlobStore::digest(text.toUtf8());
+}
+
+QByteArray HistoryManager::partsDigest(const QVector<Part> &parts)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    for (const Part &part : parts) {
+        hash.addData(part.mimeType.toUtf8());
+        hash.addData(QByteArrayView("\0", 1));
+        hash.addData(part.digest);
+    }
+    return hash.result();
+}
+
+QString HistoryManager::makePreview(const QString &text)
+{
+    return text.left(PreviewLength);
+}
+
+bool HistoryManager::OrderLess::operator()(const OrderKey &a, const OrderKey &b) const
+{
+    // Сначала избранные элементы
+    if (a.isFavorite != b.isFavorite) {
+        return a.isFavorite > b.isFavorite;
+    }
+    // Затем по количеству использований
+    if (a.usageCount != b.usageCount) {
+        return a.usageCount > b.usageCount;
+    }
+    // Затем по дате создания
+    if (a.addedAtMs != b.addedAtMs) {
+        return a.addedAtMs > b.addedAtMs;
+    }
+    if (a.id == b.id) {
+        return false;
+    }
+    if (a.preview != b.preview) {
+        return a.preview < b.preview;
+    }
+    return a.id < b.id;
+}
+
+HistoryManager::OrderKey HistoryManager::orderKey(const HistoryItem &item)
 {
-    m_history.clear();
-    m_dirty = true;
+    OrderKey key;
+    key.isFavorite = item.isFavorite;
+    key.usageCount = item.usageCount;
+    key.addedAtMs = item.addedAtMs;
+    key.preview = item.preview;
+    key.id = item.id;
+    return key;
+}
+
+quint64 HistoryManager::digestKey(const QByteArray &digest)
+{
+    return digest.size() >= 8 ? qFromLittleEndian<quint64>(digest.constData()) : 0;
+}
+
+QByteArray HistoryManager::textDigest(const HistoryItem &item)
+{
+    if (item.parts.isEmpty()) {
+        return item.digest;
+    }
+    for (const Part &part : item.parts) {
+        if (part.mimeType == QLatin1String("text/plain")) {
+            return part.digest;
+        }
+    }
+    return QByteArray();
+}
+
+qint64 HistoryManager::textSize(const HistoryItem &item)
+{
+    if (item.parts.isEmpty()) {
+        return item.length * qint64(sizeof(QChar));
+    }
+    qint64 size = 0;
+    for (const Part &part : item.parts) {
+        size += part.size;
+    }
+    return size;
+}
+
+quint64 HistoryManager::findId(const QByteArray &digest) const
+{
+    // Полный дайджест сравниваем только при совпадении первых 8 байт
+    const auto range = m_index.equal_range(digestKey(digest));
+    for (auto it = range.first; it != range.second; ++it) {
+        const HistoryItem *found = item(it.value());
+        if (found && found->digest == digest) {
+            return it.value();
+        }
+    }
+    return 0;
+}
+
+quint64 HistoryManager::insertText(const QString &text, HistoryItem item)
+{
+    const QByteArray utf8 = text.toUtf8();
+    const QByteArray digest = BlobStore::digest(utf8);
+
+    const quint64 existing = findId(digest);
+    if (existing != 0) {
+        const qint64 addedAtMs = item.addedAtMs;
+        updateItem(existing, [addedAtMs](HistoryItem &target) {
+            target.addedAtMs = addedAtMs;
+        });
+        return existing;
+    }
+
+    // Одинаковые тела хранятся один раз
+    m_blobs.acquire(digest, utf8);
+    item.digest = digest;
+    item.preview = makePreview(text);
+    item.length = text.size();
+    insertItem(item);
+    return item.id;
+}
+
+void HistoryManager::insertItem(HistoryItem &item)
+{
+    item.id = m_nextId++;
+    // Снимок идёт в порядке меню, и при загрузке подсказка делает вставку O(1)
+    m_order.insert(m_order.end(), orderKey(item));
+    m_byAge.emplace_hint(m_byAge.end(), item.addedAtMs, item.id);
+    m_index.insert(digestKey(item.digest), item.id);
+    m_items.insert(item.id, item);
+    m_textBytes += textSize(item);
+    if (m_searchValid) {
+        indexItem(item);
+    }
+    compressCold(item);
+}
+
+void HistoryManager::removeItem(quint64 id)
+{
+    const auto it = m_items.constFind(id);
+    if (it == m_items.cend()) {
+        return;
+    }
+
+    m_order.erase(orderKey(it.value()));
+    m_byAge.erase(AgeKey(it.value().addedAtMs, id));
+    m_index.remove(digestKey(it.value().digest), id);
+    releaseBodies(it.value());
+    m_search.remove(id);
+    m_textBytes -= textSize(it.value());
+    m_items.erase(it);
+}
+
+void HistoryManager::compressCold(const HistoryItem &item)
+{
+    if (m_coldAfter <= 0 || int(m_order.size()) <= m_coldAfter) {
+        return;
+    }
+
+    // За одну мутацию за границу «горячих» позиций уходит не больше одного
+    // соседнего элемента, плюс сам изменённый элемент, если он опустился ниже
+    const auto boundary = std::next(m_order.begin(), m_coldAfter);
+    const auto crossed = m_items.constFind(boundary->id);
+    if (crossed != m_items.cend()) {
+        compressBodies(crossed.value());
+    }
+    if (!OrderLess()(orderKey(item), *boundary)) {
+        compressBodies(item);
+    }
+}
+
+void HistoryManager::acquireStored(const HistoryItem &item)
+{
+    if (item.parts.isEmpty()) {
+        m_blobs.acquireStored(item.digest);
+        return;
+    }
+    for (const Part &part : item.parts) {
+        m_blobs.acquireStored(part.digest);
+    }
+}
+
+void HistoryManager::releaseBodies(const HistoryItem &item)
+{
+    if (item.parts.isEmpty()) {
+        m_blobs.release(item.digest);
+        return;
+    }
+    // Одна и та же картинка в разных клипах хранится один раз
+    for (const Part &part : item.parts) {
+        m_blobs.release(part.digest);
+    }
+}
+
+void HistoryManager::compressBodies(const HistoryItem &item)
+{
+    if (item.parts.isEmpty()) {
+        m_blobs.compress(item.digest);
+        return;
+    }
+    for (const Part &part : item.parts) {
+        m_blobs.compress(part.digest);
+    }
+}
+
+void HistoryManager::indexItem(const HistoryItem &item)
+{
+    if (!item.isMasked) {
+        m_search.insert(item.id, item.preview);
+    }
+}
+
+void HistoryManager::ensureSearchIndex() const
+{
+    if (m_searchValid) {
+        return;
+    }
+
+    // id растут в порядке вставки: строим по возрастанию, чтобы списки шли без сортировки
+    QVector<quint64> ids = m_items.keys();
+    std::sort(ids.begin(), ids.end());
+    m_search.clear();
+    for (quint64 id : ids) {
+        const HistoryItem &item = m_items.constFind(id).value();
+        if (!item.isMasked) {
+            m_search.insert(id, item.preview);
+        }
+    }
+    m_searchValid = true;
 }
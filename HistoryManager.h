@@ -3,47 +3,222 @@
 #include <QObject>
 #include <QVector>
 #include <QString>
+#include <QByteArray>
 #include <QDateTime>
+#include <QHash>
+#include <QMultiHash>
+#include <set>
+#include <utility>
+#include "BlobStore.h"
+#include "TrigramIndex.h"
+
+class QIODevice;
 
 class HistoryManager final : public QObject
 {
     Q_OBJECT
 
 public:
+    // One MIME representation of a rich clip, stored as its own blob
+    struct Part {
+        QString mimeType;
+        QByteArray digest; // key in the blob store
+        qint64 size = 0;   // bytes
+    };
+
     struct HistoryItem {
-        QString text;
+        quint64 id = 0; // stable for the lifetime of the item
+        QByteArray digest; // SHA-256 of the UTF-8 body, key in the blob store;
+                           // partsDigest(parts) for rich clips, which have no single body
+        QString preview;   // bounded prefix shown in the menu
+        qint64 length = 0; // body length in characters, text/plain part for rich clips
         int usageCount = 0;
         qint64 addedAtMs = 0;
         bool isFavorite = false;
+        bool isMasked = false;
+        int colorIndex = -1; // favorite dot color, -1 when not assigned
+        QVector<Part> parts; // rich clips only, text/plain included when present
+    };
+
+    static constexpr int PreviewLength = 200;
+    static constexpr qint64 MaxJsonlRecordBytes = 256 * 1024 * 1024;
+
+    // What changed since the last clearDirty(); lets the save scheduler tell
+    // a usage bump from new or removed items
+    enum DirtyField {
+        DirtyItems = 0x1,    // items added, removed or cleared
+        DirtyCounters = 0x2, // usage counts and recency
+        DirtyFlags = 0x4,    // favorite, mask and color
     };
+    Q_DECLARE_FLAGS(DirtyFields, DirtyField)
 
     explicit HistoryManager(QObject *parent = nullptr);
     ~HistoryManager() = default;
 
-    const QVector<HistoryItem> &history() const;
+    // Ids in menu order, starting at position offset; limit < 0 takes the
+    // rest. Walks the order index on every call instead of keeping a sorted
+    // copy of the items that each mutation would invalidate: a page costs
+    // O(offset + limit).
+    QVector<quint64> orderedIds(int offset = 0, int limit = -1) const;
+    // Copy of the items in menu order for background writers. Each call walks
+    // the whole order, O(n) on the calling thread; the items share their
+    // strings with the manager, so it copies no text.
+    QVector<HistoryItem> snapshot() const;
+    int size() const;
     int maxItems() const;
     void setMaxItems(int maxItems);
+    // Budget for textBytes(); 0 means unlimited. Over budget, items are
+    // evicted from the bottom of the menu order; favorites are never evicted
+    // for bytes.
+    qint64 maxTextBytes() const;
+    void setMaxTextBytes(qint64 bytes);
+    // Logical size of the history: 2 bytes per UTF-16 character of a text
+    // clip, the raw part sizes of a rich one. It bounds how much text the
+    // history holds, not what it takes in memory or on disk: bodies live in
+    // the blob store as UTF-8, usually compressed and mostly not resident.
+    qint64 textBytes() const;
     bool isDirty() const;
+    DirtyFields dirtyFields() const;
     void clearDirty();
 
-    void addToHistory(const QString &text);
+    // addedAtMs == 0 stamps the item with the current time.
+    // Returns the id of the new or refreshed item, 0 for blank text.
+    quint64 addToHistory(const QString &text, qint64 addedAtMs = 0);
+    // Same for a body that is already in the blob store (journal replay)
+    quint64 addStored(const HistoryItem &item);
+    // Same for a body hashed and written by BlobStore::prepare() on a worker
+    // thread; item.digest must be body.digest
+    quint64 addPrepared(const HistoryItem &item, const BlobStore::Prepared &body);
+    // Same for a rich clip; bodies[i] holds item.parts[i]
+    quint64 addPrepared(const HistoryItem &item, const QVector<BlobStore::Prepared> &bodies);
+    // Inserts an item with its stored counters; the body stays on disk
+    void restoreItem(const HistoryItem &item);
+    // restoreItem() for a whole snapshot: one pass over items, which are
+    // expected in menu order, and a single trim at the end. Items already
+    // present keep their id and take the stored counters.
+    void bulkLoad(const QVector<HistoryItem> &items);
+    // Enforces both the item count and the byte budget
     void trimToMaxItems();
-    void loadHistory(const QString &filePath);
-    void saveHistory(const QString &filePath) const;
-    
+    // History as JSON Lines for backups and moving between machines: a
+    // {"format":"smartclip-history","version":1} header, then one object per
+    // item, oldest first:
+    //   {"text":"...","usage_count":3,"added_at_ms":1700000000000,
+    //    "favorite":true,"masked":false,"color":2}
+    // Bodies are read one at a time and stored ones are dropped from memory
+    // again, so neither direction holds more than one record. Rich clips are
+    // exported as their text/plain part; clips without one are left out.
+    // Returns the number of items written, -1 on a write error.
+    qint64 exportJsonl(QIODevice *device) const;
+    // Merges records read line by line, trimming as it goes; an item already
+    // present takes the imported counters. Malformed lines and lines over
+    // MaxJsonlRecordBytes are counted in *skipped. Returns the number of items
+    // imported, -1 for a file of a newer format version.
+    qint64 importJsonl(QIODevice *device, qint64 *skipped = nullptr);
+
+    // Access by id
+    const HistoryItem *item(quint64 id) const;
+    QString text(quint64 id) const;
+    // Bytes of every part of a rich clip, read from the blob store on demand
+    QVector<std::pair<QString, QByteArray>> partData(quint64 id) const;
+    BlobStore *blobStore();
+
+    // Bodies of at least thresholdBytes, or of items at position coldAfter
+    // and further down the menu, are kept compressed; text() unpacks them.
+    // 0 disables the corresponding rule.
+    void setCompression(qint64 thresholdBytes, int coldAfter);
+    BlobStore::Stats compressionStats() const;
+
     // Methods for favorites
+    void toggleFavorite(quint64 id);
     void toggleFavorite(const QString &text);
     bool isFavorite(const QString &text) const;
+    void setColorIndex(quint64 id, int colorIndex);
     void sortHistory();
-    
+
     // Method for usage count
+    void incrementUsageCount(quint64 id);
     void incrementUsageCount(const QString &text);
-    
+
+    // Masked items are shown with asterisks in the menu
+    void setMasked(quint64 id, bool masked);
+
+    // Case-insensitive substring search. Only the preview is searchable, that
+    // is the first PreviewLength characters of an item: text past them is
+    // never found. Masked items are never indexed. Results come prefix
+    // matches first, then in menu order; limit <= 0 returns all of them.
+    // Queries of one or two characters bypass the trigram index: they walk
+    // the menu order and stop at limit matches, so the prefix-first ranking
+    // applies among those.
+    QVector<quint64> search(const QString &query, int limit = 50) const;
+    // fzf-style fuzzy match over previews, best score first; equal scores
+    // keep menu order, so favorites and frequently used items win ties.
+    // Large histories are scored in parallel on the global thread pool.
+    QVector<quint64> fuzzySearch(const QString &pattern, int limit = 50) const;
+
     // Method to clear history
     void clearHistory();
 
+    // Item with the given digest or nullptr; valid until the next mutation
+    const HistoryItem *findByDigest(const QByteArray &digest) const;
+
+    static QByteArray contentDigest(const QString &text);
+    // Identity of a rich clip: same MIME types with the same bodies
+    static QByteArray partsDigest(const QVector<Part> &parts);
+    static QString makePreview(const QString &text);
+
+signals:
+    // Emitted after every mutation with the fields it touched
+    void changed(HistoryManager::DirtyFields fields);
+
 private:
-    QVector<HistoryItem> m_history;
+    // Sort key of the menu order: favorites, usage count, recency, preview
+    struct OrderKey {
+        bool isFavorite = false;
+        int usageCount = 0;
+        qint64 addedAtMs = 0;
+        QString preview; // implicitly shared with the item, compared only on ties
+        quint64 id = 0;
+    };
+    struct OrderLess {
+        bool operator()(const OrderKey &a, const OrderKey &b) const;
+    };
+    using AgeKey = std::pair<qint64, quint64>; // (addedAtMs, id)
+
+    static OrderKey orderKey(const HistoryItem &item);
+    static quint64 digestKey(const QByteArray &digest);
+    static qint64 textSize(const HistoryItem &item);
+    // Body that text() returns: the item's own, or its text/plain part
+    static QByteArray textDigest(const HistoryItem &item);
+    quint64 findId(const QByteArray &digest) const;
+    quint64 insertText(const QString &text, HistoryItem item);
+    quint64 addExternal(const HistoryItem &item, const QVector<BlobStore::Prepared> &bodies);
+    void restoreOne(const HistoryItem &item);
+    void acquireStored(const HistoryItem &item);
+    void releaseBodies(const HistoryItem &item);
+    void compressBodies(const HistoryItem &item);
+    void insertItem(HistoryItem &item);
+    void removeItem(quint64 id);
+    void compressCold(const HistoryItem &item);
+    void markDirty(DirtyFields fields);
+    void indexItem(const HistoryItem &item);
+    void ensureSearchIndex() const;
+    QVector<quint64> searchShort(const QString &folded, int limit) const;
+    template<typename Fn>
+    void updateItem(quint64 id, Fn &&fn);
+
+    QHash<quint64, HistoryItem> m_items;          // id -> item
+    QMultiHash<quint64, quint64> m_index;         // first 8 digest bytes -> id
+    std::set<OrderKey, OrderLess> m_order;        // menu order
+    std::set<AgeKey> m_byAge;                     // oldest first, for eviction
+    BlobStore m_blobs;
+    mutable TrigramIndex m_search;          // built on the first search after a bulk load
+    mutable bool m_searchValid = true;
+    quint64 m_nextId = 1;
     int m_maxItems = 20;
-    bool m_dirty = false;
+    qint64 m_maxTextBytes = 0;
+    qint64 m_textBytes = 0; // sum of textSize() over m_items
+    int m_coldAfter = 0;
+    DirtyFields m_dirty;
 };
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(HistoryManager::DirtyFields)
@@ -0,0 +1,139 @@
+#include "HistoryModel.h"
+#include <QPainter>
+#include <QPixmap>
+
+HistoryModel::HistoryModel(const HistoryManager *historyManager, QObject *parent)
+    : QAbstractListModel(parent)
+    , m_historyManager(historyManager)
+    , m_ids(historyManager->orderedIds())
+{
+    // Пачка изменений (загрузка, воспроизведение журнала) даёт один сброс модели
+    m_resetTimer.setSingleShot(true);
+    m_resetTimer.setInterval(0);
+    connect(&m_resetTimer, &QTimer::timeout, this, &HistoryModel::reset);
+    connect(historyManager, &HistoryManager::changed, this, &HistoryModel::scheduleReset);
+}
+
+int HistoryModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(m_ids.size());
+}
+
+QVariant HistoryModel::data(const QModelIndex &index, int role) const
+{
+    // До отложенного сброса строка может указывать на уже удалённый элемент
+    const HistoryManager::HistoryItem *item = itemAt(index.row());
+    if (!item) {
+        return QVariant();
+    }
+
+    switch (role) {
+    case Qt::DisplayRole:
+        return label(*item);
+    case Qt::DecorationRole:
+        return item->isFavorite ? favoriteIcon(item->colorIndex) : QVariant();
+    case IdRole:
+        return item->id;
+    case FavoriteRole:
+        return item->isFavorite;
+    case MaskedRole:
+        return item->isMasked;
+    default:
+        return QVariant();
+    }
+}
+
+void HistoryModel::setFilter(const QString &pattern)
+{
+    if (pattern == m_filter) {
+        return;
+    }
+    m_filter = pattern;
+    reset();
+}
+
+QString HistoryModel::filter() const
+{
+    return m_filter;
+}
+
+quint64 HistoryModel::idAt(int row) const
+{
+    const HistoryManager::HistoryItem *item = itemAt(row);
+    return item ? item->id : 0;
+}
+
+void HistoryModel::setFavoriteColors(const QColor *colors, int count)
+{
+    // Иконки рисуются один раз на цвет, а не на каждую строку
+    m_favoriteIcons.clear();
+    for (int i = 0; i < count; ++i) {
+        QPixmap pixmap(12, 12);
+        pixmap.fill(Qt::transparent);
+        QPainter painter(&pixmap);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.setBrush(colors[i]);
+        painter.setPen(Qt::NoPen);
+        painter.drawEllipse(2, 2, 8, 8);
+        painter.end();
+        m_favoriteIcons.push_back(QIcon(pixmap));
+    }
+}
+
+QIcon HistoryModel::favoriteIcon(int colorIndex) const
+{
+    if (m_favoriteIcons.isEmpty()) {
+        return QIcon();
+    }
+    // Без закреплённого цвета — последний (белый)
+    if (colorIndex < 0 || colorIndex >= m_favoriteIcons.size()) {
+        colorIndex = int(m_favoriteIcons.size()) - 1;
+    }
+    return m_favoriteIcons.at(colorIndex);
+}
+
+QString HistoryModel::label(const HistoryManager::HistoryItem &item)
+{
+    // Определяем нужно ли маскировать текст (для меню хватает превью)
+    QString s = item.isMasked ? maskText(item.preview) : item.preview;
+    s.replace('\n', ' ');
+    s.replace('\r', ' ');
+    s = s.simplified();
+
+    const int maxLen = 60;
+    if (s.length() > maxLen) {
+        s = s.left(maxLen - 3) + "...";
+    }
+    return s;
+}
+
+QString HistoryModel::maskText(const QString &text)
+{
+    if (text.length() <= 6) {
+        return QString(text.length(), '*');
+    }
+
+    // Показываем первые 3 и последние 3 символа, остальное звездочками
+    return text.left(3) + QString(text.length() - 6, '*') + text.right(3);
+}
+
+const HistoryManager::HistoryItem *HistoryModel::itemAt(int row) const
+{
+    return (row >= 0 && row < m_ids.size()) ? m_historyManager->item(m_ids.at(row)) : nullptr;
+}
+
+void HistoryModel::scheduleReset()
+{
+    if (!m_resetTimer.isActive()) {
+        m_resetTimer.start();
+    }
+}
+
+void HistoryModel::reset()
+{
+    m_resetTimer.stop();
+    beginResetModel();
+    m_ids = m_filter.isEmpty() ? m_historyManager->orderedIds()
+                               : m_historyManager->fuzzySearch(m_filter, MaxFilterRows);
+    endResetModel();
+}
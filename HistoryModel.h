@@ -0,0 +1,57 @@
+#pragma once
+
+#include "HistoryManager.h"
+#include <QAbstractListModel>
+#include <QColor>
+#include <QIcon>
+#include <QTimer>
+#include <QVector>
+
+// List model over HistoryManager in menu order, or over the results of a
+// fuzzy filter. Only the ids of the rows are taken at a reset; items are
+// read from the manager on demand, so a view only touches the rows it paints.
+// Mutations of the manager are coalesced into one model reset per event loop
+// pass.
+class HistoryModel final : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {
+        IdRole = Qt::UserRole + 1,
+        FavoriteRole,
+        MaskedRole,
+    };
+
+    // Filter results past this many rows are not shown
+    static constexpr int MaxFilterRows = 500;
+
+    explicit HistoryModel(const HistoryManager *historyManager, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+    // An empty pattern shows the whole history
+    void setFilter(const QString &pattern);
+    QString filter() const;
+    quint64 idAt(int row) const;
+
+    // Dots drawn for favorites, indexed by HistoryItem::colorIndex
+    void setFavoriteColors(const QColor *colors, int count);
+    QIcon favoriteIcon(int colorIndex) const;
+
+    // Single-line label as shown in the menu and the picker
+    static QString label(const HistoryManager::HistoryItem &item);
+    static QString maskText(const QString &text);
+
+private:
+    const HistoryManager::HistoryItem *itemAt(int row) const;
+    void scheduleReset();
+    void reset();
+
+    const HistoryManager *m_historyManager = nullptr;
+    QString m_filter;
+    QVector<quint64> m_ids; // rows as of the last reset: menu order or filter results
+    QVector<QIcon> m_favoriteIcons;
+    QTimer m_resetTimer;
+};
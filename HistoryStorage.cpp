@@ -0,0 +1,394 @@
+#include "HistoryStorage.h"
+#include "CryptoManager.h"
+#include "Trace.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char kMagic[4] = {'S', 'C', 'H', 'B'};
+const quint16 kVersion = 5;
+const quint16 kMinVersion = 3; // v3 — те же записи без частей, v4 — без пролога и хвоста чанков
+const quint16 kBoundChunksVersion = 5;
+const int kHeaderSize = 32;
+// v5: номер чанка и флаги перед числом записей
+const int kChunkPrologueSize = 8;
+// v5: число записей, число чанков и номер журнала в конце последнего чанка
+const int kTrailerSize = 16;
+const int kEntrySize = 64;
+const int kDigestSize = 32;
+
+enum EntryFlag : quint8 {
+    FlagFavorite = 0x01,
+    FlagMasked = 0x02,
+};
+
+enum ChunkFlag : quint32 {
+    FlagLastChunk = 0x01,
+};
+
+// Смещения полей в записи чанка (little endian); превью — относительно конца записей
+enum EntryField {
+    FieldDigest = 0,
+    FieldAddedAt = 32,
+    FieldLength = 40,
+    FieldUsage = 48,
+    FieldFlags = 52,
+    FieldColor = 53,
+    FieldPartCount = 54,
+    FieldPreviewOffset = 56,
+    FieldPreviewLength = 60,
+};
+
+// Часть после превью: дайджест, размер, длина типа и сам тип в Latin-1
+const int kPartHeaderSize = kDigestSize + 8 + 1;
+
+QByteArray encodeParts(const QVector<HistoryManager::Part> &parts)
+{
+    QByteArray encoded;
+    for (const HistoryManager::Part &part : parts) {
+        const QByteArray type = part.mimeType.toLatin1().left(255);
+        uchar header[kPartHeaderSize];
+        std::memcpy(header, part.digest.constData(), kDigestSize);
+        qToLittleEndian<qint64>(part.size, header + kDigestSize);
+        header[kDigestSize + 8] = uchar(type.size());
+        encoded.append(reinterpret_cast<const char *>(header), kPartHeaderSize);
+        encoded.append(type);
+    }
+    return encoded;
+}
+
+// Собирает записи и превью одного чанка, пока он не заполнится
+class ChunkWriter
+{
+public:
+    ChunkWriter(QSaveFile &out, const CryptoManager *crypto)
+        : m_out(out)
+        , m_crypto(crypto)
+    {
+        // Пролог и число записей заполняются при сбросе чанка
+        m_entries.reserve(kChunkPrologueSize + 4 + HistoryStorage::ChunkSize + kTrailerSize);
+        m_entries.resize(kChunkPrologueSize + 4);
+        m_previews.reserve(HistoryStorage::ChunkSize);
+    }
+
+    bool add(const HistoryManager::HistoryItem &item)
+    {
+        const QByteArray preview = item.preview.toUtf8();
+        const QByteArray parts = encodeParts(item.parts);
+        if (m_count > 0
+            && m_entries.size() - kChunkPrologueSize + m_previews.size() + kEntrySize + preview.size() + parts.size()
+                > HistoryStorage::ChunkSize) {
+            if (!flush(false, 0)) {
+                return false;
+            }
+        }
+
+        uchar e[kEntrySize] = {};
+        std::memcpy(e + FieldDigest, item.digest.constData(), kDigestSize);
+        qToLittleEndian<qint64>(item.addedAtMs, e + FieldAddedAt);
+        qToLittleEndian<qint64>(item.length, e + FieldLength);
+        qToLittleEndian<qint32>(item.usageCount, e + FieldUsage);
+        e[FieldFlags] = (item.isFavorite ? FlagFavorite : 0) | (item.isMasked ? FlagMasked : 0);
+        e[FieldColor] = uchar(qint8(item.colorIndex));
+        qToLittleEndian<quint16>(quint16(item.parts.size()), e + FieldPartCount);
+        qToLittleEndian<quint32>(quint32(m_previews.size()), e + FieldPreviewOffset);
+        qToLittleEndian<quint32>(quint32(preview.size()), e + FieldPreviewLength);
+        m_entries.append(reinterpret_cast<const char *>(e), kEntrySize);
+        m_previews.append(preview);
+        m_previews.append(parts);
+        ++m_count;
+        return true;
+    }
+
+    // Последний чанк пишется всегда, даже пустой: он несёт хвост с заголовком
+    bool flush(bool last, quint64 journalSequence)
+    {
+        if (m_count == 0 && !last) {
+            return true;
+        }
+
+        // Открытый текст чанка существует только в этом буфере
+        uchar *head = reinterpret_cast<uchar *>(m_entries.data());
+        qToLittleEndian<quint32>(m_chunks, head);
+        qToLittleEndian<quint32>(last ? FlagLastChunk : 0, head + 4);
+        qToLittleEndian<quint32>(m_count, head + kChunkPrologueSize);
+        m_entries.append(m_previews);
+        if (last) {
+            uchar trailer[kTrailerSize];
+            qToLittleEndian<quint32>(m_total + m_count, trailer);
+            qToLittleEndian<quint32>(m_chunks + 1, trailer + 4);
+            qToLittleEndian<quint64>(journalSequence, trailer + 8);
+            m_entries.append(reinterpret_cast<const char *>(trailer), kTrailerSize);
+        }
+        const QByteArray encrypted = m_crypto->encrypt(m_entries);
+
+        uchar length[4];
+        qToLittleEndian<quint32>(quint32(encrypted.size()), length);
+        const bool ok = m_out.write(reinterpret_cast<const char *>(length), sizeof(length)) == qint64(sizeof(length))
+            && m_out.write(encrypted) == encrypted.size();
+
+        // Затираем открытый текст, ёмкость буферов сохраняется для следующего чанка
+        m_entries.fill('\0');
+        m_previews.fill('\0');
+        m_entries.resize(kChunkPrologueSize + 4);
+        m_previews.resize(0);
+        m_total += m_count;
+        m_count = 0;
+        ++m_chunks;
+        return ok;
+    }
+
+    quint32 total() const { return m_total; }
+    quint32 chunks() const { return m_chunks; }
+
+private:
+    QSaveFile &m_out;
+    const CryptoManager *m_crypto;
+    QByteArray m_entries;
+    QByteArray m_previews;
+    quint32 m_count = 0;
+    quint32 m_total = 0;
+    quint32 m_chunks = 0;
+};
+
+} // namespace
+
+HistoryStorage::HistoryStorage(const QString &filePath, const CryptoManager *crypto)
+    : m_filePath(filePath)
+    , m_crypto(crypto)
+{
+}
+
+HistoryStorage::~HistoryStorage()
+{
+    close();
+}
+
+bool HistoryStorage::open()
+{
+    SMARTCLIP_TRACE("storage.open");
+    close();
+
+    m_file.setFileName(m_filePath);
+    if (!m_crypto || !m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    m_mapSize = m_file.size();
+    if (m_mapSize < kHeaderSize) {
+        close();
+        return false;
+    }
+    m_map = m_file.map(0, m_mapSize);
+    if (!m_map || std::memcmp(m_map, kMagic, sizeof(kMagic)) != 0) {
+        close();
+        return false;
+    }
+    m_version = qFromLittleEndian<quint16>(m_map + 4);
+    m_count = qFromLittleEndian<quint32>(m_map + 8);
+    m_chunks = qFromLittleEndian<quint32>(m_map + 12);
+    m_journalSequence = qFromLittleEndian<quint64>(m_map + 16);
+    if (m_version < kMinVersion || m_version > kVersion || (m_version >= kBoundChunksVersion && m_chunks == 0)) {
+        close();
+        return false;
+    }
+    // Заголовку не верим: резервируем не больше, чем поместится в файле
+    m_items.reserve(qMin<qint64>(m_count, m_mapSize / kEntrySize));
+
+    // Расшифровываем по одному чанку, прямо из отображённого файла
+    qint64 pos = kHeaderSize;
+    for (quint32 i = 0; i < m_chunks; ++i) {
+        if (pos + 4 > m_mapSize) {
+            close();
+            return false;
+        }
+        const quint32 length = qFromLittleEndian<quint32>(m_map + pos);
+        pos += 4;
+        if (pos + length > m_mapSize) {
+            close();
+            return false;
+        }
+        const QByteArray chunk = m_crypto->decrypt(
+            QByteArray::fromRawData(reinterpret_cast<const char *>(m_map + pos), length));
+        pos += length;
+        if (!readChunk(chunk, i)) {
+            close();
+            return false;
+        }
+    }
+
+    // Лишние байты после чанков и расхождение с числом записей в заголовке —
+    // признак порчи; пустые превью пропускаются, но в счёт входят
+    if (pos != m_mapSize || m_decoded != m_count) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool HistoryStorage::readChunk(const QByteArray &chunk, quint32 index)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(chunk.constData());
+    qsizetype start = 0;
+    qsizetype end = chunk.size();
+    if (m_version >= kBoundChunksVersion) {
+        if (end < kChunkPrologueSize) {
+            return false;
+        }
+        // Чанк стоит на своём месте, а последний подтверждает заголовок
+        const bool last = index + 1 == m_chunks;
+        const quint32 flags = qFromLittleEndian<quint32>(data + 4);
+        if (qFromLittleEndian<quint32>(data) != index || bool(flags & FlagLastChunk) != last) {
+            return false;
+        }
+        start = kChunkPrologueSize;
+        if (last) {
+            end -= kTrailerSize;
+            if (end < start || qFromLittleEndian<quint32>(data + end) != m_count
+                || qFromLittleEndian<quint32>(data + end + 4) != m_chunks
+                || qFromLittleEndian<quint64>(data + end + 8) != m_journalSequence) {
+                return false;
+            }
+        }
+    }
+    if (end - start < 4) {
+        return false;
+    }
+
+    const quint32 count = qFromLittleEndian<quint32>(data + start);
+    data += start;
+    end -= start;
+    const qsizetype previewsStart = 4 + qsizetype(count) * kEntrySize;
+    if (previewsStart > end) {
+        return false;
+    }
+
+    for (quint32 i = 0; i < count; ++i) {
+        const uchar *e = data + 4 + qsizetype(i) * kEntrySize;
+        const quint32 previewOffset = qFromLittleEndian<quint32>(e + FieldPreviewOffset);
+        const quint32 previewLength = qFromLittleEndian<quint32>(e + FieldPreviewLength);
+        if (previewsStart + qsizetype(previewOffset) + qsizetype(previewLength) > end) {
+            return false;
+        }
+
+        HistoryManager::HistoryItem item;
+        item.digest = QByteArray(reinterpret_cast<const char *>(e + FieldDigest), kDigestSize);
+        item.addedAtMs = qFromLittleEndian<qint64>(e + FieldAddedAt);
+        item.length = qFromLittleEndian<qint64>(e + FieldLength);
+        item.usageCount = qFromLittleEndian<qint32>(e + FieldUsage);
+        item.isFavorite = e[FieldFlags] & FlagFavorite;
+        item.isMasked = e[FieldFlags] & FlagMasked;
+        item.colorIndex = qint8(e[FieldColor]);
+        item.preview = QString::fromUtf8(reinterpret_cast<const char *>(data + previewsStart + previewOffset),
+                                         qsizetype(previewLength));
+
+        // Части богатого клипа идут сразу за его превью
+        qsizetype pos = previewsStart + qsizetype(previewOffset) + qsizetype(previewLength);
+        const quint16 partCount = qFromLittleEndian<quint16>(e + FieldPartCount);
+        for (quint16 p = 0; p < partCount; ++p) {
+            if (pos + kPartHeaderSize > end) {
+                return false;
+            }
+            const int typeLength = data[pos + kDigestSize + 8];
+            if (pos + kPartHeaderSize + typeLength > end) {
+                return false;
+            }
+            HistoryManager::Part part;
+            part.digest = QByteArray(reinterpret_cast<const char *>(data + pos), kDigestSize);
+            part.size = qFromLittleEndian<qint64>(data + pos + kDigestSize);
+            part.mimeType = QString::fromLatin1(reinterpret_cast<const char *>(data + pos + kPartHeaderSize),
+                                                typeLength);
+            item.parts.push_back(part);
+            pos += kPartHeaderSize + typeLength;
+        }
+        ++m_decoded;
+        if (!item.preview.isEmpty()) {
+            m_items.push_back(item);
+        }
+    }
+    return true;
+}
+
+void HistoryStorage::close()
+{
+    if (m_map) {
+        m_file.unmap(const_cast<uchar *>(m_map));
+        m_map = nullptr;
+    }
+    m_mapSize = 0;
+    m_journalSequence = 0;
+    m_version = 0;
+    m_count = 0;
+    m_chunks = 0;
+    m_decoded = 0;
+    m_file.close();
+    m_items.clear();
+}
+
+QString HistoryStorage::filePath() const
+{
+    return m_filePath;
+}
+
+const QVector<HistoryManager::HistoryItem> &HistoryStorage::items() const
+{
+    return m_items;
+}
+
+quint64 HistoryStorage::journalSequence() const
+{
+    return m_journalSequence;
+}
+
+bool HistoryStorage::write(const QString &filePath, const QVector<HistoryManager::HistoryItem> &items,
+                           const CryptoManager *crypto, quint64 journalSequence,
+                           const std::atomic<bool> *cancelled)
+{
+    SMARTCLIP_TRACE("storage.write", items.size());
+    const QFileInfo fi(filePath);
+    if (!fi.dir().exists()) {
+        QDir().mkpath(fi.dir().absolutePath());
+    }
+
+    QSaveFile out(filePath);
+    if (!crypto || !out.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    // Заголовок пишем в конце, когда известно число записей и чанков
+    out.write(QByteArray(kHeaderSize, '\0'));
+
+    ChunkWriter writer(out, crypto);
+    for (const HistoryManager::HistoryItem &item : items) {
+        // open() всё равно отбросил бы запись без превью
+        if (item.digest.size() != kDigestSize || item.preview.isEmpty()) {
+            continue;
+        }
+        if ((cancelled && cancelled->load(std::memory_order_relaxed)) || !writer.add(item)) {
+            out.cancelWriting();
+            return false;
+        }
+    }
+    if (!writer.flush(true, journalSequence)) {
+        out.cancelWriting();
+        return false;
+    }
+
+    uchar header[kHeaderSize] = {};
+    std::memcpy(header, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint16>(kVersion, header + 4);
+    qToLittleEndian<quint32>(writer.total(), header + 8);
+    qToLittleEndian<quint32>(writer.chunks(), header + 12);
+    qToLittleEndian<quint64>(journalSequence, header + 16);
+    if (!out.seek(0) || out.write(reinterpret_cast<const char *>(header), kHeaderSize) != kHeaderSize) {
+        out.cancelWriting();
+        return false;
+    }
+
+    out.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+    return out.commit();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "HistoryManager.h"
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+class CryptoManager;
+
+// Binary history snapshot (history.bin), opened through QFile::map.
+//
+//   header   "SCHB", version, record count, chunk count, journal sequence
+//   chunks   sequence of length-prefixed encrypted chunks; each holds up to
+//            ChunkSize bytes of fixed-size records (counters, flags, color,
+//            body digest) followed by the previews they point to; the parts
+//            of a rich clip (digest, size, MIME type) follow its preview
+//
+// The header itself is not encrypted. Since version 5 every chunk starts
+// with its index and a last-chunk flag, and the last one ends with a copy of
+// the header counts and journal sequence, so a reordered, dropped or
+// appended chunk and an edited header fail to open. A snapshot always has at
+// least one chunk. Versions 3 and 4 are still read, with only the record
+// count and the file size checked.
+//
+// Chunks are serialized, encrypted and written one at a time, so saving never
+// holds more than one chunk of plaintext and nothing unencrypted touches the
+// disk. Bodies are not part of the snapshot: they live in the BlobStore and
+// are read only when an item is pasted.
+class HistoryStorage final
+{
+public:
+    static constexpr int ChunkSize = 64 * 1024;
+
+    HistoryStorage(const QString &filePath, const CryptoManager *crypto);
+    ~HistoryStorage();
+
+    bool open();
+    void close();
+    QString filePath() const;
+
+    // Items without ids; digest, preview, length and counters are set
+    const QVector<HistoryManager::HistoryItem> &items() const;
+    // Last journal record already contained in the snapshot
+    quint64 journalSequence() const;
+
+    // Writes items in the given order through QSaveFile, so the previous
+    // snapshot stays intact until the new one is complete. Safe to call from
+    // a worker thread; setting *cancelled aborts the write between records.
+    static bool write(const QString &filePath, const QVector<HistoryManager::HistoryItem> &items,
+                      const CryptoManager *crypto, quint64 journalSequence,
+                      const std::atomic<bool> *cancelled = nullptr);
+
+private:
+    bool readChunk(const QByteArray &chunk, quint32 index);
+
+    QString m_filePath;
+    const CryptoManager *m_crypto = nullptr;
+    QFile m_file;
+    const uchar *m_map = nullptr;
+    qint64 m_mapSize = 0;
+    quint64 m_journalSequence = 0;
+    // Header of the snapshot being opened
+    quint16 m_version = 0;
+    quint32 m_count = 0;
+    quint32 m_chunks = 0;
+    quint32 m_decoded = 0; // records read so far, blank ones included
+    QVector<HistoryManager::HistoryItem> m_items;
+};
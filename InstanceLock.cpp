@@ -0,0 +1,28 @@
+#include "InstanceLock.h"
+#include <QDir>
+#include <QFileInfo>
+
+InstanceLock::InstanceLock()
+    : m_lock(path())
+{
+    // Чужой замок считается брошенным, только если его владельца больше нет
+    m_lock.setStaleLockTime(0);
+}
+
+InstanceLock::~InstanceLock() = default;
+
+bool InstanceLock::tryLock()
+{
+    QDir().mkpath(QFileInfo(path()).absolutePath());
+    return m_lock.tryLock(0);
+}
+
+bool InstanceLock::isLocked() const
+{
+    return m_lock.isLocked();
+}
+
+QString InstanceLock::path()
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/instance.lock");
+}
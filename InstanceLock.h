@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QLockFile>
+#include <QString>
+
+// Lock file in ~/.smartclip held by the running SmartClip and by
+// smartclip-cli while it rewrites the history, so that only one process
+// owns the data directory and the control socket. QLockFile records the
+// owner's pid: a lock left by a crashed process is taken over, one held by
+// a living process never is, however old it is.
+class InstanceLock final
+{
+public:
+    InstanceLock();
+    ~InstanceLock();
+
+    InstanceLock(const InstanceLock &) = delete;
+    InstanceLock &operator=(const InstanceLock &) = delete;
+
+    // Does not wait; false while another process holds the lock
+    bool tryLock();
+    bool isLocked() const;
+
+    static QString path();
+
+private:
+    QLockFile m_lock;
+};
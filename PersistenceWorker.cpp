@@ -0,0 +1,112 @@
+#include "PersistenceWorker.h"
+#include "HistoryStorage.h"
+#include <QMutexLocker>
+
+namespace {
+
+// Сколько раз подряд можно прервать запись ради более свежего снимка
+const int kMaxSupersededInRow = 2;
+
+} // namespace
+
+PersistenceWorker::PersistenceWorker(const QString &historyPath, const CryptoManager *crypto, QObject *parent)
+    : QObject(parent)
+    , m_historyPath(historyPath)
+    , m_crypto(crypto)
+{
+    m_thread.reset(QThread::create([this]() {
+        run();
+    }));
+    m_thread->setObjectName(QStringLiteral("SmartClip persistence"));
+    m_thread->start(QThread::LowPriority);
+}
+
+PersistenceWorker::~PersistenceWorker()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wake.wakeAll();
+    }
+    // Начатая запись доводится до конца
+    m_thread->wait();
+}
+
+void PersistenceWorker::save(const QVector<HistoryManager::HistoryItem> &items, quint64 journalSequence,
+                             quint64 blobEpoch)
+{
+    auto job = std::make_unique<Job>();
+    job->items = items;
+    job->journalSequence = journalSequence;
+    job->blobEpoch = blobEpoch;
+
+    QMutexLocker locker(&m_mutex);
+    if (m_writing && m_supersededInRow < kMaxSupersededInRow) {
+        m_cancelWrite.store(true, std::memory_order_relaxed);
+    }
+    m_pending = std::move(job); // Более старый ожидающий снимок просто выбрасываем
+    m_wake.wakeOne();
+}
+
+void PersistenceWorker::waitForIdle()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_pending || m_writing) {
+        m_idle.wait(&m_mutex);
+    }
+}
+
+void PersistenceWorker::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.reset();
+    if (m_writing) {
+        m_cancelWrite.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool PersistenceWorker::isBusy() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pending || m_writing;
+}
+
+void PersistenceWorker::run()
+{
+    for (;;) {
+        std::unique_ptr<Job> job;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (!m_pending && !m_stopping) {
+                m_wake.wait(&m_mutex);
+            }
+            if (!m_pending) {
+                return; // m_stopping и очередь пуста
+            }
+            job = std::move(m_pending);
+            m_writing = true;
+            m_cancelWrite.store(false, std::memory_order_relaxed);
+        }
+
+        const bool ok = HistoryStorage::write(m_historyPath, job->items, m_crypto, job->journalSequence,
+                                              &m_cancelWrite);
+        const bool superseded = !ok && m_cancelWrite.load(std::memory_order_relaxed);
+        const quint64 journalSequence = job->journalSequence;
+        const quint64 blobEpoch = job->blobEpoch;
+        job.reset();
+
+        {
+            QMutexLocker locker(&m_mutex);
+            m_writing = false;
+            m_supersededInRow = superseded ? m_supersededInRow + 1 : 0;
+            if (!m_pending) {
+                m_idle.wakeAll();
+            }
+        }
+
+        // Прерванный снимок не ошибка: следом уже идёт более новый
+        if (!superseded) {
+            emit saved(journalSequence, blobEpoch, ok);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "HistoryManager.h"
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <memory>
+
+class CryptoManager;
+
+// Writes history snapshots on a dedicated thread so the GUI keeps handling
+// clipboard events while a large history is serialized and encrypted.
+//
+// The queue holds a single pending snapshot: a newer one replaces it, and a
+// snapshot that is already being written is cancelled in favour of the newer
+// one (at most twice in a row, so a steady stream of saves still completes).
+class PersistenceWorker final : public QObject
+{
+    Q_OBJECT
+
+public:
+    PersistenceWorker(const QString &historyPath, const CryptoManager *crypto, QObject *parent = nullptr);
+    ~PersistenceWorker() override;
+
+    // Queuing shares items rather than copying them, but building them with
+    // HistoryManager::snapshot() costs O(n) on the caller's thread; single
+    // changes go to the journal, so that is paid once per compaction.
+    // blobEpoch is only handed back through saved().
+    void save(const QVector<HistoryManager::HistoryItem> &items, quint64 journalSequence, quint64 blobEpoch);
+    // Blocks until nothing is pending or being written
+    void waitForIdle();
+    // Drops the pending snapshot and aborts the one being written
+    void cancel();
+    bool isBusy() const;
+
+signals:
+    // Emitted from the worker thread; connections to GUI objects are queued
+    void saved(quint64 journalSequence, quint64 blobEpoch, bool ok);
+
+private:
+    struct Job {
+        QVector<HistoryManager::HistoryItem> items;
+        quint64 journalSequence = 0;
+        quint64 blobEpoch = 0;
+    };
+
+    void run();
+
+    const QString m_historyPath;
+    const CryptoManager *m_crypto = nullptr;
+    std::unique_ptr<QThread> m_thread;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_wake;
+    QWaitCondition m_idle;
+    std::unique_ptr<Job> m_pending;
+    bool m_writing = false;
+    bool m_stopping = false;
+    int m_supersededInRow = 0;
+    std::atomic<bool> m_cancelWrite{false};
+};
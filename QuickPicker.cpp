@@ -0,0 +1,129 @@
+#include "QuickPicker.h"
+#include "HistoryModel.h"
+#include <QApplication>
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QScreen>
+#include <QVBoxLayout>
+
+QuickPicker::QuickPicker(HistoryModel *model, QWidget *parent)
+    : QWidget(parent, Qt::Tool | Qt::FramelessWindowHint | Qt::WindowStaysOnTopHint)
+    , m_model(model)
+{
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->setContentsMargins(6, 6, 6, 6);
+    layout->setSpacing(4);
+
+    m_searchField = new QLineEdit(this);
+    m_searchField->setPlaceholderText("Search clips");
+    m_searchField->setClearButtonEnabled(true);
+    m_searchField->installEventFilter(this);
+    layout->addWidget(m_searchField);
+
+    // Одинаковая высота строк: вид не измеряет каждую строку, рисуются только видимые
+    m_list = new QListView(this);
+    m_list->setModel(m_model);
+    m_list->setUniformItemSizes(true);
+    m_list->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_list->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_list->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    m_list->setFocusPolicy(Qt::NoFocus); // Клавиатура остаётся в поле поиска
+    layout->addWidget(m_list);
+
+    connect(m_searchField, &QLineEdit::textChanged, m_model, &HistoryModel::setFilter);
+    connect(m_model, &QAbstractItemModel::modelReset, this, [this]() {
+        selectRow(0);
+    });
+    connect(m_list, &QListView::clicked, this, [this](const QModelIndex &index) {
+        activateRow(index.row(), QApplication::keyboardModifiers());
+    });
+
+    resize(520, 380);
+}
+
+void QuickPicker::popup(const QPoint &pos)
+{
+    m_searchField->clear();
+    selectRow(0);
+
+    QScreen *screen = QGuiApplication::screenAt(pos);
+    if (!screen) {
+        screen = QGuiApplication::primaryScreen();
+    }
+    if (screen) {
+        QRect frame = geometry();
+        frame.moveCenter(screen->availableGeometry().center());
+        move(frame.topLeft());
+    }
+
+    show();
+    raise();
+    activateWindow();
+    m_searchField->setFocus();
+}
+
+bool QuickPicker::event(QEvent *event)
+{
+    if (event->type() == QEvent::WindowDeactivate) {
+        hide();
+    }
+    return QWidget::event(event);
+}
+
+bool QuickPicker::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched != m_searchField || event->type() != QEvent::KeyPress) {
+        return QWidget::eventFilter(watched, event);
+    }
+
+    QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+    switch (keyEvent->key()) {
+    case Qt::Key_Up:
+    case Qt::Key_Down:
+    case Qt::Key_PageUp:
+    case Qt::Key_PageDown:
+        QApplication::sendEvent(m_list, keyEvent);
+        return true;
+    case Qt::Key_Home:
+    case Qt::Key_End:
+        // В непустом поле Home/End двигают курсор
+        if (!m_searchField->text().isEmpty()) {
+            return false;
+        }
+        QApplication::sendEvent(m_list, keyEvent);
+        return true;
+    case Qt::Key_Return:
+    case Qt::Key_Enter:
+        activateRow(m_list->currentIndex().row(), keyEvent->modifiers());
+        return true;
+    case Qt::Key_Escape:
+        hide();
+        return true;
+    default:
+        return false;
+    }
+}
+
+void QuickPicker::activateRow(int row, Qt::KeyboardModifiers modifiers)
+{
+    const quint64 id = m_model->idAt(row);
+    if (id == 0) {
+        return;
+    }
+    // Избранное и маску переключаем, не закрывая окно: результат виден сразу
+    if (!(modifiers & Qt::ControlModifier)) {
+        hide();
+    }
+    emit activated(id, modifiers);
+}
+
+void QuickPicker::selectRow(int row)
+{
+    if (row < 0 || row >= m_model->rowCount()) {
+        m_list->setCurrentIndex(QModelIndex());
+        return;
+    }
+    const QModelIndex index = m_model->index(row);
+    m_list->setCurrentIndex(index);
+    m_list->scrollTo(index);
+}
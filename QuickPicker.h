@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QLineEdit>
+#include <QListView>
+#include <QWidget>
+
+class HistoryModel;
+
+// Frameless popup for picking a clip: a search field over a QListView with
+// uniform row heights, so only the visible rows are laid out and painted
+// whatever the history size. Typing filters with the fuzzy matcher; arrows
+// and Page Up/Down move the selection without leaving the field, as do
+// Home/End while the field is empty. The picker hides when it loses focus.
+// Enter picks the clip, Ctrl+Enter toggles favorite, Ctrl+Shift+Enter
+// toggles the mask, as the same modifiers do in the tray menu.
+class QuickPicker final : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit QuickPicker(HistoryModel *model, QWidget *parent = nullptr);
+
+    // Shows the picker with an empty filter, centered on the screen under pos
+    void popup(const QPoint &pos);
+
+signals:
+    void activated(quint64 id, Qt::KeyboardModifiers modifiers);
+
+protected:
+    bool event(QEvent *event) override;
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+private:
+    void activateRow(int row, Qt::KeyboardModifiers modifiers);
+    void selectRow(int row);
+
+    HistoryModel *m_model = nullptr;
+    QLineEdit *m_searchField = nullptr;
+    QListView *m_list = nullptr;
+};
@@ -0,0 +1,68 @@
+#include "SaveScheduler.h"
+
+namespace {
+
+const int kDefaultQuietMs = 2000;
+const int kDefaultMaxDelayMs = 30000;
+
+} // namespace
+
+SaveScheduler::SaveScheduler(HistoryManager *historyManager, QObject *parent)
+    : QObject(parent)
+    , m_historyManager(historyManager)
+{
+    m_quietTimer.setSingleShot(true);
+    m_quietTimer.setInterval(kDefaultQuietMs);
+    m_maxDelayTimer.setSingleShot(true);
+    m_maxDelayTimer.setInterval(kDefaultMaxDelayMs);
+
+    connect(&m_quietTimer, &QTimer::timeout, this, &SaveScheduler::flush);
+    connect(&m_maxDelayTimer, &QTimer::timeout, this, &SaveScheduler::flush);
+    connect(m_historyManager, &HistoryManager::changed, this, &SaveScheduler::onChanged);
+}
+
+void SaveScheduler::setDelays(int quietMs, int maxDelayMs)
+{
+    m_quietTimer.setInterval(quietMs);
+    m_maxDelayTimer.setInterval(qMax(quietMs, maxDelayMs));
+}
+
+void SaveScheduler::setTriggerFields(HistoryManager::DirtyFields fields)
+{
+    m_triggerFields = fields;
+}
+
+bool SaveScheduler::isPending() const
+{
+    return m_maxDelayTimer.isActive();
+}
+
+void SaveScheduler::onChanged(HistoryManager::DirtyFields fields)
+{
+    if (!(fields & m_triggerFields)) {
+        return;
+    }
+
+    // Тихий период отсчитывается заново, максимальная задержка — от первого изменения
+    m_quietTimer.start();
+    if (!m_maxDelayTimer.isActive()) {
+        m_maxDelayTimer.start();
+    }
+}
+
+void SaveScheduler::flush()
+{
+    m_quietTimer.stop();
+    m_maxDelayTimer.stop();
+
+    const HistoryManager::DirtyFields fields = m_historyManager->dirtyFields();
+    if (fields.toInt() != 0) {
+        emit saveRequested(fields);
+    }
+}
+
+void SaveScheduler::cancel()
+{
+    m_quietTimer.stop();
+    m_maxDelayTimer.stop();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "HistoryManager.h"
+#include <QObject>
+#include <QTimer>
+
+// Coalesces history mutations into snapshot saves. Every change restarts a
+// quiet-period timer; a burst (a script copying hundreds of items) ends in
+// one save once it calms down, and never later than the maximum delay after
+// its first change. Only DirtyFlags changes schedule a save by default:
+// additions, removals and counter bumps are already durable in the journal
+// and reach the snapshot when the journal is compacted, so saving them on a
+// timer would rewrite the whole snapshot after every copy.
+class SaveScheduler final : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SaveScheduler(HistoryManager *historyManager, QObject *parent = nullptr);
+
+    void setDelays(int quietMs, int maxDelayMs);
+    void setTriggerFields(HistoryManager::DirtyFields fields);
+    bool isPending() const;
+
+public slots:
+    // Emits saveRequested() now if anything is waiting
+    void flush();
+    void cancel();
+
+signals:
+    void saveRequested(HistoryManager::DirtyFields fields);
+
+private:
+    void onChanged(HistoryManager::DirtyFields fields);
+
+    HistoryManager *m_historyManager = nullptr;
+    QTimer m_quietTimer;
+    QTimer m_maxDelayTimer;
+    HistoryManager::DirtyFields m_triggerFields = HistoryManager::DirtyFlags;
+};
@@ -1,17 +1,31 @@
 #include "SettingsDialog.h"
 #include "SettingsManager.h"
+#include "HistoryManager.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QFormLayout>
 #include <QDialogButtonBox>
 #include <QLabel>
+#include <QLocale>
 
-SettingsDialog::SettingsDialog(SettingsManager *settingsManager, QWidget *parent)
+SettingsDialog::SettingsDialog(SettingsManager *settingsManager, const HistoryManager *historyManager,
+                               QWidget *parent)
     : QDialog(parent)
     , m_settingsManager(settingsManager)
+    , m_historyManager(historyManager)
 {
     setupUI();
     loadSettingsToUI();
+    updateCompressionStats();
+    updateUsage();
+
+    // Пока диалог открыт, история продолжает пополняться: цифры обновляются на лету
+    if (m_historyManager) {
+        connect(m_historyManager, &HistoryManager::changed, this, [this]() {
+            updateUsage();
+            updateCompressionStats();
+        });
+    }
     
     setWindowTitle("Settings");
     setModal(true);
@@ -28,6 +42,20 @@ void SettingsDialog::setupUI()
     m_maxItemsSpin->setMinimum(1);
     m_maxItemsSpin->setMaximum(1000);
     formLayout->addRow("History size", m_maxItemsSpin);
+
+    // Logical text size of the history, not its memory use (0 disables the limit)
+    m_maxTextSpin = new QSpinBox(this);
+    m_maxTextSpin->setMinimum(0);
+    m_maxTextSpin->setMaximum(65536);
+    m_maxTextSpin->setSuffix(" MB");
+    m_maxTextSpin->setSpecialValueText("Unlimited");
+    m_maxTextSpin->setToolTip("Counts the clips' text at 2 bytes per character. "
+                              "Memory and disk use are usually much lower: bodies are "
+                              "stored compressed and mostly stay on disk.");
+    formLayout->addRow("History text limit", m_maxTextSpin);
+
+    m_usageLabel = new QLabel(this);
+    formLayout->addRow("Text in history", m_usageLabel);
     
     // Launch at startup
     m_launchAtStartupCheck = new QCheckBox(this);
@@ -36,6 +64,35 @@ void SettingsDialog::setupUI()
     // Save history on exit
     m_saveHistoryOnExitCheck = new QCheckBox(this);
     formLayout->addRow("Save history on exit", m_saveHistoryOnExitCheck);
+
+    // Compression of large and old clips (0 disables the rule)
+    m_compressAboveSpin = new QSpinBox(this);
+    m_compressAboveSpin->setMinimum(0);
+    m_compressAboveSpin->setMaximum(100000);
+    m_compressAboveSpin->setSuffix(" KB");
+    m_compressAboveSpin->setSpecialValueText("Never");
+    formLayout->addRow("Compress clips above", m_compressAboveSpin);
+
+    m_compressAfterSpin = new QSpinBox(this);
+    m_compressAfterSpin->setMinimum(0);
+    m_compressAfterSpin->setMaximum(1000);
+    m_compressAfterSpin->setSpecialValueText("Never");
+    formLayout->addRow("Compress clips after position", m_compressAfterSpin);
+
+    // Крупные клипы хешируются, сжимаются и пишутся на диск в фоновом потоке
+    m_largeClipSpin = new QSpinBox(this);
+    m_largeClipSpin->setMinimum(0);
+    m_largeClipSpin->setMaximum(1000000);
+    m_largeClipSpin->setSuffix(" KB");
+    m_largeClipSpin->setSpecialValueText("Never");
+    formLayout->addRow("Process in background clips above", m_largeClipSpin);
+
+    m_compressionStatsLabel = new QLabel(this);
+    formLayout->addRow("Compression", m_compressionStatsLabel);
+
+    // Спаны горячих путей; выгрузка — пунктом меню Save Trace
+    m_traceCheck = new QCheckBox(this);
+    formLayout->addRow("Record performance trace", m_traceCheck);
     
     mainLayout->addLayout(formLayout);
     
@@ -58,8 +115,52 @@ void SettingsDialog::loadSettingsToUI()
     }
     
     m_maxItemsSpin->setValue(m_settingsManager->maxItems());
+    m_maxTextSpin->setValue(m_settingsManager->maxTextMb());
     m_launchAtStartupCheck->setChecked(m_settingsManager->launchAtStartup());
     m_saveHistoryOnExitCheck->setChecked(m_settingsManager->saveHistoryOnExit());
+    m_compressAboveSpin->setValue(m_settingsManager->compressAboveKb());
+    m_compressAfterSpin->setValue(m_settingsManager->compressAfterItems());
+    m_largeClipSpin->setValue(m_settingsManager->largeClipKb());
+    m_traceCheck->setChecked(m_settingsManager->traceEnabled());
+}
+
+void SettingsDialog::updateCompressionStats()
+{
+    if (!m_historyManager) {
+        m_compressionStatsLabel->setText("-");
+        return;
+    }
+
+    // Считаются только тела, загруженные в память; остальные лежат на диске
+    const BlobStore::Stats stats = m_historyManager->compressionStats();
+    const QLocale locale;
+    QString text = QString("%1 of %2 clips compressed, %3 in memory")
+        .arg(stats.compressedBodies)
+        .arg(stats.bodies)
+        .arg(locale.formattedDataSize(stats.residentBytes));
+    if (stats.residentBytes > 0 && stats.rawBytes > stats.residentBytes) {
+        text += QString(" (%1 uncompressed, %2x)")
+            .arg(locale.formattedDataSize(stats.rawBytes))
+            .arg(double(stats.rawBytes) / double(stats.residentBytes), 0, 'f', 1);
+    }
+    m_compressionStatsLabel->setText(text);
+}
+
+void SettingsDialog::updateUsage()
+{
+    if (!m_historyManager) {
+        m_usageLabel->setText("-");
+        return;
+    }
+
+    const QLocale locale;
+    QString text = QString("%1 clips, %2")
+        .arg(m_historyManager->size())
+        .arg(locale.formattedDataSize(m_historyManager->textBytes()));
+    if (m_historyManager->maxTextBytes() > 0) {
+        text += QString(" of %1").arg(locale.formattedDataSize(m_historyManager->maxTextBytes()));
+    }
+    m_usageLabel->setText(text);
 }
 
 void SettingsDialog::onAccepted()
@@ -70,8 +171,13 @@ void SettingsDialog::onAccepted()
     
     // Save settings
     m_settingsManager->setMaxItems(m_maxItemsSpin->value());
+    m_settingsManager->setMaxTextMb(m_maxTextSpin->value());
     m_settingsManager->setLaunchAtStartup(m_launchAtStartupCheck->isChecked());
     m_settingsManager->setSaveHistoryOnExit(m_saveHistoryOnExitCheck->isChecked());
+    m_settingsManager->setCompressAboveKb(m_compressAboveSpin->value());
+    m_settingsManager->setCompressAfterItems(m_compressAfterSpin->value());
+    m_settingsManager->setLargeClipKb(m_largeClipSpin->value());
+    m_settingsManager->setTraceEnabled(m_traceCheck->isChecked());
     
     accept();
 }
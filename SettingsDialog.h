@@ -3,15 +3,18 @@
 #include <QDialog>
 #include <QSpinBox>
 #include <QCheckBox>
+#include <QLabel>
 
 class SettingsManager;
+class HistoryManager;
 
 class SettingsDialog : public QDialog
 {
     Q_OBJECT
 
 public:
-    explicit SettingsDialog(SettingsManager *settingsManager, QWidget *parent = nullptr);
+    explicit SettingsDialog(SettingsManager *settingsManager, const HistoryManager *historyManager = nullptr,
+                            QWidget *parent = nullptr);
     ~SettingsDialog() = default;
 
 private slots:
@@ -21,10 +24,20 @@ private slots:
 private:
     void setupUI();
     void loadSettingsToUI();
+    void updateCompressionStats();
+    void updateUsage();
 
     SettingsManager *m_settingsManager;
+    const HistoryManager *m_historyManager;
     
     QSpinBox *m_maxItemsSpin;
+    QSpinBox *m_maxTextSpin;
+    QLabel *m_usageLabel;
     QCheckBox *m_launchAtStartupCheck;
     QCheckBox *m_saveHistoryOnExitCheck;
+    QSpinBox *m_compressAboveSpin;
+    QSpinBox *m_compressAfterSpin;
+    QSpinBox *m_largeClipSpin;
+    QLabel *m_compressionStatsLabel;
+    QCheckBox *m_traceCheck;
 };
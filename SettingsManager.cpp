@@ -15,6 +15,11 @@ int SettingsManager::maxItems() const
     return m_maxItems;
 }
 
+int SettingsManager::maxTextMb() const
+{
+    return m_maxTextMb;
+}
+
 bool SettingsManager::launchAtStartup() const
 {
     return m_launchAtStartup;
@@ -25,6 +30,26 @@ bool SettingsManager::saveHistoryOnExit() const
     return m_saveHistoryOnExit;
 }
 
+int SettingsManager::compressAboveKb() const
+{
+    return m_compressAboveKb;
+}
+
+int SettingsManager::compressAfterItems() const
+{
+    return m_compressAfterItems;
+}
+
+int SettingsManager::largeClipKb() const
+{
+    return m_largeClipKb;
+}
+
+bool SettingsManager::traceEnabled() const
+{
+    return m_traceEnabled;
+}
+
 void SettingsManager::setMaxItems(int maxItems)
 {
     if (m_maxItems != maxItems) {
@@ -32,6 +57,13 @@ void SettingsManager::setMaxItems(int maxItems)
     }
 }
 
+void SettingsManager::setMaxTextMb(int mb)
+{
+    if (m_maxTextMb != mb) {
+        m_maxTextMb = mb;
+    }
+}
+
 void SettingsManager::setLaunchAtStartup(bool enabled)
 {
     if (m_launchAtStartup != enabled) {
@@ -46,6 +78,34 @@ void SettingsManager::setSaveHistoryOnExit(bool enabled)
     }
 }
 
+void SettingsManager::setCompressAboveKb(int kb)
+{
+    if (m_compressAboveKb != kb) {
+        m_compressAboveKb = kb;
+    }
+}
+
+void SettingsManager::setCompressAfterItems(int items)
+{
+    if (m_compressAfterItems != items) {
+        m_compressAfterItems = items;
+    }
+}
+
+void SettingsManager::setLargeClipKb(int kb)
+{
+    if (m_largeClipKb != kb) {
+        m_largeClipKb = kb;
+    }
+}
+
+void SettingsManager::setTraceEnabled(bool enabled)
+{
+    if (m_traceEnabled != enabled) {
+        m_traceEnabled = enabled;
+    }
+}
+
 void SettingsManager::loadSettings(const QString &filePath)
 {
     const QFileInfo fi(filePath);
@@ -75,6 +135,17 @@ void SettingsManager::loadSettings(const QString &filePath)
             }
         }
 
+        {
+            const QRegularExpression re7(QLatin1String("^\\s*max_(?:text|history)_mb\\s*:\\s*(\\d+)\\s*$"));
+            const QRegularExpressionMatch m7 = re7.match(line);
+            if (m7.hasMatch()) {
+                bool ok = false;
+                const int v = m7.captured(1).toInt(&ok);
+                if (ok) {
+                    m_maxTextMb = v;
+                }
+            }
+        }
         {
             const QRegularExpression re2(QLatin1String("^\\s*launch_at_startup\\s*:\\s*(true|false)\\s*$"));
             const QRegularExpressionMatch m2 = re2.match(line);
@@ -89,6 +160,46 @@ void SettingsManager::loadSettings(const QString &filePath)
                 m_saveHistoryOnExit = (m3.captured(1) == QLatin1String("true"));
             }
         }
+        {
+            const QRegularExpression re4(QLatin1String("^\\s*compress_above_kb\\s*:\\s*(\\d+)\\s*$"));
+            const QRegularExpressionMatch m4 = re4.match(line);
+            if (m4.hasMatch()) {
+                bool ok = false;
+                const int v = m4.captured(1).toInt(&ok);
+                if (ok) {
+                    m_compressAboveKb = v;
+                }
+            }
+        }
+        {
+            const QRegularExpression re5(QLatin1String("^\\s*compress_after_items\\s*:\\s*(\\d+)\\s*$"));
+            const QRegularExpressionMatch m5 = re5.match(line);
+            if (m5.hasMatch()) {
+                bool ok = false;
+                const int v = m5.captured(1).toInt(&ok);
+                if (ok) {
+                    m_compressAfterItems = v;
+                }
+            }
+        }
+        {
+            const QRegularExpression re6(QLatin1String("^\\s*large_clip_kb\\s*:\\s*(\\d+)\\s*$"));
+            const QRegularExpressionMatch m6 = re6.match(line);
+            if (m6.hasMatch()) {
+                bool ok = false;
+                const int v = m6.captured(1).toInt(&ok);
+                if (ok) {
+                    m_largeClipKb = v;
+                }
+            }
+        }
+        {
+            const QRegularExpression re8(QLatin1String("^\\s*trace_enabled\\s*:\\s*(true|false)\\s*$"));
+            const QRegularExpressionMatch m8 = re8.match(line);
+            if (m8.hasMatch()) {
+                m_traceEnabled = (m8.captured(1) == QLatin1String("true"));
+            }
+        }
     }
 }
 
@@ -106,6 +217,11 @@ void SettingsManager::saveSettings(const QString &filePath) const
 
     QTextStream out(&f);
     out << "max_items: " << m_maxItems << "\n";
+    out << "max_text_mb: " << m_maxTextMb << "\n";
     out << "launch_at_startup: " << (m_launchAtStartup ? "true" : "false") << "\n";
     out << "save_history_on_exit: " << (m_saveHistoryOnExit ? "true" : "false") << "\n";
+    out << "compress_above_kb: " << m_compressAboveKb << "\n";
+    out << "compress_after_items: " << m_compressAfterItems << "\n";
+    out << "large_clip_kb: " << m_largeClipKb << "\n";
+    out << "trace_enabled: " << (m_traceEnabled ? "true" : "false") << "\n";
 }
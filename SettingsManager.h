@@ -12,18 +12,33 @@ public:
     ~SettingsManager() = default;
 
     int maxItems() const;
+    int maxTextMb() const;
     bool launchAtStartup() const;
     bool saveHistoryOnExit() const;
+    int compressAboveKb() const;
+    int compressAfterItems() const;
+    int largeClipKb() const;
+    bool traceEnabled() const;
 
     void setMaxItems(int maxItems);
+    void setMaxTextMb(int mb);
     void setLaunchAtStartup(bool enabled);
     void setSaveHistoryOnExit(bool enabled);
+    void setCompressAboveKb(int kb);
+    void setCompressAfterItems(int items);
+    void setLargeClipKb(int kb);
+    void setTraceEnabled(bool enabled);
 
     void loadSettings(const QString &filePath);
     void saveSettings(const QString &filePath) const;
 
 private:
     int m_maxItems = 20;
+    int m_maxTextMb = 256; // 0 — без ограничения объёма текста
     bool m_launchAtStartup = false;
     bool m_saveHistoryOnExit = true;
+    int m_compressAboveKb = 64;   // 0 — не сжимать по размеру
+    int m_compressAfterItems = 10; // 0 — не сжимать по позиции
+    int m_largeClipKb = 1024;      // клипы крупнее принимаются в фоновом потоке; 0 — всегда в GUI
+    bool m_traceEnabled = false;   // запись спанов для выгрузки в Chrome trace
 };
@@ -3,6 +3,8 @@
 #include "SettingsDialog.h"
 #include "HistoryManager.h"
 #include "LaunchAgentManager.h"
+#include "CryptoManager.h"
+#include "Trace.h"
 #include <QApplication>
 #include <QAction>
 #include <QClipboard>
@@ -20,9 +22,11 @@
 #include <QKeyEvent>
 #include <QSystemTrayIcon>
 #include <QMenu>
-#include <QCryptographicHash>
+#include <QSaveFile>
+#include <QTextStream>
 #include <algorithm>
 #include <QStyleHints>
+#include <QCursor>
 
 #if defined(Q_OS_MAC)
  #include <unistd.h>
@@ -44,71 +48,130 @@ const QColor SmartClipApp::favoriteColors[8] = {
 };
 int SmartClipApp::favoriteColorIndex = 0;
 
-SmartClipApp::SmartClipApp(QObject *parent)
+// Журнал сворачивается в новый снимок, когда превышает этот размер или
+// набирает столько записей с последнего снимка; таймера для этого нет
+static const qint64 kJournalCompactionBytes = 256 * 1024;
+static const int kJournalCompactionRecords = 1000;
+
+SmartClipApp::SmartClipApp(const InstanceLock *instanceLock, QObject *parent)
     : QObject(parent)
     , settingsManager(new SettingsManager(this))
     , historyManager(new HistoryManager(this))
     , launchAgentManager(new LaunchAgentManager(this))
+    , cryptoManager(new CryptoManager(this))
 {
+    journal = new HistoryJournal(journalFilePath(), cryptoManager, this);
+    persistence = std::make_unique<PersistenceWorker>(historyFilePath(), cryptoManager);
+    connect(persistence.get(), &PersistenceWorker::saved, this, &SmartClipApp::onSnapshotSaved);
+    clipIngestor = std::make_unique<ClipIngestor>(cryptoManager);
+    connect(clipIngestor.get(), &ClipIngestor::ready, this, &SmartClipApp::onClipsIngested);
+
     // Load settings
     settingsManager->loadSettings(settingsFilePath());
+    // До загрузки истории, чтобы в трассу попал и запуск
+    Trace::setEnabled(Trace::enabledByEnvironment() || settingsManager->traceEnabled());
     
     // Apply launch at startup setting
     launchAgentManager->applyLaunchAtStartup(settingsManager->launchAtStartup());
+
+    // Лимит нужен до загрузки, иначе журнал воспроизводится с лимитом по умолчанию
+    historyManager->setMaxItems(settingsManager->maxItems());
+    historyManager->setMaxTextBytes(qint64(settingsManager->maxTextMb()) * 1024 * 1024);
+    applyCompressionSettings();
     
     if (settingsManager->saveHistoryOnExit()) {
-        loadHistory();
+        historyManager->blobStore()->setStorage(blobsDirectoryPath(), cryptoManager);
+        // Снимок и журнал читаются в фоне, когда иконка уже показана: см. show()
+        historyLoader = std::make_unique<HistoryLoader>(historyFilePath(), journalFilePath(), cryptoManager);
+        connect(historyLoader.get(), &HistoryLoader::finished, this, &SmartClipApp::onHistoryLoaded);
+        historyLoading = true;
     } else {
-        QFile::remove(historyFilePath());
+        removeHistoryFiles();
     }
+    historyManager->clearDirty();
+
+    // Копирования и прочие изменения из журнала ждут его сворачивания; по
+    // таймеру сохраняются только флаги, часть которых (цвета) в журнал не пишется
+    saveScheduler = new SaveScheduler(historyManager, this);
+    connect(saveScheduler, &SaveScheduler::saveRequested, this, [this]() {
+        if (settingsManager->saveHistoryOnExit()) {
+            compactJournal();
+        }
+    });
+
     updateIcon();
 
     titleAction = new QAction("Select the clip you want to add to your clipboard", this);
     titleAction->setEnabled(false);
+
+    // Окно со списком не зависит от размера истории, в отличие от меню
+    historyModel = new HistoryModel(historyManager, this);
+    historyModel->setFavoriteColors(favoriteColors, 8);
+    quickPicker = std::make_unique<QuickPicker>(historyModel);
+    connect(quickPicker.get(), &QuickPicker::activated, this, &SmartClipApp::activateItem);
+
+    searchAction = new QAction("Search...", this);
+    connect(searchAction, &QAction::triggered, this, &SmartClipApp::showQuickPicker);
     
     settingsAction = new QAction("Settings", this);
     connect(settingsAction, &QAction::triggered, this, &SmartClipApp::onSettings);
 
     clearHistoryAction = new QAction("Clear", this);
+    // Очистку до конца загрузки отменила бы сама загрузка
+    clearHistoryAction->setEnabled(!historyLoading);
     connect(clearHistoryAction, &QAction::triggered, this, &SmartClipApp::onClearHistory);
 
+    saveTraceAction = new QAction("Save Trace", this);
+    saveTraceAction->setVisible(Trace::isEnabled());
+    connect(saveTraceAction, &QAction::triggered, this, &SmartClipApp::onSaveTrace);
+
     quitAction = new QAction("Quit", this);
     connect(quitAction, &QAction::triggered, this, &SmartClipApp::onQuit);
 
-    rebuildMenu();
+    setupMenu();
+    syncMenu();
 
     trayIcon.setContextMenu(&trayMenu);
     trayIcon.setToolTip("SmartClip");
-
-    connect(qApp, &QCoreApplication::aboutToQuit, this, [this]() {
-        if (exitHandled) {
-            return;
-        }
-        exitHandled = true;
-
-        if (settingsManager->saveHistoryOnExit()) {
-            if (historyManager->isDirty()) {
-                saveHistory();
-            }
-        } else {
-            QFile::remove(historyFilePath());
+#if !defined(Q_OS_MAC)
+    // На macOS клик по иконке открывает меню, на остальных системах — окно поиска
+    connect(&trayIcon, &QSystemTrayIcon::activated, this, [this](QSystemTrayIcon::ActivationReason reason) {
+        if (reason == QSystemTrayIcon::Trigger) {
+            showQuickPicker();
         }
     });
+#endif
 
-    if (QClipboard *clipboard = QApplication::clipboard()) {
-        connect(clipboard, &QClipboard::dataChanged, this, &SmartClipApp::onClipboardChanged);
-        connect(clipboard, &QClipboard::changed, this, [this](QClipboard::Mode mode) {
-            if (mode == QClipboard::Clipboard) {
-                onClipboardChanged();
-            }
-        });
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &SmartClipApp::finishPersistence);
+
+    // Одно копирование — один вызов addClip, сколько бы сигналов ни пришло
+    clipboardWatcher = new ClipboardWatcher(QApplication::clipboard(), this);
+    connect(clipboardWatcher, &ClipboardWatcher::textChanged, this, &SmartClipApp::addClip);
+    connect(clipboardWatcher, &ClipboardWatcher::contentChanged, this, &SmartClipApp::addContent);
+
+    // Перед показом меню забираем копирование, которое опрос ещё не заметил
+    connect(&trayMenu, &QMenu::aboutToShow, clipboardWatcher, &ClipboardWatcher::check);
+
+    // Запросы интеграций и повторный запуск приложения
+    controlServer = new ControlServer(historyManager, this);
+    connect(controlServer, &ControlServer::pasteRequested, this, [this](quint64 id) {
+        activateItem(id, Qt::NoModifier);
+    });
+    connect(controlServer, &ControlServer::showRequested, this, &SmartClipApp::showQuickPicker);
+    if (!controlServer->listen(*instanceLock)) {
+        qWarning() << "Control socket unavailable:" << ControlServer::serverName();
     }
 
 #if defined(Q_OS_MAC)
-    clipboardPollTimer = new QTimer(this);
-    clipboardPollTimer->setInterval(500);
-    connect(clipboardPollTimer, &QTimer::timeout, this, &SmartClipApp::pollClipboard);
-    clipboardPollTimer->start();
+    // Сигналы буфера на macOS приходят только пока приложение активно.
+    // Опрос дешёвый: пока changeCount не сдвинулся, буфер не читается
+    clipboardPoller = new ClipboardPoller(clipboardWatcher, this);
+    clipboardPoller->start();
+    connect(qApp, &QCoreApplication::aboutToQuit, this, [this]() {
+        const ClipboardPoller::Counters counters = clipboardPoller->counters();
+        qDebug() << "Clipboard polls:" << counters.polls << "hits:" << counters.hits
+                 << "missed:" << counters.missedChanges << "paused:" << counters.pausedTicks;
+    });
 #endif
 
 #if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
@@ -121,68 +184,102 @@ SmartClipApp::SmartClipApp(QObject *parent)
 void SmartClipApp::show()
 {
     trayIcon.show();
+    // Время до появления иконки не зависит от размера истории
+    if (historyLoader) {
+        historyLoader->start();
+    }
 }
 
-void SmartClipApp::onClipboardChanged()
+void SmartClipApp::onHistoryLoaded()
 {
-    QClipboard *clipboard = QApplication::clipboard();
-    if (!clipboard) {
+    if (!historyLoading) {
         return;
     }
+    SMARTCLIP_TRACE("app.history_loaded");
+    historyLoading = false;
+    clearHistoryAction->setEnabled(true);
+    const HistoryLoader::Result result = historyLoader->takeResult();
 
-    const QString text = clipboard->text(QClipboard::Clipboard);
-    qDebug() << "Clipboard changed: " << text;
-    
-    if (ignoreNextClipboardChange) {
-        ignoreNextClipboardChange = false;
-        lastClipboardText = text;
+    // Сохранение выключили, пока история читалась: старые файлы удалятся на выходе
+    if (!settingsManager->saveHistoryOnExit()) {
         return;
     }
 
-    if (text.trimmed().isEmpty()) {
-        return;
+    // Клипы, скопированные во время загрузки, в журнал не попали
+    const bool changedWhileLoading = historyManager->isDirty();
+    bool migrated = false;
+    if (result.hasSnapshot) {
+        historyManager->bulkLoad(result.items);
+    } else if (QFile::exists(legacyHistoryFilePath())) {
+        loadLegacyHistory();
+        migrated = true;
     }
 
-    if (text == lastClipboardText) {
-        return;
+    // Поверх снимка применяем изменения, записанные после него,
+    // и сразу сворачиваем воспроизведённый журнал в свежий снимок
+    const bool replayed = journal->replay(result.journal, result.snapshotSequence, historyManager,
+                                          [this](quint64 id) { applyToggleFavorite(id); });
+    if (migrated) {
+        rekeyHistory();
+    } else if (replayed || changedWhileLoading) {
+        compactJournal();
     }
-    lastClipboardText = text;
-    
-    historyManager->addToHistory(text);
-    rebuildMenu();
+    historyManager->clearDirty();
+    syncMenu();
 }
 
-void SmartClipApp::pollClipboard()
+void SmartClipApp::addClip(const QString &text)
 {
-    QClipboard *clipboard = QApplication::clipboard();
-    if (!clipboard) {
+    SMARTCLIP_TRACE("app.add_clip", text.size());
+    // Содержимое не логируем: в буфере бывают пароли и мегабайтные вставки
+    qDebug() << "Clipboard changed:" << text.size() << "chars";
+
+    // Крупный клип: хеш, сжатие и запись на диск уходят в фоновый поток.
+    // Число символов UTF-16 не больше числа байт UTF-8, так что порог не занижен
+    const qint64 largeClipBytes = qint64(settingsManager->largeClipKb()) * 1024;
+    if (largeClipBytes > 0 && text.size() >= largeClipBytes) {
+        const BlobStore *blobs = historyManager->blobStore();
+        clipIngestor->ingest(text, QDateTime::currentMSecsSinceEpoch(), blobs->directory(),
+                             blobs->compressionThreshold());
         return;
     }
 
-    const QString text = clipboard->text(QClipboard::Clipboard);
-    
-    if (ignoreNextClipboardChange) {
-        ignoreNextClipboardChange = false;
-        lastClipboardText = text;
-        return;
-    }
+    // Тело уже записано в хранилище; в журнал идут только дайджест и превью
+    const quint64 id = historyManager->addToHistory(text, QDateTime::currentMSecsSinceEpoch());
+    appendJournal(HistoryJournal::Op::Add, historyManager->item(id));
+    syncMenu();
+}
 
-    if (text.trimmed().isEmpty()) {
-        return;
-    }
+void SmartClipApp::addContent(const ClipContent &content)
+{
+    SMARTCLIP_TRACE("app.add_content", content.byteSize());
+    qDebug() << "Clipboard changed:" << content.byteSize() << "bytes of rich content";
+
+    // Кодирование картинки, хеши и запись частей — всегда в фоновом потоке
+    const BlobStore *blobs = historyManager->blobStore();
+    clipIngestor->ingest(content, QDateTime::currentMSecsSinceEpoch(), blobs->directory(),
+                         blobs->compressionThreshold());
+}
 
-    if (text == lastClipboardText) {
+void SmartClipApp::onClipsIngested()
+{
+    SMARTCLIP_TRACE("app.clips_ingested");
+    const QVector<ClipIngestor::Result> results = clipIngestor->takeResults();
+    if (results.isEmpty()) {
         return;
     }
-    lastClipboardText = text;
-    
-    historyManager->addToHistory(text);
-    rebuildMenu();
+    for (const ClipIngestor::Result &result : results) {
+        const quint64 id = result.item.parts.isEmpty()
+            ? historyManager->addPrepared(result.item, result.body)
+            : historyManager->addPrepared(result.item, result.parts);
+        appendJournal(HistoryJournal::Op::Add, historyManager->item(id));
+    }
+    syncMenu();
 }
 
 void SmartClipApp::onSettings()
 {
-    SettingsDialog dialog(settingsManager);
+    SettingsDialog dialog(settingsManager, historyManager);
     if (dialog.exec() == QDialog::Accepted) {
         // Settings were saved in the dialog
         // Apply launch at startup if changed
@@ -190,62 +287,139 @@ void SmartClipApp::onSettings()
         
         // Trim history if max items changed
         historyManager->setMaxItems(settingsManager->maxItems());
+        historyManager->setMaxTextBytes(qint64(settingsManager->maxTextMb()) * 1024 * 1024);
+        applyCompressionSettings();
+
+        // Переменная окружения включает трассу независимо от настройки
+        Trace::setEnabled(Trace::enabledByEnvironment() || settingsManager->traceEnabled());
+        saveTraceAction->setVisible(Trace::isEnabled());
+
+        // Без сохранения истории журнал тоже не ведём, а тела держим в памяти
+        if (settingsManager->saveHistoryOnExit()) {
+            const bool wasEnabled = historyManager->blobStore()->hasStorage();
+            historyManager->blobStore()->setStorage(blobsDirectoryPath(), cryptoManager);
+            if (!wasEnabled) {
+                // Всё, что накопилось без журнала, сразу попадает в снимок
+                compactJournal();
+            }
+        } else {
+            persistence->cancel();
+            historyManager->blobStore()->setStorage(QString(), nullptr);
+            journal->clear();
+        }
         
         // Rebuild menu to reflect any changes
-        rebuildMenu();
+        syncMenu();
     }
 }
 
-void SmartClipApp::onQuit()
+void SmartClipApp::applyCompressionSettings()
 {
-    if (!exitHandled) {
-        exitHandled = true;
-        if (settingsManager->saveHistoryOnExit()) {
-            if (historyManager->isDirty()) {
-                saveHistory();
-            }
-        } else {
-            QFile::remove(historyFilePath());
-        }
+    historyManager->setCompression(qint64(settingsManager->compressAboveKb()) * 1024,
+                                   settingsManager->compressAfterItems());
+}
+
+void SmartClipApp::onSaveTrace()
+{
+    // Только имена спанов, длительности и счётчики — содержимого клипов в трассе нет
+    const QString path = traceFilePath();
+    if (Trace::writeChromeTrace(path)) {
+        trayIcon.showMessage("SmartClip", "Trace saved to " + QDir::toNativeSeparators(path));
+    } else {
+        trayIcon.showMessage("SmartClip", "Could not save the trace", QSystemTrayIcon::Warning);
     }
+}
+
+void SmartClipApp::onQuit()
+{
+    finishPersistence();
     qApp->quit();
 }
 
+void SmartClipApp::finishPersistence()
+{
+    if (exitHandled) {
+        return;
+    }
+    exitHandled = true;
+    saveScheduler->cancel();
+
+    // Выход до конца загрузки: дочитываем историю, иначе снимок её бы затёр
+    if (historyLoading) {
+        historyLoader->start();
+        historyLoader->waitForFinished();
+        onHistoryLoaded();
+    }
+
+    // Клипы, скопированные перед выходом, должны попасть в журнал
+    clipIngestor->waitForIdle();
+    onClipsIngested();
+
+    if (settingsManager->saveHistoryOnExit()) {
+        // Полный снимок на выходе не нужен: всё, что в него не попало, уже в журнале.
+        // Ждём только запись, которая идёт сейчас
+        persistence->waitForIdle();
+    } else {
+        persistence->cancel();
+        persistence->waitForIdle();
+        removeHistoryFiles();
+    }
+}
+
+void SmartClipApp::showQuickPicker()
+{
+    clipboardWatcher->check();
+    quickPicker->popup(QCursor::pos());
+}
+
 void SmartClipApp::onClearHistory()
 {
     historyManager->clearHistory();
-    rebuildMenu();
+    appendJournal(HistoryJournal::Op::Clear, nullptr);
+    syncMenu();
+}
+
+void SmartClipApp::onToggleFavorite(quint64 id)
+{
+    const HistoryManager::HistoryItem *item = historyManager->item(id);
+    if (!item) {
+        return;
+    }
+    appendJournal(HistoryJournal::Op::ToggleFavorite, item);
+    applyToggleFavorite(id);
+    syncMenu();
 }
 
-void SmartClipApp::onToggleFavorite(const QString &text)
+void SmartClipApp::applyToggleFavorite(quint64 id)
 {
-    historyManager->toggleFavorite(text);
+    historyManager->toggleFavorite(id);
     
     // Если элемент добавляется в избранное, закрепляем за ним цвет
-    if (historyManager->isFavorite(text)) {
-        if (!favoriteItemColors.contains(text)) {
-            favoriteItemColors[text] = getFavoriteColorIndex(text);
+    const HistoryManager::HistoryItem *item = historyManager->item(id);
+    if (item && item->isFavorite) {
+        if (item->colorIndex < 0) {
+            historyManager->setColorIndex(id, getFavoriteColorIndex(id));
         }
     } else {
         // Если элемент удаляется из избранного, освобождаем цвет
-        releaseFavoriteColor(text);
+        releaseFavoriteColor(id);
     }
-    
-    rebuildMenu();
 }
 
-int SmartClipApp::getFavoriteColorIndex(const QString &text)
+int SmartClipApp::getFavoriteColorIndex(quint64 id)
 {
     // Если цвет уже закреплен за этим элементом, возвращаем его
-    if (favoriteItemColors.contains(text)) {
-        return favoriteItemColors[text];
+    const HistoryManager::HistoryItem *item = historyManager->item(id);
+    if (item && item->colorIndex >= 0) {
+        return item->colorIndex;
     }
     
     // Ищем свободный цвет (кроме белого)
     QSet<int> usedColors;
-    for (auto it = favoriteItemColors.begin(); it != favoriteItemColors.end(); ++it) {
-        if (it.value() < 7) { // Игнорируем белый цвет
-            usedColors.insert(it.value());
+    for (quint64 otherId : historyManager->orderedIds()) {
+        const HistoryManager::HistoryItem *other = historyManager->item(otherId);
+        if (other->isFavorite && other->colorIndex >= 0 && other->colorIndex < 7) { // Игнорируем белый цвет
+            usedColors.insert(other->colorIndex);
         }
     }
     
@@ -260,184 +434,193 @@ int SmartClipApp::getFavoriteColorIndex(const QString &text)
     return 7;
 }
 
-void SmartClipApp::releaseFavoriteColor(const QString &text)
+void SmartClipApp::releaseFavoriteColor(quint64 id)
 {
-    favoriteItemColors.remove(text);
+    historyManager->setColorIndex(id, -1);
 }
 
-void SmartClipApp::rebuildMenu()
+void SmartClipApp::setupMenu()
 {
-    trayMenu.clear();
+    // Постоянная часть меню; элементы истории вставляются между двумя разделителями
+    trayMenu.addAction(titleAction);
+    trayMenu.addAction(searchAction);
+    historySeparator = trayMenu.addSeparator();
+    historyEndSeparator = trayMenu.addSeparator();
+    trayMenu.addAction(clearHistoryAction);
+    trayMenu.addSeparator();
+    trayMenu.addAction(settingsAction);
+    trayMenu.addAction(saveTraceAction);
+    trayMenu.addAction(quitAction);
+}
 
-    if (titleAction) {
-        trayMenu.addAction(titleAction);
+// Индексы самой длинной возрастающей подпоследовательности values, O(n log n)
+static QVector<int> longestIncreasingRun(const QVector<int> &values)
+{
+    QVector<int> tails;              // индекс последнего элемента цепочки каждой длины
+    QVector<int> previous(values.size(), -1);
+    for (int i = 0; i < values.size(); ++i) {
+        const auto pos = std::lower_bound(tails.begin(), tails.end(), values.at(i), [&](int index, int value) {
+            return values.at(index) < value;
+        });
+        if (pos != tails.begin()) {
+            previous[i] = *(pos - 1);
+        }
+        if (pos == tails.end()) {
+            tails.push_back(i);
+        } else {
+            *pos = i;
+        }
     }
 
-    const auto &history = historyManager->history();
-    if (!history.isEmpty()) {
-        trayMenu.addSeparator();
+    QVector<int> run(tails.size());
+    for (int i = tails.isEmpty() ? -1 : tails.last(), k = int(tails.size()) - 1; i >= 0; i = previous.at(i), --k) {
+        run[k] = i;
     }
+    return run;
+}
 
-    for (int i = 0; i < history.size(); ++i) {
-        const QString text = history.at(i).text;
-        
-        // Определяем нужно ли маскировать текст
-        QString displayText = maskedItems.contains(text) ? maskText(text) : text;
-        QAction *action = trayMenu.addAction(formatMenuLabel(displayText));
-
-        // Показываем иконку избранного если элемент в избранном
-        if (history.at(i).isFavorite) {
-            action->setIcon(QIcon());
-            action->setIconVisibleInMenu(true);
-            QPixmap pixmap(12, 12);
-            pixmap.fill(Qt::transparent);
-            QPainter painter(&pixmap);
-            painter.setRenderHint(QPainter::Antialiasing);
-            
-            // Получаем закрепленный цвет за этим элементом
-            int colorIndex = favoriteItemColors.value(text, 7); // По умолчанию белый
-            painter.setBrush(favoriteColors[colorIndex]);
-            painter.setPen(Qt::NoPen);
-            painter.drawEllipse(2, 2, 8, 8);
-            painter.end();
-            action->setIcon(QIcon(pixmap));
+void SmartClipApp::syncMenu()
+{
+    SMARTCLIP_TRACE("menu.sync", historyManager->size());
+    // Только id в порядке меню: сами элементы читаются из истории по месту
+    const QVector<quint64> order = historyManager->orderedIds();
+    historySeparator->setVisible(!order.isEmpty());
+
+    QHash<quint64, int> targetPosition;
+    targetPosition.reserve(order.size());
+    for (int i = 0; i < order.size(); ++i) {
+        targetPosition.insert(order.at(i), i);
+    }
+
+    // Пропавшие элементы удаляем, у оставшихся запоминаем новые позиции
+    QVector<quint64> kept;
+    QVector<int> keptPositions;
+    for (quint64 id : std::as_const(menuOrder)) {
+        const auto target = targetPosition.constFind(id);
+        if (target == targetPosition.cend()) {
+            QAction *action = menuEntries.take(id).action;
+            trayMenu.removeAction(action);
+            action->deleteLater(); // Может удаляться из своего же triggered
+        } else {
+            kept.push_back(id);
+            keptPositions.push_back(target.value());
         }
-        
-        connect(action, &QAction::triggered, this, [this, text]() {
-            Qt::KeyboardModifiers modifiers = QApplication::keyboardModifiers();
-            
-            if (modifiers & Qt::ControlModifier && modifiers & Qt::ShiftModifier) {
-                // Shift+Ctrl+клик - переключаем маскирование
-                toggleMaskItem(text);
-            } else if (modifiers & Qt::ControlModifier) {
-                onToggleFavorite(text);
-            } else {
-                // Обычное копирование в буфер - всегда копируем полный текст!
-                historyManager->incrementUsageCount(text);
-
-                if (QClipboard *clipboard = QApplication::clipboard()) {
-                    ignoreNextClipboardChange = true;
-                    clipboard->setText(text, QClipboard::Clipboard);
-                }
-
-                rebuildMenu();
-            }
-        });
-        
-        // Добавляем контекстное меню для правого клика
-        action->setData(text); // Сохраняем текст для использования в контекстном меню
     }
 
-    trayMenu.addSeparator();
-
-    if (clearHistoryAction) {
-        trayMenu.addAction(clearHistoryAction);
+    // Самая длинная цепочка уже стоящих по порядку действий остаётся на месте,
+    // двигаются только остальные: одно копирование трогает O(1) действий
+    QSet<quint64> inPlace;
+    for (int index : longestIncreasingRun(keptPositions)) {
+        inPlace.insert(kept.at(index));
     }
 
-    trayMenu.addSeparator();
-
-    if (settingsAction) {
-        trayMenu.addAction(settingsAction);
-    }
-    
-    if (quitAction) {
-        trayMenu.addAction(quitAction);
+    // С конца: всё после before уже на своих местах
+    QAction *before = historyEndSeparator;
+    for (int i = int(order.size()) - 1; i >= 0; --i) {
+        const HistoryManager::HistoryItem &item = *historyManager->item(order.at(i));
+        auto entry = menuEntries.find(item.id);
+        if (entry == menuEntries.end()) {
+            entry = menuEntries.insert(item.id, createMenuEntry(item));
+            trayMenu.insertAction(before, entry->action);
+        } else {
+            updateMenuEntry(entry.value(), item);
+            if (!inPlace.contains(item.id)) {
+                trayMenu.insertAction(before, entry->action);
+            }
+        }
+        before = entry->action;
     }
+
+    menuOrder = order;
 }
 
-void SmartClipApp::toggleMaskItem(const QString &text)
+SmartClipApp::MenuEntry SmartClipApp::createMenuEntry(const HistoryManager::HistoryItem &item)
 {
-    if (maskedItems.contains(text)) {
-        maskedItems.remove(text);
-    } else {
-        maskedItems[text] = true;
-    }
-    rebuildMenu();
+    MenuEntry entry;
+    entry.action = new QAction(HistoryModel::label(item), &trayMenu);
+    entry.action->setData(item.id);
+    entry.isMasked = item.isMasked;
+
+    const quint64 id = item.id;
+    connect(entry.action, &QAction::triggered, this, [this, id]() {
+        activateItem(id, QApplication::keyboardModifiers());
+    });
+    updateMenuEntry(entry, item);
+    return entry;
 }
 
-QString SmartClipApp::maskText(const QString &text) const
+void SmartClipApp::updateMenuEntry(MenuEntry &entry, const HistoryManager::HistoryItem &item)
 {
-    if (text.length() <= 6) {
-        return QString(text.length(), '*');
+    // Превью у id неизменно: подпись пересчитывается только при смене маски
+    if (entry.isMasked != item.isMasked) {
+        entry.isMasked = item.isMasked;
+        entry.action->setText(HistoryModel::label(item));
+    }
+
+    // Иконки закреплённых цветов общие и рисуются один раз
+    const int colorIndex = item.isFavorite ? item.colorIndex : -1;
+    if (entry.isFavorite != item.isFavorite || entry.colorIndex != colorIndex) {
+        entry.isFavorite = item.isFavorite;
+        entry.colorIndex = colorIndex;
+        entry.action->setIconVisibleInMenu(item.isFavorite);
+        entry.action->setIcon(item.isFavorite ? historyModel->favoriteIcon(colorIndex) : QIcon());
     }
-    
-    // Показываем первые 3 и последние 3 символа, остальное звездочками
-    QString masked = text.left(3) + QString(text.length() - 6, '*') + text.right(3);
-    return masked;
 }
 
-QByteArray SmartClipApp::getEncryptionKey() const
+void SmartClipApp::activateItem(quint64 id, Qt::KeyboardModifiers modifiers)
 {
-    QString keyPath = QDir::homePath() + QLatin1String("/.smartclip/.key");
-    QFile keyFile(keyPath);
-    
-    // Если ключ существует, читаем его
-    if (keyFile.open(QIODevice::ReadOnly)) {
-        QByteArray storedKey = keyFile.readAll();
-        if (storedKey.size() == 32) { // SHA-256 = 32 байта
-            return QByteArray::fromBase64(storedKey);
+    SMARTCLIP_TRACE("app.activate_item");
+    if (modifiers & Qt::ControlModifier && modifiers & Qt::ShiftModifier) {
+        // Shift+Ctrl+клик - переключаем маскирование
+        toggleMaskItem(id);
+    } else if (modifiers & Qt::ControlModifier) {
+        onToggleFavorite(id);
+    } else {
+        // Обычное копирование в буфер - всегда копируем полный текст!
+        // Тело расшифровывается только здесь
+        const HistoryManager::HistoryItem *item = historyManager->item(id);
+        if (!item) {
+            return;
         }
+        if (!item->parts.isEmpty()) {
+            // Все форматы клипа поднимаются из хранилища только при вставке
+            const QVector<ClipContent::Format> parts = historyManager->partData(id);
+            if (std::any_of(parts.cbegin(), parts.cend(), [](const ClipContent::Format &part) {
+                    return part.second.isEmpty();
+                })) {
+                return;
+            }
+            clipboardWatcher->setMimeData(ClipContent::toMimeData(parts));
+        } else {
+            const QString text = historyManager->text(id);
+            if (text.isEmpty()) {
+                return;
+            }
+            clipboardWatcher->setText(text);
+        }
+        appendJournal(HistoryJournal::Op::Use, item);
+        historyManager->incrementUsageCount(id);
+
+        syncMenu();
     }
-    
-    // Генерируем новый ключ
-    QByteArray newKey = QCryptographicHash::hash(
-        QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8() + 
-        QString::number(QCoreApplication::applicationPid()).toUtf8(),
-        QCryptographicHash::Sha256
-    );
-    
-    // Сохраняем ключ (только для чтения/записи владельцем)
-    if (keyFile.open(QIODevice::WriteOnly)) {
-        keyFile.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
-        keyFile.write(newKey.toBase64());
-    }
-    
-    return newKey;
 }
 
-QByteArray SmartClipApp::encryptData(const QByteArray &data) const
+void SmartClipApp::toggleMaskItem(quint64 id)
 {
-    QByteArray key = getEncryptionKey();
-    
-    // Простой но надежный метод: XOR с хэшем ключа
-    QByteArray encrypted = data;
-    for (int i = 0; i < encrypted.size(); ++i) {
-        encrypted[i] = encrypted[i] ^ key[i % key.size()];
+    const HistoryManager::HistoryItem *item = historyManager->item(id);
+    if (!item) {
+        return;
     }
-    
-    // Добавляем проверочную сумму для целостности
-    QByteArray hash = QCryptographicHash::hash(encrypted, QCryptographicHash::Sha256);
-    encrypted.append(hash.left(8)); // 8 байт контрольной суммы
-    
-    return encrypted;
+    appendJournal(HistoryJournal::Op::ToggleMask, item);
+    applyToggleMask(id);
+    syncMenu();
 }
 
-QByteArray SmartClipApp::decryptData(const QByteArray &data) const
+void SmartClipApp::applyToggleMask(quint64 id)
 {
-    if (data.size() < 8) {
-        return QByteArray(); // Слишком короткие данные
-    }
-    
-    QByteArray key = getEncryptionKey();
-    
-    // Отделяем данные от контрольной суммы
-    QByteArray encrypted = data.left(data.size() - 8);
-    QByteArray storedHash = data.right(8);
-    
-    // Расшифровываем
-    QByteArray decrypted = encrypted;
-    for (int i = 0; i < decrypted.size(); ++i) {
-        decrypted[i] = decrypted[i] ^ key[i % key.size()];
-    }
-    
-    // Проверяем целостность
-    QByteArray calculatedHash = QCryptographicHash::hash(encrypted, QCryptographicHash::Sha256).left(8);
-    if (storedHash != calculatedHash) {
-        qDebug() << "Data integrity check failed!";
-        return QByteArray(); // Данные повреждены
+    if (const HistoryManager::HistoryItem *item = historyManager->item(id)) {
+        historyManager->setMasked(id, !item->isMasked);
     }
-    
-    return decrypted;
 }
 
 QString SmartClipApp::settingsFilePath() const
@@ -446,41 +629,80 @@ QString SmartClipApp::settingsFilePath() const
 }
 
 QString SmartClipApp::historyFilePath() const
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/history.bin");
+}
+
+QString SmartClipApp::legacyHistoryFilePath() const
 {
     return QDir::homePath() + QLatin1String("/.smartclip/history.yml");
 }
 
-void SmartClipApp::loadHistory()
+QString SmartClipApp::legacyMetadataFilePath() const
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/metadata.yml");
+}
+
+QString SmartClipApp::journalFilePath() const
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/history.journal");
+}
+
+QString SmartClipApp::blobsDirectoryPath() const
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/blobs");
+}
+
+QString SmartClipApp::traceFilePath() const
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/trace-")
+        + QDateTime::currentDateTime().toString(QStringLiteral("yyyyMMdd-HHmmss")) + QLatin1String(".json");
+}
+
+void SmartClipApp::removeHistoryFiles()
+{
+    QFile::remove(historyFilePath());
+    QFile::remove(legacyHistoryFilePath());
+    QFile::remove(legacyMetadataFilePath());
+    QDir(blobsDirectoryPath()).removeRecursively();
+    journal->clear();
+}
+
+void SmartClipApp::loadLegacyHistory()
 {
     // Загружаем зашифрованный файл истории
-    QFile file(historyFilePath());
+    QFile file(legacyHistoryFilePath());
     if (file.open(QIODevice::ReadOnly)) {
         QByteArray encryptedData = file.readAll();
-        QByteArray decryptedData = decryptData(encryptedData);
+        QByteArray decryptedData = cryptoManager->decryptLegacy(encryptedData);
         
         // Парсим расшифрованные данные
         QString content = QString::fromUtf8(decryptedData);
         QStringList lines = content.split('\n');
         
         HistoryManager::HistoryItem currentItem;
+        QString currentText;
         bool hasItem = false;
+
+        // Тело попадает в хранилище, счётчики переносим из старого файла
+        auto restoreCurrent = [this, &currentItem, &currentText]() {
+            const quint64 id = historyManager->addToHistory(currentText, currentItem.addedAtMs);
+            if (id != 0) {
+                HistoryManager::HistoryItem restored = *historyManager->item(id);
+                restored.isFavorite = currentItem.isFavorite;
+                restored.usageCount = currentItem.usageCount;
+                historyManager->restoreItem(restored);
+            }
+        };
         
         for (const QString &line : lines) {
             if (line.startsWith("text:\"")) {
                 if (hasItem) {
-                    // Сохраняем предыдущий элемент
-                    historyManager->addToHistory(currentItem.text);
-                    // Устанавливаем остальные параметры
-                    const auto &history = historyManager->history();
-                    if (!history.isEmpty()) {
-                        auto &lastItem = const_cast<HistoryManager::HistoryItem&>(history.last());
-                        lastItem.isFavorite = currentItem.isFavorite;
-                        lastItem.usageCount = currentItem.usageCount;
-                        lastItem.addedAtMs = currentItem.addedAtMs;
-                    }
+                    // Сохраняем предыдущий элемент вместе со счетчиками
+                    restoreCurrent();
                 }
                 
-                currentItem.text = line.mid(6, line.length() - 7); // Убираем text:" и "
+                currentText = line.mid(6, line.length() - 7); // Убираем text:" и "
                 currentItem.isFavorite = false;
                 currentItem.usageCount = 0;
                 currentItem.addedAtMs = QDateTime::currentMSecsSinceEpoch();
@@ -493,15 +715,7 @@ void SmartClipApp::loadHistory()
                 currentItem.addedAtMs = line.mid(5).toLongLong();
             } else if (line == "---") {
                 if (hasItem) {
-                    historyManager->addToHistory(currentItem.text);
-                    // Устанавливаем остальные параметры
-                    const auto &history = historyManager->history();
-                    if (!history.isEmpty()) {
-                        auto &lastItem = const_cast<HistoryManager::HistoryItem&>(history.last());
-                        lastItem.isFavorite = currentItem.isFavorite;
-                        lastItem.usageCount = currentItem.usageCount;
-                        lastItem.addedAtMs = currentItem.addedAtMs;
-                    }
+                    restoreCurrent();
                     hasItem = false;
                 }
             }
@@ -509,23 +723,15 @@ void SmartClipApp::loadHistory()
         
         // Сохраняем последний элемент
         if (hasItem) {
-            historyManager->addToHistory(currentItem.text);
-            // Устанавливаем остальные параметры
-            const auto &history = historyManager->history();
-            if (!history.isEmpty()) {
-                auto &lastItem = const_cast<HistoryManager::HistoryItem&>(history.last());
-                lastItem.isFavorite = currentItem.isFavorite;
-                lastItem.usageCount = currentItem.usageCount;
-                lastItem.addedAtMs = currentItem.addedAtMs;
-            }
+            restoreCurrent();
         }
     }
     
     // Загружаем метаданные (расшифровываем весь файл)
-    QFile metaFile(QDir::homePath() + QLatin1String("/.smartclip/metadata.yml"));
+    QFile metaFile(legacyMetadataFilePath());
     if (metaFile.open(QIODevice::ReadOnly)) {
         QByteArray encryptedData = metaFile.readAll();
-        QByteArray decryptedData = decryptData(encryptedData);
+        QByteArray decryptedData = cryptoManager->decryptLegacy(encryptedData);
         
         // Парсим расшифрованные метаданные
         QString content = QString::fromUtf8(decryptedData);
@@ -534,97 +740,107 @@ void SmartClipApp::loadHistory()
         for (const QString &line : lines) {
             if (line.startsWith("masked:\"")) {
                 QString text = line.mid(8, line.length() - 9); // Убираем masked:" и "
-                maskedItems[text] = true;
+                if (const auto *item = historyManager->findByDigest(HistoryManager::contentDigest(text))) {
+                    historyManager->setMasked(item->id, true);
+                }
             } else if (line.startsWith("color:\"")) {
                 int colonPos = line.indexOf("\":");
                 if (colonPos > 7) {
                     QString text = line.mid(7, colonPos - 7); // Убираем color:" и "
                     int colorIndex = line.mid(colonPos + 2).toInt();
-                    favoriteItemColors[text] = colorIndex;
+                    if (const auto *item = historyManager->findByDigest(HistoryManager::contentDigest(text))) {
+                        historyManager->setColorIndex(item->id, colorIndex);
+                    }
                 }
             }
         }
     }
 }
 
-void SmartClipApp::saveHistory() const
+void SmartClipApp::rekeyHistory()
 {
-    // Сохраняем историю в обычном формате
-    QString tempPath = historyFilePath() + ".tmp";
-    QFile tempFile(tempPath);
-    if (tempFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&tempFile);
-        
-        const auto &history = historyManager->history();
-        for (const auto &item : history) {
-            out << "text:\"" << item.text << "\"\n";
-            out << "favorite:" << (item.isFavorite ? "true" : "false") << "\n";
-            out << "count:" << item.usageCount << "\n";
-            out << "time:" << item.addedAtMs << "\n";
-            out << "---\n";
-        }
+    SMARTCLIP_TRACE("app.rekey_history", historyManager->size());
+    // Старый ключ выводился из времени и pid и служил XOR-гаммой поверх
+    // известного текста YAML, так что его надо считать раскрытым.
+    // Шифр не должен меняться под фоновыми потоками
+    clipIngestor->waitForIdle();
+    onClipsIngested();
+    persistence->waitForIdle();
+
+    // Тела, записанные старым ключом, поднимаем в память, журнал и хранилище удаляем
+    BlobStore *blobs = historyManager->blobStore();
+    blobs->setStorage(QString(), nullptr);
+    journal->clear();
+    QFile::remove(historyFilePath());
+    QDir(blobsDirectoryPath()).removeRecursively();
+
+    if (!cryptoManager->rotateKey()) {
+        qWarning() << "Could not replace the history key";
+    }
+
+    // Тела переписываются новым ключом, снимок тоже; старые файлы удаляются после его записи
+    blobs->setStorage(blobsDirectoryPath(), cryptoManager);
+    compactJournal();
+}
+
+void SmartClipApp::appendJournal(HistoryJournal::Op op, const HistoryManager::HistoryItem *item)
+{
+    // Пока история загружается, номера записей ещё неизвестны; изменения
+    // этого времени попадут в снимок после загрузки
+    if (!settingsManager->saveHistoryOnExit() || historyLoading
+        || (op != HistoryJournal::Op::Clear && !item)) {
+        return;
     }
-    
-    // Шифруем весь файл и перезаписываем оригинал
-    QFile tempRead(tempPath);
-    if (tempRead.open(QIODevice::ReadOnly)) {
-        QByteArray plainData = tempRead.readAll();
-        QByteArray encryptedData = encryptData(plainData);
-        
-        QFile encryptedFile(historyFilePath());
-        if (encryptedFile.open(QIODevice::WriteOnly)) {
-            encryptedFile.write(encryptedData);
+
+    HistoryJournal::Record record;
+    record.op = op;
+    if (item) {
+        record.digest = item->digest;
+        if (op == HistoryJournal::Op::Add) {
+            record.timestampMs = item->addedAtMs;
+            record.preview = item->preview;
+            record.length = item->length;
+            record.parts = item->parts;
         }
     }
-    
-    // Удаляем временный файл
-    tempFile.remove();
-    
-    // Сохраняем метаданные (шифруем весь файл)
-    QString metaPath = QDir::homePath() + QLatin1String("/.smartclip/metadata.yml");
-    QString metaTempPath = metaPath + ".tmp";
-    QFile metaTempFile(metaTempPath);
-    if (metaTempFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&metaTempFile);
-        out << "# SmartClip metadata\n";
-        out << "# Masked items\n";
-        for (auto it = maskedItems.begin(); it != maskedItems.end(); ++it) {
-            out << "masked:\"" << it.key() << "\"\n";
-        }
-        out << "# Favorite colors\n";
-        for (auto it = favoriteItemColors.begin(); it != favoriteItemColors.end(); ++it) {
-            out << "color:\"" << it.key() << "\":" << it.value() << "\n";
-        }
+    journal->append(record);
+
+    if (journal->size() > kJournalCompactionBytes || journal->pendingRecords() >= kJournalCompactionRecords) {
+        compactJournal();
     }
-    
-    // Шифруем весь файл метаданных
-    QFile metaTempRead(metaTempPath);
-    if (metaTempRead.open(QIODevice::ReadOnly)) {
-        QByteArray plainData = metaTempRead.readAll();
-        QByteArray encryptedData = encryptData(plainData);
-        
-        QFile metaEncryptedFile(metaPath);
-        if (metaEncryptedFile.open(QIODevice::WriteOnly)) {
-            metaEncryptedFile.write(encryptedData);
-        }
+}
+
+void SmartClipApp::compactJournal()
+{
+    // Снимок недозагруженной истории затёр бы тот, что сейчас читается
+    if (historyLoading) {
+        return;
     }
-    
-    // Удаляем временный файл метаданных
-    metaTempFile.remove();
+    SMARTCLIP_TRACE("app.compact_journal", historyManager->size());
+    // Всё, что записано до ротации, попадёт в снимок; новые записи идут в свежий сегмент.
+    // Снимок разделяется неявно: копия дешёвая и не меняется в потоке записи.
+    // Более новый снимок вытесняет ещё не записанный
+    journal->rotate();
+    rotatedSequence = journal->lastSequence();
+    persistence->save(historyManager->snapshot(), rotatedSequence, historyManager->blobStore()->nextEpoch());
+    historyManager->clearDirty();
 }
 
-QString SmartClipApp::formatMenuLabel(const QString &text)
+void SmartClipApp::onSnapshotSaved(quint64 journalSequence, quint64 blobEpoch, bool ok)
 {
-    QString s = text;
-    s.replace('\n', ' ');
-    s.replace('\r', ' ');
-    s = s.simplified();
+    if (!ok) {
+        return;
+    }
 
-    const int maxLen = 60;
-    if (s.length() > maxLen) {
-        s = s.left(maxLen - 3) + "...";
+    // Повёрнутый сегмент удаляем, только если снимок покрывает все его записи:
+    // после ротации, сделанной во время записи, в нём есть и более новые
+    if (journalSequence >= rotatedSequence) {
+        journal->removeRotated();
     }
-    return s;
+    // Тела, на которые снимок больше не ссылается, можно удалять
+    historyManager->blobStore()->collectGarbage(blobEpoch);
+    QFile::remove(legacyHistoryFilePath());
+    QFile::remove(legacyMetadataFilePath());
 }
 
 void SmartClipApp::updateIcon()
@@ -10,70 +10,124 @@
 #include <QEvent>
 #include <QShortcut>
 #include <QTimer>
+#include <memory>
+#include "HistoryManager.h"
+#include "HistoryModel.h"
+#include "HistoryJournal.h"
+#include "HistoryLoader.h"
+#include "PersistenceWorker.h"
+#include "ClipIngestor.h"
+#include "SaveScheduler.h"
+#include "QuickPicker.h"
+#include "ClipboardWatcher.h"
+#include "ClipboardPoller.h"
+#include "ControlServer.h"
 class SettingsManager;
 class SettingsDialog;
-class HistoryManager;
 class LaunchAgentManager;
+class CryptoManager;
 
 class SmartClipApp final : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit SmartClipApp(QObject *parent = nullptr);
+    // The lock must be held for the lifetime of the app
+    explicit SmartClipApp(const InstanceLock *instanceLock, QObject *parent = nullptr);
     void show();
 
 private slots:
     void updateIcon();
-    void onClipboardChanged();
-    void pollClipboard();
     void onSettings();
     void onQuit();
+    void onSaveTrace();
     void onClearHistory();
-    void onToggleFavorite(const QString &text);
+    void onToggleFavorite(quint64 id);
+    void onSnapshotSaved(quint64 journalSequence, quint64 blobEpoch, bool ok);
+    void onClipsIngested();
+    void onHistoryLoaded();
+    void finishPersistence();
+    void showQuickPicker();
     
     // Методы для управления цветами избранного
-    int getFavoriteColorIndex(const QString &text);
-    void releaseFavoriteColor(const QString &text);
+    int getFavoriteColorIndex(quint64 id);
+    void releaseFavoriteColor(quint64 id);
     
     // Методы для маскирования элементов
-    void toggleMaskItem(const QString &text);
-    QString maskText(const QString &text) const;
-    
-    // Методы для шифрования
-    QByteArray encryptData(const QByteArray &data) const;
-    QByteArray decryptData(const QByteArray &data) const;
-    QByteArray getEncryptionKey() const;
+    void toggleMaskItem(quint64 id);
 
 private:
-    void rebuildMenu();
-    void loadHistory();
-    void saveHistory() const;
+    // Menu entry of a history item, reused while the item exists
+    struct MenuEntry {
+        QAction *action = nullptr;
+        bool isFavorite = false;
+        bool isMasked = false;
+        int colorIndex = -1;
+    };
+
+    void setupMenu();
+    // Brings the menu in line with orderedIds(), inserting, moving and
+    // updating only the actions that changed
+    void syncMenu();
+    MenuEntry createMenuEntry(const HistoryManager::HistoryItem &item);
+    void updateMenuEntry(MenuEntry &entry, const HistoryManager::HistoryItem &item);
+    void addClip(const QString &text);
+    void addContent(const ClipContent &content);
+    void activateItem(quint64 id, Qt::KeyboardModifiers modifiers);
+    void applyToggleFavorite(quint64 id);
+    void applyToggleMask(quint64 id);
+    void applyCompressionSettings();
+    void loadLegacyHistory();
+    // Re-encrypts the migrated history under a fresh key
+    void rekeyHistory();
+    void appendJournal(HistoryJournal::Op op, const HistoryManager::HistoryItem *item);
+    void compactJournal();
+    void removeHistoryFiles();
     QString settingsFilePath() const;
     QString historyFilePath() const;
+    QString legacyHistoryFilePath() const;
+    QString legacyMetadataFilePath() const;
+    QString journalFilePath() const;
+    QString blobsDirectoryPath() const;
+    QString traceFilePath() const;
     QString launchAgentPlistPath() const;
-    static QString formatMenuLabel(const QString &text);
 
     QSystemTrayIcon trayIcon;
     QMenu trayMenu;
 
-    bool ignoreNextClipboardChange = false;
-    QString lastClipboardText;
     bool exitHandled = false;
 
-    QTimer *clipboardPollTimer = nullptr;
+    ClipboardPoller *clipboardPoller = nullptr; // only where clipboard signals are unreliable
+    ClipboardWatcher *clipboardWatcher = nullptr;
+    ControlServer *controlServer = nullptr;
     SettingsManager *settingsManager = nullptr;
     HistoryManager *historyManager = nullptr;
     LaunchAgentManager *launchAgentManager = nullptr;
+    CryptoManager *cryptoManager = nullptr;
+    HistoryJournal *journal = nullptr;
+    SaveScheduler *saveScheduler = nullptr;
+    quint64 rotatedSequence = 0; // last record in the rotated journal segment
+    // Destroyed before the QObject children, so their threads are joined while cryptoManager is alive
+    std::unique_ptr<PersistenceWorker> persistence;
+    std::unique_ptr<ClipIngestor> clipIngestor;
+    std::unique_ptr<HistoryLoader> historyLoader; // only when history is saved
+    bool historyLoading = false; // until the loaded history is applied
+    HistoryModel *historyModel = nullptr;
+    // Top-level widget, so not a QObject child; destroyed before historyModel
+    std::unique_ptr<QuickPicker> quickPicker;
 
     QAction *titleAction = nullptr;
+    QAction *searchAction = nullptr;
     QAction *settingsAction = nullptr;
     QAction *quitAction = nullptr;
     QAction *clearHistoryAction = nullptr;
+    QAction *saveTraceAction = nullptr; // visible only while tracing
+    QAction *historySeparator = nullptr;
+    QAction *historyEndSeparator = nullptr;
+    QHash<quint64, MenuEntry> menuEntries; // id -> action
+    QVector<quint64> menuOrder;            // ids in the order they are in the menu
     
     // Цвета для иконок избранного
     static const QColor favoriteColors[8]; // 7 цветов + белый
     static int favoriteColorIndex;
-    QHash<QString, int> favoriteItemColors; // Сохраняем закрепленные цвета за элементами
-    QHash<QString, bool> maskedItems; // Сохраняем элементы которые нужно маскировать
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "Trace.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct Event {
+    const char *name = nullptr;
+    qint64 startNs = 0;
+    qint64 durationNs = 0;
+    qint64 value = -1;
+};
+
+// Кольцо одного потока; мьютекс захватывает только сам поток и выгрузка
+struct ThreadBuffer {
+    QMutex mutex;
+    QVector<Event> events;
+    quint64 written = 0;
+    quint64 threadId = 0;
+    QString threadName;
+};
+
+struct Registry {
+    QMutex mutex;
+    // Буфер переживает свой поток, чтобы спаны завершённых потоков попали в выгрузку
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+ThreadBuffer *threadBuffer()
+{
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    if (!buffer) {
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->events.resize(Trace::RingSize);
+        buffer->threadId = quint64(quintptr(QThread::currentThreadId()));
+        QThread *thread = QThread::currentThread();
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+            buffer->threadName = QStringLiteral("main");
+        } else if (thread && !thread->objectName().isEmpty()) {
+            buffer->threadName = thread->objectName();
+        } else {
+            buffer->threadName = QStringLiteral("thread %1").arg(buffer->threadId);
+        }
+
+        QMutexLocker locker(&registry().mutex);
+        registry().buffers.push_back(buffer);
+    }
+    return buffer.get();
+}
+
+} // namespace
+
+void Trace::setEnabled(bool enabled)
+{
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Trace::enabledByEnvironment()
+{
+    const QByteArray value = qgetenv("SMARTCLIP_TRACE");
+    return !value.isEmpty() && value != "0";
+}
+
+bool Trace::writeChromeTrace(const QString &filePath)
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+
+    QMutexLocker registryLocker(&registry().mutex);
+    for (const std::shared_ptr<ThreadBuffer> &buffer : registry().buffers) {
+        QMutexLocker locker(&buffer->mutex);
+
+        QJsonObject threadName;
+        threadName.insert(QStringLiteral("name"), QStringLiteral("thread_name"));
+        threadName.insert(QStringLiteral("ph"), QStringLiteral("M"));
+        threadName.insert(QStringLiteral("pid"), pid);
+        threadName.insert(QStringLiteral("tid"), qint64(buffer->threadId));
+        threadName.insert(QStringLiteral("args"), QJsonObject{{QStringLiteral("name"), buffer->threadName}});
+        events.append(threadName);
+
+        // Кольцо переполнено — начинаем с самого старого уцелевшего спана
+        const quint64 count = qMin<quint64>(buffer->written, RingSize);
+        for (quint64 i = buffer->written - count; i < buffer->written; ++i) {
+            const Event &event = buffer->events.at(int(i % RingSize));
+            QJsonObject span;
+            span.insert(QStringLiteral("name"), QLatin1String(event.name));
+            span.insert(QStringLiteral("cat"), QStringLiteral("smartclip"));
+            span.insert(QStringLiteral("ph"), QStringLiteral("X"));
+            span.insert(QStringLiteral("ts"), double(event.startNs) / 1000.0);
+            span.insert(QStringLiteral("dur"), double(event.durationNs) / 1000.0);
+            span.insert(QStringLiteral("pid"), pid);
+            span.insert(QStringLiteral("tid"), qint64(buffer->threadId));
+            if (event.value >= 0) {
+                span.insert(QStringLiteral("args"), QJsonObject{{QStringLiteral("n"), event.value}});
+            }
+            events.append(span);
+        }
+    }
+    registryLocker.unlock();
+
+    QJsonObject root;
+    root.insert(QStringLiteral("traceEvents"), events);
+    root.insert(QStringLiteral("displayTimeUnit"), QStringLiteral("ms"));
+
+    QDir().mkpath(QFileInfo(filePath).absolutePath());
+    QSaveFile f(filePath);
+    if (!f.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    f.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    return f.commit();
+}
+
+void Trace::clear()
+{
+    QMutexLocker registryLocker(&registry().mutex);
+    for (const std::shared_ptr<ThreadBuffer> &buffer : registry().buffers) {
+        QMutexLocker locker(&buffer->mutex);
+        buffer->written = 0;
+    }
+}
+
+qint64 Trace::now()
+{
+    // Общее начало отсчёта для всех потоков
+    static const QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed();
+}
+
+void Trace::record(const char *name, qint64 startNs, qint64 durationNs, qint64 value)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    QMutexLocker locker(&buffer->mutex);
+    Event &event = buffer->events[int(buffer->written % RingSize)];
+    event.name = name;
+    event.startNs = startNs;
+    event.durationNs = durationNs;
+    event.value = value;
+    ++buffer->written;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+
+// Scoped timing spans on hot paths, exported as Chrome trace JSON for
+// chrome://tracing or ui.perfetto.dev. While tracing is off a span costs one
+// relaxed atomic load. While it is on, every thread appends to its own ring
+// of the last RingSize spans, so a long session keeps bounded memory.
+//
+// Span names must be string literals and the optional value a count or a
+// size: nothing derived from clip contents is ever recorded.
+class Trace final
+{
+public:
+    static constexpr int RingSize = 16384;
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+    // SMARTCLIP_TRACE=1 in the environment
+    static bool enabledByEnvironment();
+    // Buffered spans of all threads, oldest first; false when the file
+    // could not be written
+    static bool writeChromeTrace(const QString &filePath);
+    static void clear();
+
+    class Span final
+    {
+    public:
+        explicit Span(const char *name, qint64 value = -1)
+            : m_name(isEnabled() ? name : nullptr)
+            , m_value(value)
+        {
+            if (m_name) {
+                m_startNs = now();
+            }
+        }
+        ~Span()
+        {
+            if (m_name) {
+                record(m_name, m_startNs, now() - m_startNs, m_value);
+            }
+        }
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+        // For values only known at the end of the span, e.g. items removed
+        void setValue(qint64 value) { m_value = value; }
+
+    private:
+        const char *m_name;
+        qint64 m_value;
+        qint64 m_startNs = 0;
+    };
+
+private:
+    static qint64 now();
+    static void record(const char *name, qint64 startNs, qint64 durationNs, qint64 value);
+
+    static inline std::atomic<bool> s_enabled{false};
+};
+
+#define SMARTCLIP_TRACE_JOIN2(a, b) a##b
+#define SMARTCLIP_TRACE_JOIN(a, b) SMARTCLIP_TRACE_JOIN2(a, b)
+// SMARTCLIP_TRACE("name") or SMARTCLIP_TRACE("name", value) spans the rest of the scope
+#define SMARTCLIP_TRACE(...) const Trace::Span SMARTCLIP_TRACE_JOIN(traceSpan_, __LINE__)(__VA_ARGS__)
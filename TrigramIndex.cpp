@@ -0,0 +1,172 @@
+#include "TrigramIndex.h"
+#include <algorithm>
+
+void TrigramIndex::insert(quint64 id, const QString &text)
+{
+    if (m_texts.contains(id)) {
+        remove(id);
+    }
+
+    const QString folded = fold(text);
+    m_texts.insert(id, folded);
+
+    QVector<Trigram> grams = trigrams(folded);
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    for (Trigram trigram : grams) {
+        addPosting(trigram, id);
+    }
+}
+
+void TrigramIndex::remove(quint64 id)
+{
+    // Списки не трогаем: мёртвые id отсеются при поиске и уйдут при уплотнении
+    if (m_texts.remove(id) == 0) {
+        return;
+    }
+    ++m_dead;
+    if (m_dead > 1024 && m_dead > m_texts.size()) {
+        compact();
+    }
+}
+
+void TrigramIndex::clear()
+{
+    m_postings.clear();
+    m_texts.clear();
+    m_dead = 0;
+}
+
+bool TrigramIndex::contains(quint64 id) const
+{
+    return m_texts.contains(id);
+}
+
+int TrigramIndex::size() const
+{
+    return int(m_texts.size());
+}
+
+QVector<quint64> TrigramIndex::search(const QString &query) const
+{
+    QVector<quint64> result;
+    const QString folded = fold(query);
+    if (folded.isEmpty()) {
+        return result;
+    }
+
+    // Короткие запросы вызывающий обходит сам: полный перебор текстов здесь
+    // стоил бы O(n) символов на запрос
+    QVector<Trigram> grams = trigrams(folded);
+    if (grams.isEmpty()) {
+        return result;
+    }
+
+    // Пересекаем списки начиная с самого короткого
+    QVector<const QVector<quint64> *> lists;
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    for (Trigram trigram : grams) {
+        const auto it = m_postings.constFind(trigram);
+        if (it == m_postings.cend()) {
+            return result;
+        }
+        lists.push_back(&it.value());
+    }
+    std::sort(lists.begin(), lists.end(), [](const QVector<quint64> *a, const QVector<quint64> *b) {
+        return a->size() < b->size();
+    });
+
+    QVector<quint64> candidates = *lists.first();
+    for (int i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+        const QVector<quint64> &list = *lists.at(i);
+        QVector<quint64> next;
+        next.reserve(candidates.size());
+        auto pos = list.cbegin();
+        for (quint64 id : candidates) {
+            // Двоичный поиск от предыдущей позиции: кандидатов обычно намного меньше
+            pos = std::lower_bound(pos, list.cend(), id);
+            if (pos == list.cend()) {
+                break;
+            }
+            if (*pos == id) {
+                next.push_back(id);
+            }
+        }
+        candidates.swap(next);
+    }
+
+    // Триграммы дают только кандидатов: подстроку подтверждаем по тексту
+    result.reserve(candidates.size());
+    for (quint64 id : candidates) {
+        const auto it = m_texts.constFind(id);
+        if (it != m_texts.cend() && it.value().contains(folded)) {
+            result.push_back(id);
+        }
+    }
+    return result;
+}
+
+qsizetype TrigramIndex::matchPosition(quint64 id, const QString &foldedQuery) const
+{
+    const auto it = m_texts.constFind(id);
+    return (it != m_texts.cend()) ? it.value().indexOf(foldedQuery) : -1;
+}
+
+bool TrigramIndex::covers(const QString &foldedQuery)
+{
+    // Три кодовые точки занимают от трёх до шести единиц UTF-16
+    if (foldedQuery.size() >= 6) {
+        return true;
+    }
+    return foldedQuery.toUcs4().size() >= 3;
+}
+
+QString TrigramIndex::fold(const QString &text)
+{
+    return text.toCaseFolded();
+}
+
+QVector<TrigramIndex::Trigram> TrigramIndex::trigrams(const QString &folded)
+{
+    // По кодовым точкам, а не по UTF-16: суррогатная пара — один символ
+    const QList<uint> points = folded.toUcs4();
+    QVector<Trigram> grams;
+    if (points.size() < 3) {
+        return grams;
+    }
+    grams.reserve(points.size() - 2);
+    for (qsizetype i = 0; i + 2 < points.size(); ++i) {
+        grams.push_back((Trigram(points.at(i)) << 42) | (Trigram(points.at(i + 1)) << 21) | Trigram(points.at(i + 2)));
+    }
+    return grams;
+}
+
+void TrigramIndex::addPosting(Trigram trigram, quint64 id)
+{
+    QVector<quint64> &list = m_postings[trigram];
+    if (list.isEmpty() || list.last() < id) {
+        list.push_back(id); // Обычный случай: новые id растут
+        return;
+    }
+    const auto pos = std::lower_bound(list.begin(), list.end(), id);
+    if (pos == list.end() || *pos != id) {
+        list.insert(pos, id);
+    }
+}
+
+void TrigramIndex::compact()
+{
+    for (auto it = m_postings.begin(); it != m_postings.end();) {
+        QVector<quint64> &list = it.value();
+        list.erase(std::remove_if(list.begin(), list.end(), [this](quint64 id) {
+            return !m_texts.contains(id);
+        }), list.end());
+        if (list.isEmpty()) {
+            it = m_postings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_dead = 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Inverted index from trigrams of case-folded code points to item ids, for
+// case-insensitive substring search. Candidates come from intersecting the
+// posting lists of the query's trigrams and are confirmed against the
+// indexed text, so results are exact.
+//
+// Ids must be inserted in increasing order to keep posting lists sorted;
+// out-of-order inserts are supported but cost a sorted insert. Removal only
+// drops the text and leaves a tombstone in the postings, which are compacted
+// once the dead ids outnumber the live ones.
+class TrigramIndex final
+{
+public:
+    void insert(quint64 id, const QString &text);
+    void remove(quint64 id);
+    void clear();
+    bool contains(quint64 id) const;
+    int size() const;
+
+    // Ids whose text contains query, in increasing id order. Queries the
+    // index cannot serve (see covers()) return nothing.
+    QVector<quint64> search(const QString &query) const;
+    // Whether an already folded query is long enough to have a trigram
+    static bool covers(const QString &foldedQuery);
+    // Position of an already folded query in the indexed text of id, -1 if absent
+    qsizetype matchPosition(quint64 id, const QString &foldedQuery) const;
+
+    static QString fold(const QString &text);
+
+private:
+    using Trigram = quint64; // three 21-bit code points
+
+    static QVector<Trigram> trigrams(const QString &folded);
+    void addPosting(Trigram trigram, quint64 id);
+    void compact();
+
+    QHash<Trigram, QVector<quint64>> m_postings;
+    QHash<quint64, QString> m_texts; // folded text of live ids
+    int m_dead = 0;
+};
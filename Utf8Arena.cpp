@@ -0,0 +1,202 @@
+#include "Utf8Arena.h"
+#include <cstring>
+
+namespace {
+
+// Меньше этого мёртвого места не уплотняем: копирование дороже выигрыша
+const qint64 kMinCompactBytes = 256 * 1024;
+
+} // namespace
+
+Utf8Arena::Handle Utf8Arena::store(QByteArrayView bytes)
+{
+    const qsizetype size = bytes.size();
+    if (size == 0) {
+        return Null;
+    }
+
+    int chunk = -1;
+    if (size > ChunkSize / 4) {
+        // Крупное тело — отдельный блок: при уплотнении его не копируем
+        chunk = newChunk(size, true);
+    } else {
+        if (m_current < 0 || m_chunks[m_current].capacity - m_chunks[m_current].used < size) {
+            m_current = newChunk(ChunkSize, false);
+        }
+        chunk = m_current;
+        m_packedUsed += size;
+    }
+
+    Chunk &target = m_chunks[chunk];
+    Span span;
+    span.chunk = chunk;
+    span.offset = target.used;
+    span.size = size;
+    std::memcpy(target.data.get() + span.offset, bytes.data(), size_t(size));
+    target.used += size;
+    target.live += size;
+    m_liveBytes += size;
+
+    if (!m_freeHandles.isEmpty()) {
+        const Handle handle = m_freeHandles.takeLast();
+        m_spans[handle - 1] = span;
+        return handle;
+    }
+    m_spans.push_back(span);
+    return Handle(m_spans.size());
+}
+
+void Utf8Arena::release(Handle handle)
+{
+    const Span *found = span(handle);
+    if (!found) {
+        return;
+    }
+
+    const Span released = *found;
+    m_spans[handle - 1] = Span();
+    m_freeHandles.push_back(handle);
+    m_liveBytes -= released.size;
+
+    Chunk &chunk = m_chunks[released.chunk];
+    chunk.live -= released.size;
+    if (chunk.dedicated) {
+        freeChunk(released.chunk);
+        return;
+    }
+
+    m_packedDead += released.size;
+    if (chunk.live == 0 && released.chunk != m_current) {
+        // Целиком мёртвый блок освобождаем сразу, не дожидаясь уплотнения
+        m_packedDead -= chunk.used;
+        m_packedUsed -= chunk.used;
+        freeChunk(released.chunk);
+    }
+    if (m_packedDead >= kMinCompactBytes && m_packedDead * 2 > m_packedUsed) {
+        compact();
+    }
+}
+
+void Utf8Arena::clear()
+{
+    m_chunks.clear();
+    m_freeChunks.clear();
+    m_spans.clear();
+    m_freeHandles.clear();
+    m_current = -1;
+    m_liveBytes = 0;
+    m_packedUsed = 0;
+    m_packedDead = 0;
+}
+
+QByteArrayView Utf8Arena::view(Handle handle) const
+{
+    const Span *found = span(handle);
+    if (!found) {
+        return QByteArrayView();
+    }
+    return QByteArrayView(m_chunks[found->chunk].data.get() + found->offset, found->size);
+}
+
+QByteArray Utf8Arena::bytes(Handle handle) const
+{
+    return view(handle).toByteArray();
+}
+
+QString Utf8Arena::toString(Handle handle) const
+{
+    return QString::fromUtf8(view(handle));
+}
+
+qsizetype Utf8Arena::size(Handle handle) const
+{
+    const Span *found = span(handle);
+    return found ? found->size : 0;
+}
+
+void Utf8Arena::compact()
+{
+    // Живые тела из упакованных блоков переезжают подряд в новые блоки;
+    // отдельные блоки крупных тел остаются на месте
+    std::vector<Chunk> old;
+    old.swap(m_chunks);
+    m_freeChunks.clear();
+    m_current = -1;
+    m_packedUsed = 0;
+    m_packedDead = 0;
+
+    QVector<int> movedDedicated(int(old.size()), -1);
+    for (int i = 0; i < int(old.size()); ++i) {
+        if (old[i].data && old[i].dedicated) {
+            movedDedicated[i] = int(m_chunks.size());
+            m_chunks.push_back(std::move(old[i]));
+        }
+    }
+
+    for (Span &span : m_spans) {
+        if (span.chunk < 0) {
+            continue;
+        }
+        if (movedDedicated.at(span.chunk) >= 0) {
+            span.chunk = movedDedicated.at(span.chunk);
+            continue;
+        }
+        if (m_current < 0 || m_chunks[m_current].capacity - m_chunks[m_current].used < span.size) {
+            m_current = newChunk(ChunkSize, false);
+        }
+        Chunk &target = m_chunks[m_current];
+        std::memcpy(target.data.get() + target.used, old[span.chunk].data.get() + span.offset, size_t(span.size));
+        span.chunk = m_current;
+        span.offset = target.used;
+        target.used += span.size;
+        target.live += span.size;
+        m_packedUsed += span.size;
+    }
+    ++m_compactions;
+}
+
+Utf8Arena::Stats Utf8Arena::stats() const
+{
+    Stats stats;
+    for (const Chunk &chunk : m_chunks) {
+        if (chunk.data) {
+            ++stats.chunks;
+            stats.reservedBytes += chunk.capacity;
+        }
+    }
+    stats.spans = int(m_spans.size() - m_freeHandles.size());
+    stats.liveBytes = m_liveBytes;
+    stats.compactions = m_compactions;
+    return stats;
+}
+
+int Utf8Arena::newChunk(qsizetype capacity, bool dedicated)
+{
+    Chunk chunk;
+    chunk.data.reset(new char[size_t(capacity)]);
+    chunk.capacity = capacity;
+    chunk.dedicated = dedicated;
+
+    if (!m_freeChunks.isEmpty()) {
+        const int index = m_freeChunks.takeLast();
+        m_chunks[index] = std::move(chunk);
+        return index;
+    }
+    m_chunks.push_back(std::move(chunk));
+    return int(m_chunks.size()) - 1;
+}
+
+void Utf8Arena::freeChunk(int index)
+{
+    m_chunks[index] = Chunk();
+    m_freeChunks.push_back(index);
+}
+
+const Utf8Arena::Span *Utf8Arena::span(Handle handle) const
+{
+    if (handle == Null || handle > Handle(m_spans.size())) {
+        return nullptr;
+    }
+    const Span &found = m_spans.at(handle - 1);
+    return (found.chunk >= 0) ? &found : nullptr;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+// Bump allocator for clip bodies. Bodies are copied back to back into 1 MB
+// chunks instead of getting one heap block each, so 50k small clips cost
+// about fifty allocations rather than 50k. Bodies larger than a quarter of
+// a chunk get a chunk of their own, which is freed as soon as they are.
+//
+// Handles stay valid across compaction, which repacks live bodies once
+// more than half of the packed chunks is dead space left by releases.
+// Views are only valid until the next store() or release().
+//
+// The bytes are UTF-8 text or its zlib-compressed form; QString is only
+// produced by toString() at the UI boundary.
+class Utf8Arena final
+{
+public:
+    using Handle = quint32;
+    static constexpr Handle Null = 0;
+    static constexpr qsizetype ChunkSize = 1024 * 1024;
+
+    struct Stats {
+        int chunks = 0;          // heap blocks held, packed and dedicated
+        int spans = 0;           // live bodies
+        qint64 liveBytes = 0;
+        qint64 reservedBytes = 0; // capacity of all chunks
+        quint64 compactions = 0;
+    };
+
+    Utf8Arena() = default;
+    Utf8Arena(const Utf8Arena &) = delete;
+    Utf8Arena &operator=(const Utf8Arena &) = delete;
+
+    Handle store(QByteArrayView bytes);
+    void release(Handle handle);
+    void clear();
+
+    QByteArrayView view(Handle handle) const;
+    QByteArray bytes(Handle handle) const;
+    QString toString(Handle handle) const;
+    qsizetype size(Handle handle) const;
+
+    // Repacks live bodies into as few chunks as possible
+    void compact();
+    Stats stats() const;
+
+private:
+    struct Span {
+        int chunk = -1; // -1 for a free handle
+        qsizetype offset = 0;
+        qsizetype size = 0;
+    };
+    struct Chunk {
+        std::unique_ptr<char[]> data; // null for a freed slot
+        qsizetype capacity = 0;
+        qsizetype used = 0;
+        qsizetype live = 0;
+        bool dedicated = false;
+    };
+
+    int newChunk(qsizetype capacity, bool dedicated);
+    void freeChunk(int index);
+    const Span *span(Handle handle) const;
+
+    std::vector<Chunk> m_chunks;
+    QVector<int> m_freeChunks;   // indices of freed chunk slots
+    QVector<Span> m_spans;       // handle - 1 -> span
+    QVector<Handle> m_freeHandles;
+    int m_current = -1;          // packed chunk being filled
+    qint64 m_liveBytes = 0;
+    qint64 m_packedUsed = 0;     // bytes handed out from packed chunks
+    qint64 m_packedDead = 0;     // of those, released since the last compaction
+    quint64 m_compactions = 0;
+};
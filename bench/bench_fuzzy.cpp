@@ -0,0 +1,84 @@
+// Measures fuzzy scoring of 100k clip previews per keystroke, the cost the
+// picker pays while the user types. "serial" runs FuzzyMatcher over every
+// preview on one thread; "search" is HistoryManager::fuzzySearch, which
+// scores in parallel and ranks the top 50. The utf16 corpus has Cyrillic
+// text and takes the scalar path.
+
+#include "../FuzzyMatcher.h"
+#include "../HistoryManager.h"
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+#include <QThreadPool>
+#include <QVector>
+
+namespace {
+
+QString clipText(int i, bool utf16)
+{
+    static const QStringList words = {
+        QStringLiteral("SmartClipApp"), QStringLiteral("history_manager"), QStringLiteral("git commit -m"),
+        QStringLiteral("https://example.com/path?q="), QStringLiteral("SELECT * FROM clips"),
+        QStringLiteral("QClipboard::dataChanged"), QStringLiteral("lorem ipsum dolor"),
+    };
+    QString text = words.at(i % words.size()) + QLatin1Char(' ') + QString::number(i * 7919);
+    if (utf16) {
+        text += QStringLiteral(" Буфер обмена");
+    }
+    return text + QLatin1Char(' ') + words.at((i / 7) % words.size());
+}
+
+} // namespace
+
+int main()
+{
+    QTextStream out(stdout);
+    out << "# scan: " << FuzzyMatcher::implementation()
+        << ", threads: " << QThreadPool::globalInstance()->maxThreadCount() << '\n';
+    out << "corpus,pattern,matches,serial_ms,search_ms\n";
+
+    const int n = 100000;
+    const int runs = 10;
+    const QString typed = QStringLiteral("hstmgr");
+
+    for (bool utf16 : {false, true}) {
+        HistoryManager manager;
+        manager.setMaxItems(n);
+        for (int i = 0; i < n; ++i) {
+            manager.addToHistory(clipText(i, utf16));
+        }
+        const QVector<HistoryManager::HistoryItem> items = manager.snapshot();
+
+        // По одному замеру на каждое нажатие клавиши
+        for (int length = 1; length <= typed.size(); ++length) {
+            const QString pattern = typed.left(length);
+
+            QElapsedTimer timer;
+            int matches = 0;
+            timer.start();
+            for (int run = 0; run < runs; ++run) {
+                const FuzzyMatcher matcher(pattern);
+                matches = 0;
+                for (const auto &item : items) {
+                    if (matcher.score(item.preview) != FuzzyMatcher::NoMatch) {
+                        ++matches;
+                    }
+                }
+            }
+            const double serialMs = double(timer.nsecsElapsed()) / runs / 1e6;
+
+            timer.restart();
+            for (int run = 0; run < runs; ++run) {
+                manager.fuzzySearch(pattern);
+            }
+            const double searchMs = double(timer.nsecsElapsed()) / runs / 1e6;
+
+            out << (utf16 ? "utf16" : "latin1") << ',' << pattern << ',' << matches << ','
+                << serialMs << ',' << searchMs << '\n';
+        }
+    }
+
+    return 0;
+}
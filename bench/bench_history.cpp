@@ -0,0 +1,90 @@
+// Measures HistoryManager mutation cost as the history grows.
+// A flat ns/op column across sizes means the operation does not depend on n.
+
+#include "../HistoryManager.h"
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QTextStream>
+#include <QVector>
+
+namespace {
+
+QString clipText(int i)
+{
+    return QStringLiteral("clip #%1 ").arg(i).repeated(1 + i % 4);
+}
+
+void fill(HistoryManager &manager, int n)
+{
+    manager.setMaxItems(n);
+    for (int i = 0; i < n; ++i) {
+        manager.addToHistory(clipText(i));
+    }
+}
+
+double nsPerOp(const QElapsedTimer &timer, int ops)
+{
+    return double(timer.nsecsElapsed()) / qMax(ops, 1);
+}
+
+} // namespace
+
+int main()
+{
+    QTextStream out(stdout);
+    out << "n,add_new_ns,add_existing_ns,usage_ns,favorite_ns,search_ns,trim_half_ns_per_item\n";
+
+    const QVector<int> sizes = {100, 1000, 10000, 100000};
+    const int ops = 1000;
+
+    for (int n : sizes) {
+        HistoryManager manager;
+        fill(manager, n);
+
+        QElapsedTimer timer;
+
+        // Новые элементы: вставка + вытеснение самого старого
+        timer.start();
+        for (int i = 0; i < ops; ++i) {
+            manager.addToHistory(clipText(n + i));
+        }
+        const double addNew = nsPerOp(timer, ops);
+
+        // Повторное копирование уже существующего текста
+        timer.restart();
+        for (int i = 0; i < ops; ++i) {
+            manager.addToHistory(clipText(n + (i % ops)));
+        }
+        const double addExisting = nsPerOp(timer, ops);
+
+        timer.restart();
+        for (int i = 0; i < ops; ++i) {
+            manager.incrementUsageCount(clipText(n + (i % ops)));
+        }
+        const double usage = nsPerOp(timer, ops);
+
+        timer.restart();
+        for (int i = 0; i < ops; ++i) {
+            manager.toggleFavorite(clipText(n + (i % ops)));
+        }
+        const double favorite = nsPerOp(timer, ops);
+
+        // Подстрока из середины истории; первый поиск строит индекс и не считается
+        manager.search(QStringLiteral("warm-up"));
+        timer.restart();
+        for (int i = 0; i < ops; ++i) {
+            manager.search(QStringLiteral("#%1 ").arg(n / 2 + i));
+        }
+        const double search = nsPerOp(timer, ops);
+
+        timer.restart();
+        manager.setMaxItems(n / 2);
+        const double trim = nsPerOp(timer, n - n / 2);
+
+        out << n << ',' << addNew << ',' << addExisting << ',' << usage << ','
+            << favorite << ',' << search << ',' << trim << '\n';
+    }
+
+    return 0;
+}
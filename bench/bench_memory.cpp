@@ -0,0 +1,165 @@
+// Measures memory held by a synthetic 50k-clip history: live heap blocks,
+// total allocation calls, peak RSS and the arena that holds clip bodies.
+// "filled" is after the first 50k copies, "churned" after another 50k that
+// evict as many, "trimmed" after cutting the history to 5k clips.
+// peak_rss_kb only ever grows, so compare the same phase across builds.
+//
+// Heap counters come from malloc interposition on glibc and from the
+// default zone on macOS; elsewhere they print as -1.
+
+#include "../HistoryManager.h"
+
+#include <QString>
+#include <QTextStream>
+#include <atomic>
+
+#if defined(Q_OS_MACOS)
+#include <malloc/malloc.h>
+#endif
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+std::atomic<qint64> g_allocations{0};
+std::atomic<qint64> g_liveBlocks{0};
+
+} // namespace
+
+#if defined(__GLIBC__)
+// Счётчики поверх malloc из glibc; Qt выделяет строки именно через malloc
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    void *ptr = __libc_malloc(size);
+    if (ptr) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_liveBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+void *calloc(size_t count, size_t size)
+{
+    void *ptr = __libc_calloc(count, size);
+    if (ptr) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        g_liveBlocks.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    void *moved = __libc_realloc(ptr, size);
+    if (!ptr && moved) {
+        g_liveBlocks.fetch_add(1, std::memory_order_relaxed);
+    } else if (ptr && size == 0) {
+        g_liveBlocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+    if (moved) {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return moved;
+}
+
+void free(void *ptr)
+{
+    if (ptr) {
+        g_liveBlocks.fetch_sub(1, std::memory_order_relaxed);
+    }
+    __libc_free(ptr);
+}
+} // extern "C"
+#endif
+
+namespace {
+
+const int kClips = 50000;
+
+// От коротких строк до абзацев в несколько килобайт, как в живой истории
+QString clipText(int i)
+{
+    const QString line = QStringLiteral("clip %1: the quick brown fox jumps over the lazy dog ").arg(i);
+    return line.repeated(1 + (i * 7) % 40);
+}
+
+qint64 liveBlocks()
+{
+#if defined(__GLIBC__)
+    return g_liveBlocks.load();
+#elif defined(Q_OS_MACOS)
+    malloc_statistics_t stats;
+    malloc_zone_statistics(nullptr, &stats);
+    return qint64(stats.blocks_in_use);
+#else
+    return -1;
+#endif
+}
+
+qint64 allocations()
+{
+#if defined(__GLIBC__)
+    return g_allocations.load();
+#else
+    return -1;
+#endif
+}
+
+qint64 peakRssKb()
+{
+#if defined(Q_OS_UNIX)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(Q_OS_MACOS)
+    return qint64(usage.ru_maxrss) / 1024; // На macOS ru_maxrss в байтах
+#else
+    return qint64(usage.ru_maxrss);
+#endif
+#else
+    return -1;
+#endif
+}
+
+void report(QTextStream &out, const char *phase, const HistoryManager &manager)
+{
+    const BlobStore::Stats blobs = manager.compressionStats();
+    out << phase << ',' << manager.size() << ',' << liveBlocks() << ',' << allocations() << ','
+        << peakRssKb() << ',' << blobs.chunks << ',' << blobs.reservedBytes / 1024 << ','
+        << blobs.residentBytes / 1024 << '\n';
+    out.flush();
+}
+
+} // namespace
+
+int main()
+{
+    QTextStream out(stdout);
+    out << "phase,clips,live_blocks,allocations,peak_rss_kb,arena_chunks,arena_reserved_kb,resident_kb\n";
+
+    HistoryManager manager;
+    manager.setMaxItems(kClips);
+    report(out, "start", manager);
+
+    for (int i = 0; i < kClips; ++i) {
+        manager.addToHistory(clipText(i));
+    }
+    report(out, "filled", manager);
+
+    // Каждый новый клип вытесняет самый старый
+    for (int i = kClips; i < 2 * kClips; ++i) {
+        manager.addToHistory(clipText(i));
+    }
+    report(out, "churned", manager);
+
+    manager.setMaxItems(kClips / 10);
+    report(out, "trimmed", manager);
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Measures snapshot save cost: HistoryStorage::write into a QSaveFile.
+// Reports mean and worst-case latency over several runs and the throughput
+// of the written file.
+
+#include "../CryptoManager.h"
+#include "../HistoryManager.h"
+#include "../HistoryStorage.h"
+
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QString>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+
+namespace {
+
+QString clipText(int i)
+{
+    return QStringLiteral("{\"clip\": %1, \"payload\": \"%2\"}\n").arg(i).arg(QString(40 + i % 200, QLatin1Char('x')));
+}
+
+} // namespace
+
+int main()
+{
+    // Ключ и файлы создаются во временном каталоге, а не в ~/.smartclip
+    QTemporaryDir home;
+    if (!home.isValid()) {
+        return 1;
+    }
+    qputenv("HOME", home.path().toLocal8Bit());
+
+    const CryptoManager crypto;
+    const QString path = home.filePath(QStringLiteral("history.bin"));
+
+    QTextStream out(stdout);
+    out << "n,file_bytes,mean_ms,max_ms,mb_per_s\n";
+
+    const QVector<int> sizes = {100, 1000, 10000, 100000};
+    const int runs = 10;
+
+    for (int n : sizes) {
+        HistoryManager manager;
+        manager.setMaxItems(n);
+        for (int i = 0; i < n; ++i) {
+            manager.addToHistory(clipText(i));
+        }
+        const QVector<HistoryManager::HistoryItem> items = manager.snapshot();
+
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+        QElapsedTimer timer;
+        for (int run = 0; run < runs; ++run) {
+            timer.start();
+            if (!HistoryStorage::write(path, items, &crypto, 0)) {
+                return 1;
+            }
+            const qint64 ns = timer.nsecsElapsed();
+            totalNs += ns;
+            maxNs = qMax(maxNs, ns);
+        }
+
+        const qint64 bytes = QFileInfo(path).size();
+        const double meanMs = double(totalNs) / runs / 1e6;
+        out << n << ',' << bytes << ',' << meanMs << ',' << double(maxNs) / 1e6 << ','
+            << (meanMs > 0 ? double(bytes) / (1024.0 * 1024.0) / (meanMs / 1000.0) : 0.0) << '\n';
+    }
+
+    return 0;
+}
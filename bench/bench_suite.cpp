@@ -0,0 +1,309 @@
+// Benchmark suite over smartclip_core: history mutations, snapshot load and
+// save, and encryption, at 1k, 10k and 100k items and for clips from 10 B to
+// 10 MB. Runs without a tray or a display.
+//
+// Output is JSON Lines on stdout: one metadata object, then one object per
+// case with per-operation times over the timed runs:
+//   {"benchmark":"add_to_history","items":10000,"clip_bytes":1024,"ops":1000,
+//    "runs":7,"median_ns":812,"min_ns":790,"max_ns":901}
+// save and load also report the snapshot size as "bytes".
+//
+// Clip contents come from fixed seeds and every case starts with one untimed
+// warm-up run, so two runs of the same build see identical work.
+//   --filter <text>  only cases whose benchmark name contains text
+//   --runs <n>       timed runs per case, 7 by default
+
+#include "../CryptoManager.h"
+#include "../HistoryManager.h"
+#include "../HistoryStorage.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+const QVector<int> kItemCounts = {1000, 10000, 100000};
+const QVector<qint64> kClipSizes = {10, 1024, 100 * 1024, 10 * 1024 * 1024};
+// Фоновые клипы, которыми заполняется история перед замером
+const qint64 kBackgroundClipBytes = 64;
+
+// Детерминированный печатный текст заданной длины; разные seed — разные тела
+QString clipText(quint32 seed, qint64 bytes)
+{
+    QString text = QString::number(seed) + QLatin1Char(':');
+    text.reserve(qMax<qint64>(bytes, text.size()));
+    quint32 state = seed * 2654435761u + 1;
+    while (text.size() < bytes) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        text += QLatin1Char(char(' ' + state % 95));
+    }
+    return text;
+}
+
+void fill(HistoryManager &manager, int items, quint32 firstSeed)
+{
+    manager.setMaxItems(items);
+    for (int i = 0; i < items; ++i) {
+        manager.addToHistory(clipText(firstSeed + quint32(i), kBackgroundClipBytes), 1000 + i);
+    }
+}
+
+// Крупные тела: операций меньше, чтобы один случай не шёл минутами
+int opsFor(qint64 clipBytes, int fewOps, int manyOps)
+{
+    return clipBytes >= 1024 * 1024 ? 3 : clipBytes >= 100 * 1024 ? fewOps : manyOps;
+}
+
+class Suite
+{
+public:
+    Suite(QTextStream &out, const QString &filter, int runs)
+        : m_out(out)
+        , m_filter(filter)
+        , m_runs(runs)
+    {
+    }
+
+    bool selected(const char *name) const
+    {
+        return m_filter.isEmpty() || QLatin1String(name).contains(m_filter);
+    }
+
+    // run(index) returns the elapsed ns of its timed part; index -1 is the warm-up
+    void measure(const char *name, int items, qint64 clipBytes, int ops,
+                 const std::function<qint64(int)> &run, qint64 bytes = -1)
+    {
+        run(-1);
+        QVector<double> perOp;
+        for (int i = 0; i < m_runs; ++i) {
+            perOp.push_back(double(run(i)) / qMax(ops, 1));
+        }
+        std::sort(perOp.begin(), perOp.end());
+
+        QJsonObject result;
+        result.insert(QStringLiteral("benchmark"), QLatin1String(name));
+        result.insert(QStringLiteral("items"), items);
+        result.insert(QStringLiteral("clip_bytes"), clipBytes);
+        result.insert(QStringLiteral("ops"), ops);
+        result.insert(QStringLiteral("runs"), m_runs);
+        result.insert(QStringLiteral("median_ns"), qRound64(perOp.at(perOp.size() / 2)));
+        result.insert(QStringLiteral("min_ns"), qRound64(perOp.first()));
+        result.insert(QStringLiteral("max_ns"), qRound64(perOp.last()));
+        if (bytes >= 0) {
+            result.insert(QStringLiteral("bytes"), bytes);
+        }
+        emitLine(result);
+    }
+
+    void emitLine(const QJsonObject &object)
+    {
+        m_out << QJsonDocument(object).toJson(QJsonDocument::Compact) << '\n';
+        m_out.flush();
+    }
+
+private:
+    QTextStream &m_out;
+    QString m_filter;
+    int m_runs;
+};
+
+void benchAdd(Suite &suite)
+{
+    // Новые клипы в заполненную историю: вставка плюс вытеснение самого старого.
+    // Крупные клипы меряются на 1k элементов, иначе история не влезет в память
+    for (int items : kItemCounts) {
+        for (qint64 clipBytes : kClipSizes) {
+            if (clipBytes > 1024 && items != kItemCounts.first()) {
+                continue;
+            }
+            const int ops = opsFor(clipBytes, 20, 1000);
+            HistoryManager manager;
+            fill(manager, items, 0);
+            suite.measure("add_to_history", items, clipBytes, ops, [&](int run) {
+                QVector<QString> texts;
+                for (int i = 0; i < ops; ++i) {
+                    texts.push_back(clipText(quint32(1000000 + (run + 1) * ops + i), clipBytes));
+                }
+                QElapsedTimer timer;
+                timer.start();
+                for (const QString &text : std::as_const(texts)) {
+                    manager.addToHistory(text);
+                }
+                return timer.nsecsElapsed();
+            });
+        }
+    }
+}
+
+void benchSort(Suite &suite)
+{
+    for (int items : kItemCounts) {
+        HistoryManager manager;
+        fill(manager, items, 0);
+        // Полная перестройка порядка и обход его целиком
+        suite.measure("sort_history", items, kBackgroundClipBytes, 1, [&](int) {
+            QElapsedTimer timer;
+            timer.start();
+            manager.sortHistory();
+            manager.orderedIds();
+            return timer.nsecsElapsed();
+        });
+    }
+}
+
+void benchTrim(Suite &suite)
+{
+    for (int items : kItemCounts) {
+        const int removed = items - items / 2;
+        suite.measure("trim_to_max_items", items, kBackgroundClipBytes, removed, [&](int) {
+            HistoryManager manager;
+            fill(manager, items, 0);
+            QElapsedTimer timer;
+            timer.start();
+            manager.setMaxItems(items / 2);
+            return timer.nsecsElapsed();
+        });
+    }
+}
+
+void benchPersistence(Suite &suite, const CryptoManager &crypto, const QString &path)
+{
+    // В снимок попадают только превью, так что размер клипа важен до 1 KB
+    for (int items : kItemCounts) {
+        for (qint64 clipBytes : {qint64(10), qint64(1024)}) {
+            HistoryManager manager;
+            manager.setMaxItems(items);
+            for (int i = 0; i < items; ++i) {
+                manager.addToHistory(clipText(quint32(i), clipBytes), 1000 + i);
+            }
+            const QVector<HistoryManager::HistoryItem> snapshot = manager.snapshot();
+            if (!HistoryStorage::write(path, snapshot, &crypto, 0)) {
+                return;
+            }
+            const qint64 fileBytes = QFileInfo(path).size();
+
+            if (suite.selected("save")) {
+                suite.measure("save", items, clipBytes, 1, [&](int) {
+                    QElapsedTimer timer;
+                    timer.start();
+                    HistoryStorage::write(path, snapshot, &crypto, 0);
+                    return timer.nsecsElapsed();
+                }, fileBytes);
+            }
+            if (suite.selected("load")) {
+                // Как при запуске: расшифровка чанков и восстановление элементов
+                suite.measure("load", items, clipBytes, 1, [&](int) {
+                    QElapsedTimer timer;
+                    timer.start();
+                    HistoryStorage storage(path, &crypto);
+                    HistoryManager loaded;
+                    loaded.setMaxItems(items);
+                    if (storage.open()) {
+                        loaded.bulkLoad(storage.items());
+                    }
+                    return timer.nsecsElapsed();
+                }, fileBytes);
+            }
+        }
+    }
+}
+
+void benchCrypto(Suite &suite, const CryptoManager &crypto)
+{
+    for (qint64 clipBytes : kClipSizes) {
+        const int ops = opsFor(clipBytes, 100, 10000);
+        const QByteArray plain = clipText(7, clipBytes).toUtf8();
+        const QByteArray sealed = crypto.encrypt(plain);
+
+        if (suite.selected("encrypt")) {
+            suite.measure("encrypt", 0, clipBytes, ops, [&](int) {
+                QElapsedTimer timer;
+                timer.start();
+                for (int i = 0; i < ops; ++i) {
+                    crypto.encrypt(plain);
+                }
+                return timer.nsecsElapsed();
+            });
+        }
+        if (suite.selected("decrypt")) {
+            suite.measure("decrypt", 0, clipBytes, ops, [&](int) {
+                QElapsedTimer timer;
+                timer.start();
+                for (int i = 0; i < ops; ++i) {
+                    crypto.decrypt(sealed);
+                }
+                return timer.nsecsElapsed();
+            });
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption filterOption(QStringLiteral("filter"),
+                                          QStringLiteral("Run only benchmarks whose name contains <text>."),
+                                          QStringLiteral("text"));
+    const QCommandLineOption runsOption(QStringLiteral("runs"), QStringLiteral("Timed runs per case."),
+                                        QStringLiteral("n"), QStringLiteral("7"));
+    parser.addOption(filterOption);
+    parser.addOption(runsOption);
+    parser.process(app);
+    const int runs = qMax(1, parser.value(runsOption).toInt());
+
+    // Ключ и файлы создаются во временном каталоге, а не в ~/.smartclip
+    QTemporaryDir home;
+    if (!home.isValid()) {
+        return 1;
+    }
+    qputenv("HOME", home.path().toLocal8Bit());
+    const CryptoManager crypto;
+    const QString path = home.filePath(QStringLiteral("history.bin"));
+
+    QTextStream out(stdout);
+    Suite suite(out, parser.value(filterOption), runs);
+
+    QJsonObject meta;
+    meta.insert(QStringLiteral("suite"), QStringLiteral("smartclip_bench"));
+    meta.insert(QStringLiteral("qt"), QLatin1String(qVersion()));
+#if defined(QT_DEBUG)
+    meta.insert(QStringLiteral("build"), QStringLiteral("debug"));
+#else
+    meta.insert(QStringLiteral("build"), QStringLiteral("release"));
+#endif
+    meta.insert(QStringLiteral("runs"), runs);
+    suite.emitLine(meta);
+
+    if (suite.selected("add_to_history")) {
+        benchAdd(suite);
+    }
+    if (suite.selected("sort_history")) {
+        benchSort(suite);
+    }
+    if (suite.selected("trim_to_max_items")) {
+        benchTrim(suite);
+    }
+    if (suite.selected("save") || suite.selected("load")) {
+        benchPersistence(suite, crypto, path);
+    }
+    if (suite.selected("encrypt") || suite.selected("decrypt")) {
+        benchCrypto(suite, crypto);
+    }
+    return 0;
+}
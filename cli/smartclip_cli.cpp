@@ -0,0 +1,168 @@
+// Offline import and export of the SmartClip history as JSON Lines, built on
+// smartclip_core without a tray or a display. Reads and writes ~/.smartclip
+// directly: export only reads and is safe at any time, import rewrites the
+// snapshot and refuses to run while SmartClip holds its instance lock.
+//
+//   smartclip-cli export [file]   history to file, or to stdout without one
+//   smartclip-cli import [file]   merges file, or stdin, into the history
+//
+// Records are streamed one at a time in both directions; the record format
+// is described at HistoryManager::exportJsonl().
+
+#include "../CryptoManager.h"
+#include "../HistoryJournal.h"
+#include "../HistoryManager.h"
+#include "../HistoryStorage.h"
+#include "../InstanceLock.h"
+#include "../SettingsManager.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QTextStream>
+#include <cstdio>
+
+namespace {
+
+QString dataPath(const char *name)
+{
+    return QDir::homePath() + QLatin1String("/.smartclip/") + QLatin1String(name);
+}
+
+int exportHistory(const HistoryManager &manager, const QString &path, QTextStream &err)
+{
+    qint64 written = -1;
+    if (path.isEmpty() || path == QLatin1String("-")) {
+        QFile out;
+        if (out.open(stdout, QIODevice::WriteOnly)) {
+            written = manager.exportJsonl(&out);
+            if (!out.flush()) {
+                written = -1;
+            }
+        }
+    } else {
+        // Прежний файл остаётся целым, пока новая выгрузка не записана полностью
+        QSaveFile out(path);
+        if (out.open(QIODevice::WriteOnly)) {
+            written = manager.exportJsonl(&out);
+            if (written >= 0 && !out.commit()) {
+                written = -1;
+            }
+        }
+    }
+
+    if (written < 0) {
+        err << "Could not write " << (path.isEmpty() ? QStringLiteral("stdout") : path) << "\n";
+        return 1;
+    }
+    err << "Exported " << written << " items\n";
+    return 0;
+}
+
+int importHistory(HistoryManager &manager, HistoryJournal &journal, const CryptoManager &crypto,
+                  const QString &path, QTextStream &err)
+{
+    QFile in;
+    bool opened = false;
+    if (path.isEmpty() || path == QLatin1String("-")) {
+        opened = in.open(stdin, QIODevice::ReadOnly);
+    } else {
+        in.setFileName(path);
+        opened = in.open(QIODevice::ReadOnly);
+    }
+    if (!opened) {
+        err << "Could not open " << (path.isEmpty() ? QStringLiteral("stdin") : path) << "\n";
+        return 1;
+    }
+
+    qint64 skipped = 0;
+    const qint64 imported = manager.importJsonl(&in, &skipped);
+    if (imported < 0) {
+        err << "The file was written by a newer SmartClip\n";
+        return 1;
+    }
+
+    // Снимок покрывает весь журнал, поэтому журнал после записи не нужен.
+    // Тела вытесненных импортом элементов удаляются, как после сохранения в приложении
+    BlobStore *blobs = manager.blobStore();
+    const quint64 epoch = blobs->nextEpoch();
+    if (!HistoryStorage::write(dataPath("history.bin"), manager.snapshot(), &crypto, journal.lastSequence())) {
+        err << "Could not write the history\n";
+        return 1;
+    }
+    journal.clear();
+    blobs->collectGarbage(epoch);
+
+    err << "Imported " << imported << " items";
+    if (skipped > 0) {
+        err << ", skipped " << skipped << " malformed or oversized lines";
+    }
+    err << "\n";
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("smartclip-cli"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Imports and exports the SmartClip history as JSON Lines."));
+    parser.addHelpOption();
+    parser.addPositionalArgument(QStringLiteral("command"), QStringLiteral("export or import"));
+    parser.addPositionalArgument(QStringLiteral("file"), QStringLiteral("JSON Lines file; stdout or stdin when omitted"),
+                                 QStringLiteral("[file]"));
+    parser.process(app);
+
+    QTextStream err(stderr);
+    const QStringList args = parser.positionalArguments();
+    const QString command = args.value(0);
+    if ((command != QLatin1String("export") && command != QLatin1String("import")) || args.size() > 2) {
+        parser.showHelp(1);
+    }
+    const QString path = args.value(1);
+
+    // Запущенное приложение перезаписало бы импортированный снимок своим,
+    // поэтому импорт берёт тот же замок и держит его до конца
+    InstanceLock instanceLock;
+    if (command == QLatin1String("import") && !instanceLock.tryLock()) {
+        err << "SmartClip is running; quit it before importing\n";
+        return 1;
+    }
+
+    SettingsManager settings;
+    settings.loadSettings(dataPath("settings.yml"));
+    if (!settings.saveHistoryOnExit() && command == QLatin1String("import")) {
+        // Приложение удалит такую историю при запуске
+        err << "History saving is turned off in SmartClip settings\n";
+        return 1;
+    }
+
+    const CryptoManager crypto;
+    HistoryManager manager;
+    manager.setMaxItems(settings.maxItems());
+    manager.setMaxTextBytes(qint64(settings.maxTextMb()) * 1024 * 1024);
+    manager.setCompression(qint64(settings.compressAboveKb()) * 1024, settings.compressAfterItems());
+    manager.blobStore()->setStorage(dataPath("blobs"), &crypto);
+
+    // Превью и счётчики из снимка, поверх — журнал; тела остаются на диске
+    quint64 snapshotSequence = 0;
+    HistoryStorage storage(dataPath("history.bin"), &crypto);
+    if (storage.open()) {
+        manager.bulkLoad(storage.items());
+        snapshotSequence = storage.journalSequence();
+        storage.close();
+    }
+    // Цвет новому избранному приложение назначит при следующем переключении
+    HistoryJournal journal(dataPath("history.journal"), &crypto);
+    journal.replay(journal.readAll(), snapshotSequence, &manager);
+
+    if (command == QLatin1String("export")) {
+        return exportHistory(manager, path, err);
+    }
+    return importHistory(manager, journal, crypto, path, err);
+}
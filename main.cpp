@@ -2,12 +2,25 @@
 #include <QSystemTrayIcon>
 #include <QMessageBox>
 
+#include "ControlServer.h"
+#include "InstanceLock.h"
 #include "SmartClipApp.h"
 
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
 
+    // Уже запущенный экземпляр открывает своё окно поиска, второй трей не нужен.
+    // Замок берётся до сокета, так что два одновременных запуска не станут
+    // оба сервером; замок упавшего экземпляра QLockFile забирает сам
+    InstanceLock instanceLock;
+    if (!instanceLock.tryLock()) {
+        if (!ControlServer::activateRunning()) {
+            qWarning("SmartClip is already running or its history is being imported");
+        }
+        return 0;
+    }
+
 #if defined(Q_OS_MAC)
     // Не показывать иконку в Dock
     app.setQuitOnLastWindowClosed(false);
@@ -22,7 +35,7 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    SmartClipApp tray;
+    SmartClipApp tray(&instanceLock);
     tray.show();
 
     return app.exec();
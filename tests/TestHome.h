@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../CryptoManager.h"
+
+#include <QFile>
+#include <QString>
+#include <QTemporaryDir>
+#include <memory>
+
+// Home directory of one test function. CryptoManager keeps its key in
+// ~/.smartclip, so every test gets a fresh temporary home and a key of its
+// own. Call init() from the test's init() slot and reset() from cleanup().
+class TestHome final
+{
+public:
+    // Points HOME and USERPROFILE at path
+    static void setHome(const QString &path)
+    {
+        qputenv("HOME", QFile::encodeName(path));
+        qputenv("USERPROFILE", QFile::encodeName(path));
+    }
+
+    // False if the temporary directory could not be created
+    bool init()
+    {
+        m_dir = std::make_unique<QTemporaryDir>();
+        if (!m_dir->isValid()) {
+            return false;
+        }
+        setHome(m_dir->path());
+        m_crypto = std::make_unique<CryptoManager>();
+        return true;
+    }
+
+    void reset()
+    {
+        m_crypto.reset();
+        m_dir.reset();
+    }
+
+    QString path() const { return m_dir->path(); }
+    QString filePath(const QString &name) const { return m_dir->filePath(name); }
+    const CryptoManager *crypto() const { return m_crypto.get(); }
+
+private:
+    std::unique_ptr<QTemporaryDir> m_dir;
+    std::unique_ptr<CryptoManager> m_crypto;
+};
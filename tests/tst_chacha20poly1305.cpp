@@ -0,0 +1,202 @@
+// Known-answer and rejection tests for ChaCha20Poly1305. The same file is
+// built twice: against smartclip_core, with whatever keystream path the
+// target has, and with SMARTCLIP_CHACHA_PORTABLE for the scalar path.
+
+#include "../ChaCha20Poly1305.h"
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QtTest>
+
+namespace {
+
+// RFC 8439, 2.8.2
+const QByteArray kKey = QByteArray::fromHex("808182838485868788898a8b8c8d8e8f"
+                                            "909192939495969798999a9b9c9d9e9f");
+const QByteArray kNonce = QByteArray::fromHex("070000004041424344454647");
+const QByteArray kAad = QByteArray::fromHex("50515253c0c1c2c3c4c5c6c7");
+const QByteArray kPlaintext("Ladies and Gentlemen of the class of '99: If I could offer you only one tip "
+                            "for the future, sunscreen would be it.");
+const QByteArray kCiphertext = QByteArray::fromHex("d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+                                                   "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+                                                   "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc"
+                                                   "3ff4def08e4b7a9de576d26586cec64b6116");
+const QByteArray kTag = QByteArray::fromHex("1ae10b594f09e26a7e902ecbd0600691");
+
+// 805 bytes: three runs of the four-block path and a partial block. The
+// expected values come from an independent implementation of RFC 8439
+const int kLongLength = 4 * 64 * 3 + 37;
+const QByteArray kLongCiphertextSha256 =
+    QByteArray::fromHex("b9a4d2ba6ae371c09e24dfb0612f3db2c361c07abc49b02e5f1754142bc97cb2");
+const QByteArray kLongTag = QByteArray::fromHex("0bd8c2bf7c2c2bfd26211cd8e0890bf2");
+
+const quint8 *bytes(const QByteArray &data)
+{
+    return reinterpret_cast<const quint8 *>(data.constData());
+}
+
+quint8 *bytes(QByteArray &data)
+{
+    return reinterpret_cast<quint8 *>(data.data());
+}
+
+QByteArray longPlaintext()
+{
+    QByteArray data(kLongLength, Qt::Uninitialized);
+    for (int i = 0; i < data.size(); ++i) {
+        data[i] = char((i * 7 + 3) & 0xff);
+    }
+    return data;
+}
+
+struct Sealed {
+    QByteArray ciphertext;
+    QByteArray tag;
+};
+
+Sealed seal(const ChaCha20Poly1305 &cipher, const QByteArray &plaintext)
+{
+    Sealed sealed;
+    sealed.ciphertext.resize(plaintext.size());
+    sealed.tag.resize(ChaCha20Poly1305::TagSize);
+    cipher.seal(bytes(kNonce), bytes(kAad), kAad.size(), bytes(plaintext), plaintext.size(),
+                bytes(sealed.ciphertext), bytes(sealed.tag));
+    return sealed;
+}
+
+// plaintext заранее заполняется маркером: при отказе он должен остаться нетронутым
+bool open(const ChaCha20Poly1305 &cipher, const QByteArray &aad, const QByteArray &ciphertext,
+          const QByteArray &tag, QByteArray *plaintext)
+{
+    plaintext->fill('\xaa', ciphertext.size());
+    return cipher.open(bytes(kNonce), bytes(aad), aad.size(), bytes(ciphertext), ciphertext.size(), bytes(tag),
+                       bytes(*plaintext));
+}
+
+} // namespace
+
+class TestChaCha20Poly1305 final : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void rfc8439Vector();
+    void longMessage();
+    void roundTripLengths();
+    void inPlace();
+    void rejectsTamperedCiphertext();
+    void rejectsTamperedAad();
+    void rejectsWrongTag();
+    void rejectsTruncation();
+
+private:
+    ChaCha20Poly1305 m_cipher{bytes(kKey)};
+};
+
+void TestChaCha20Poly1305::initTestCase()
+{
+    qInfo("keystream: %s", ChaCha20Poly1305::implementation());
+#if defined(SMARTCLIP_CHACHA_PORTABLE)
+    QCOMPARE(QByteArray(ChaCha20Poly1305::implementation()), QByteArray("portable"));
+#endif
+}
+
+void TestChaCha20Poly1305::rfc8439Vector()
+{
+    const Sealed sealed = seal(m_cipher, kPlaintext);
+    QCOMPARE(sealed.ciphertext, kCiphertext);
+    QCOMPARE(sealed.tag, kTag);
+
+    QByteArray plaintext;
+    QVERIFY(open(m_cipher, kAad, kCiphertext, kTag, &plaintext));
+    QCOMPARE(plaintext, kPlaintext);
+}
+
+void TestChaCha20Poly1305::longMessage()
+{
+    const Sealed sealed = seal(m_cipher, longPlaintext());
+    QCOMPARE(QCryptographicHash::hash(sealed.ciphertext, QCryptographicHash::Sha256), kLongCiphertextSha256);
+    QCOMPARE(sealed.tag, kLongTag);
+
+    QByteArray plaintext;
+    QVERIFY(open(m_cipher, kAad, sealed.ciphertext, sealed.tag, &plaintext));
+    QCOMPARE(plaintext, longPlaintext());
+}
+
+void TestChaCha20Poly1305::roundTripLengths()
+{
+    // Границы блока и четырёхблочного прохода
+    const QByteArray source = longPlaintext();
+    for (int length : {0, 1, 15, 16, 17, 63, 64, 65, 255, 256, 257, 511, 512, 513}) {
+        const QByteArray message = source.left(length);
+        const Sealed sealed = seal(m_cipher, message);
+        QByteArray plaintext;
+        QVERIFY2(open(m_cipher, kAad, sealed.ciphertext, sealed.tag, &plaintext), qPrintable(QString::number(length)));
+        QCOMPARE(plaintext, message);
+    }
+}
+
+void TestChaCha20Poly1305::inPlace()
+{
+    QByteArray buffer = longPlaintext();
+    QByteArray tag(ChaCha20Poly1305::TagSize, Qt::Uninitialized);
+    m_cipher.seal(bytes(kNonce), bytes(kAad), kAad.size(), bytes(buffer), buffer.size(), bytes(buffer), bytes(tag));
+    QCOMPARE(tag, kLongTag);
+
+    QVERIFY(m_cipher.open(bytes(kNonce), bytes(kAad), kAad.size(), bytes(buffer), buffer.size(), bytes(tag),
+                          bytes(buffer)));
+    QCOMPARE(buffer, longPlaintext());
+}
+
+void TestChaCha20Poly1305::rejectsTamperedCiphertext()
+{
+    const QByteArray untouched(kCiphertext.size(), '\xaa');
+    for (int i : {0, 1, 63, 64, int(kCiphertext.size()) - 1}) {
+        QByteArray tampered = kCiphertext;
+        tampered[i] = char(tampered.at(i) ^ 0x01);
+        QByteArray plaintext;
+        QVERIFY(!open(m_cipher, kAad, tampered, kTag, &plaintext));
+        QCOMPARE(plaintext, untouched);
+    }
+}
+
+void TestChaCha20Poly1305::rejectsTamperedAad()
+{
+    QByteArray aad = kAad;
+    aad[0] = char(aad.at(0) ^ 0x80);
+    QByteArray plaintext;
+    QVERIFY(!open(m_cipher, aad, kCiphertext, kTag, &plaintext));
+    QVERIFY(!open(m_cipher, QByteArray(), kCiphertext, kTag, &plaintext));
+}
+
+void TestChaCha20Poly1305::rejectsWrongTag()
+{
+    QByteArray plaintext;
+    for (int i = 0; i < ChaCha20Poly1305::TagSize; ++i) {
+        QByteArray tag = kTag;
+        tag[i] = char(tag.at(i) ^ 0x40);
+        QVERIFY(!open(m_cipher, kAad, kCiphertext, tag, &plaintext));
+    }
+    QVERIFY(!open(m_cipher, kAad, kCiphertext, QByteArray(ChaCha20Poly1305::TagSize, '\0'), &plaintext));
+
+    // Тег под другим ключом
+    QByteArray otherKey = kKey;
+    otherKey[31] = char(otherKey.at(31) ^ 0x01);
+    const ChaCha20Poly1305 other(bytes(otherKey));
+    QVERIFY(!open(other, kAad, kCiphertext, kTag, &plaintext));
+}
+
+void TestChaCha20Poly1305::rejectsTruncation()
+{
+    QByteArray plaintext;
+    QVERIFY(!open(m_cipher, kAad, kCiphertext.chopped(1), kTag, &plaintext));
+    QVERIFY(!open(m_cipher, kAad, kCiphertext.left(64), kTag, &plaintext));
+    QVERIFY(!open(m_cipher, kAad, QByteArray(), kTag, &plaintext));
+    // Хвост с тегом, принятый за шифртекст, тоже не проходит
+    QVERIFY(!open(m_cipher, kAad, kCiphertext + kTag.left(8), kTag, &plaintext));
+}
+
+QTEST_APPLESS_MAIN(TestChaCha20Poly1305)
+
+#include "tst_chacha20poly1305.moc"
@@ -0,0 +1,318 @@
+// HistoryJournal: records survive a reopen with their sequences, rotation
+// keeps the order, damage loses only what follows it, and replay applies
+// exactly the records newer than the snapshot.
+
+#include "../BlobStore.h"
+#include "../HistoryJournal.h"
+#include "../HistoryManager.h"
+#include "TestHome.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QtTest>
+
+namespace {
+
+HistoryJournal::Record addRecord(const QString &text, qint64 addedAtMs)
+{
+    HistoryJournal::Record record;
+    record.op = HistoryJournal::Op::Add;
+    record.digest = HistoryManager::contentDigest(text);
+    record.timestampMs = addedAtMs;
+    record.preview = HistoryManager::makePreview(text);
+    record.length = text.size();
+    return record;
+}
+
+HistoryJournal::Record opRecord(HistoryJournal::Op op, const QString &text)
+{
+    HistoryJournal::Record record;
+    record.op = op;
+    if (op != HistoryJournal::Op::Clear) {
+        record.digest = HistoryManager::contentDigest(text);
+    }
+    return record;
+}
+
+} // namespace
+
+class TestHistoryJournal final : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void appendAndReadAll();
+    void richAddRoundTrip();
+    void sequenceContinuesAfterReopen();
+    void sequenceSurvivesClear();
+    void rotateKeepsOrder();
+    void tornTailLosesLastRecord();
+    void corruptRecordEndsSegment();
+    void replaySkipsSnapshotRecords();
+    void replayRestoresHistory();
+    void replayClear();
+
+private:
+    QString journalPath() const { return m_home.filePath(QStringLiteral("history.journal")); }
+    QString blobsPath() const { return m_home.filePath(QStringLiteral("blobs")); }
+
+    TestHome m_home;
+};
+
+void TestHistoryJournal::init()
+{
+    QVERIFY(m_home.init());
+}
+
+void TestHistoryJournal::cleanup()
+{
+    m_home.reset();
+}
+
+void TestHistoryJournal::appendAndReadAll()
+{
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    QVERIFY(journal.append(addRecord(QStringLiteral("first"), 1000)));
+    QVERIFY(journal.append(opRecord(HistoryJournal::Op::Use, QStringLiteral("first"))));
+    QVERIFY(journal.append(opRecord(HistoryJournal::Op::ToggleFavorite, QStringLiteral("first"))));
+    QVERIFY(journal.append(opRecord(HistoryJournal::Op::ToggleMask, QStringLiteral("first"))));
+    QVERIFY(journal.append(opRecord(HistoryJournal::Op::Clear, QString())));
+    QCOMPARE(journal.lastSequence(), quint64(5));
+
+    HistoryJournal reader(journalPath(), m_home.crypto());
+    const QVector<HistoryJournal::Record> records = reader.readAll();
+    QCOMPARE(records.size(), 5);
+    const HistoryJournal::Op ops[] = {HistoryJournal::Op::Add, HistoryJournal::Op::Use,
+                                      HistoryJournal::Op::ToggleFavorite, HistoryJournal::Op::ToggleMask,
+                                      HistoryJournal::Op::Clear};
+    for (int i = 0; i < records.size(); ++i) {
+        QCOMPARE(int(records.at(i).op), int(ops[i]));
+        QCOMPARE(records.at(i).sequence, quint64(i + 1));
+    }
+
+    const HistoryJournal::Record &added = records.first();
+    QCOMPARE(added.digest, HistoryManager::contentDigest(QStringLiteral("first")));
+    QCOMPARE(added.timestampMs, qint64(1000));
+    QCOMPARE(added.preview, QStringLiteral("first"));
+    QCOMPARE(added.length, qint64(5));
+    QVERIFY(records.last().digest.isEmpty());
+}
+
+void TestHistoryJournal::richAddRoundTrip()
+{
+    HistoryJournal::Record record = addRecord(QStringLiteral("rich"), 2000);
+    HistoryManager::Part html;
+    html.mimeType = QStringLiteral("text/html");
+    html.digest = BlobStore::digest("<i>rich</i>");
+    html.size = 11;
+    record.parts = {html};
+    record.digest = HistoryManager::partsDigest(record.parts);
+
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    QVERIFY(journal.append(record));
+
+    const QVector<HistoryJournal::Record> records = HistoryJournal(journalPath(), m_home.crypto()).readAll();
+    QCOMPARE(records.size(), 1);
+    QCOMPARE(records.first().digest, record.digest);
+    QCOMPARE(records.first().parts.size(), 1);
+    QCOMPARE(records.first().parts.first().mimeType, html.mimeType);
+    QCOMPARE(records.first().parts.first().digest, html.digest);
+    QCOMPARE(records.first().parts.first().size, html.size);
+}
+
+void TestHistoryJournal::sequenceContinuesAfterReopen()
+{
+    {
+        HistoryJournal journal(journalPath(), m_home.crypto());
+        journal.append(addRecord(QStringLiteral("a"), 1));
+        journal.append(addRecord(QStringLiteral("b"), 2));
+    }
+
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    QCOMPARE(journal.lastSequence(), quint64(0));
+    QCOMPARE(journal.readAll().size(), 2);
+    QCOMPARE(journal.lastSequence(), quint64(2));
+    QVERIFY(journal.append(addRecord(QStringLiteral("c"), 3)));
+    QCOMPARE(journal.lastSequence(), quint64(3));
+
+    // Снимок новее журнала: номера продолжаются после него
+    journal.advanceSequence(10);
+    journal.advanceSequence(4);
+    QCOMPARE(journal.lastSequence(), quint64(10));
+}
+
+void TestHistoryJournal::sequenceSurvivesClear()
+{
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    journal.append(addRecord(QStringLiteral("a"), 1));
+    journal.append(addRecord(QStringLiteral("b"), 2));
+    journal.clear();
+    QVERIFY(!QFile::exists(journalPath()));
+    QCOMPARE(journal.lastSequence(), quint64(2));
+
+    QVERIFY(journal.append(addRecord(QStringLiteral("c"), 3)));
+    const QVector<HistoryJournal::Record> records = HistoryJournal(journalPath(), m_home.crypto()).readAll();
+    QCOMPARE(records.size(), 1);
+    QCOMPARE(records.first().sequence, quint64(3));
+}
+
+void TestHistoryJournal::rotateKeepsOrder()
+{
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    journal.append(addRecord(QStringLiteral("a"), 1));
+    QCOMPARE(journal.pendingRecords(), 1);
+    journal.rotate();
+    QCOMPARE(journal.pendingRecords(), 0);
+    journal.append(addRecord(QStringLiteral("b"), 2));
+    // Снимок после первой ротации не записан: вторая дописывает к старому сегменту
+    journal.rotate();
+    journal.append(addRecord(QStringLiteral("c"), 3));
+
+    QVector<HistoryJournal::Record> records = HistoryJournal(journalPath(), m_home.crypto()).readAll();
+    QCOMPARE(records.size(), 3);
+    for (int i = 0; i < records.size(); ++i) {
+        QCOMPARE(records.at(i).sequence, quint64(i + 1));
+    }
+
+    journal.removeRotated();
+    records = HistoryJournal(journalPath(), m_home.crypto()).readAll();
+    QCOMPARE(records.size(), 1);
+    QCOMPARE(records.first().sequence, quint64(3));
+}
+
+void TestHistoryJournal::tornTailLosesLastRecord()
+{
+    {
+        HistoryJournal journal(journalPath(), m_home.crypto());
+        journal.append(addRecord(QStringLiteral("a"), 1));
+        journal.append(addRecord(QStringLiteral("b"), 2));
+        journal.append(addRecord(QStringLiteral("c"), 3));
+    }
+    QVERIFY(QFile::resize(journalPath(), QFileInfo(journalPath()).size() - 3));
+
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    const QVector<HistoryJournal::Record> records = journal.readAll();
+    QCOMPARE(records.size(), 2);
+    QCOMPARE(records.last().sequence, quint64(2));
+    QCOMPARE(journal.lastSequence(), quint64(2));
+}
+
+void TestHistoryJournal::corruptRecordEndsSegment()
+{
+    qint64 firstEnd = 0;
+    {
+        HistoryJournal journal(journalPath(), m_home.crypto());
+        journal.append(addRecord(QStringLiteral("a"), 1));
+        firstEnd = journal.size();
+        journal.append(addRecord(QStringLiteral("b"), 2));
+        journal.append(addRecord(QStringLiteral("c"), 3));
+    }
+
+    // Байт внутри второй записи, после её длины
+    QFile f(journalPath());
+    QVERIFY(f.open(QIODevice::ReadWrite));
+    QVERIFY(f.seek(firstEnd + 10));
+    char byte = 0;
+    QVERIFY(f.getChar(&byte));
+    QVERIFY(f.seek(firstEnd + 10));
+    QVERIFY(f.putChar(char(byte ^ 0x01)));
+    f.close();
+
+    const QVector<HistoryJournal::Record> records = HistoryJournal(journalPath(), m_home.crypto()).readAll();
+    QCOMPARE(records.size(), 1);
+    QCOMPARE(records.first().sequence, quint64(1));
+}
+
+void TestHistoryJournal::replaySkipsSnapshotRecords()
+{
+    HistoryManager history;
+    history.setMaxItems(100);
+    const quint64 id = history.addToHistory(QStringLiteral("a"), 1000);
+
+    QVector<HistoryJournal::Record> records;
+    records.push_back(opRecord(HistoryJournal::Op::Use, QStringLiteral("a")));
+    records.push_back(opRecord(HistoryJournal::Op::Use, QStringLiteral("a")));
+    records.push_back(opRecord(HistoryJournal::Op::ToggleFavorite, QStringLiteral("a")));
+    for (int i = 0; i < records.size(); ++i) {
+        records[i].sequence = quint64(i + 1);
+    }
+
+    // Первые две записи уже в снимке
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    QVERIFY(journal.replay(records, 2, &history));
+    QCOMPARE(history.item(id)->usageCount, 0);
+    QVERIFY(history.item(id)->isFavorite);
+    QCOMPARE(journal.lastSequence(), quint64(3));
+
+    // Всё в снимке: применять нечего, но номер всё равно продвигается
+    HistoryJournal later(journalPath(), m_home.crypto());
+    QVERIFY(!later.replay(records, 5, &history));
+    QCOMPARE(later.lastSequence(), quint64(5));
+    QVERIFY(history.item(id)->isFavorite);
+}
+
+void TestHistoryJournal::replayRestoresHistory()
+{
+    // Запись как в приложении: тело в хранилище, в журнале дайджест и превью
+    {
+        HistoryManager history;
+        history.setMaxItems(100);
+        history.blobStore()->setStorage(blobsPath(), m_home.crypto());
+        HistoryJournal journal(journalPath(), m_home.crypto());
+        for (const QString &text : {QStringLiteral("one"), QStringLiteral("two"), QStringLiteral("three")}) {
+            const quint64 id = history.addToHistory(text, 1000);
+            const HistoryManager::HistoryItem *item = history.item(id);
+            HistoryJournal::Record record = addRecord(text, item->addedAtMs);
+            record.digest = item->digest;
+            journal.append(record);
+        }
+        journal.append(opRecord(HistoryJournal::Op::Use, QStringLiteral("two")));
+        journal.append(opRecord(HistoryJournal::Op::ToggleMask, QStringLiteral("three")));
+        journal.append(opRecord(HistoryJournal::Op::ToggleFavorite, QStringLiteral("one")));
+    }
+
+    HistoryManager restored;
+    restored.setMaxItems(100);
+    restored.blobStore()->setStorage(blobsPath(), m_home.crypto());
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    // Избранное переключает вызывающий, чтобы назначить цвет
+    QVector<quint64> toggled;
+    QVERIFY(journal.replay(journal.readAll(), 0, &restored, [&toggled](quint64 id) { toggled.push_back(id); }));
+    QCOMPARE(restored.size(), 3);
+    const HistoryManager::HistoryItem *one = restored.findByDigest(HistoryManager::contentDigest(QStringLiteral("one")));
+    QVERIFY(one);
+    QCOMPARE(toggled, QVector<quint64>{one->id});
+    QVERIFY(!one->isFavorite);
+
+    const HistoryManager::HistoryItem *two = restored.findByDigest(HistoryManager::contentDigest(QStringLiteral("two")));
+    QVERIFY(two);
+    QCOMPARE(two->usageCount, 1);
+    QCOMPARE(restored.text(two->id), QStringLiteral("two"));
+    const HistoryManager::HistoryItem *three =
+        restored.findByDigest(HistoryManager::contentDigest(QStringLiteral("three")));
+    QVERIFY(three);
+    QVERIFY(three->isMasked);
+    QCOMPARE(restored.text(three->id), QStringLiteral("three"));
+}
+
+void TestHistoryJournal::replayClear()
+{
+    HistoryManager history;
+    history.setMaxItems(100);
+    history.addToHistory(QStringLiteral("old"), 1000);
+
+    QVector<HistoryJournal::Record> records = {opRecord(HistoryJournal::Op::Clear, QString()),
+                                               opRecord(HistoryJournal::Op::Use, QStringLiteral("old"))};
+    records[0].sequence = 1;
+    records[1].sequence = 2;
+
+    HistoryJournal journal(journalPath(), m_home.crypto());
+    QVERIFY(journal.replay(records, 0, &history));
+    QCOMPARE(history.size(), 0);
+}
+
+QTEST_GUILESS_MAIN(TestHistoryJournal)
+
+#include "tst_historyjournal.moc"
@@ -0,0 +1,198 @@
+// JSON Lines export and import of HistoryManager: a round trip keeps text,
+// counters and flags, and the importer copes with blank, malformed, long and
+// unterminated lines and refuses files of a newer format.
+
+#include "../HistoryManager.h"
+
+#include <QBuffer>
+#include <QtTest>
+
+namespace {
+
+QByteArray header(int version = 1)
+{
+    return "{\"format\":\"smartclip-history\",\"version\":" + QByteArray::number(version) + "}\n";
+}
+
+const HistoryManager::HistoryItem *find(const HistoryManager &history, const QString &text)
+{
+    return history.findByDigest(HistoryManager::contentDigest(text));
+}
+
+qint64 importData(HistoryManager &history, const QByteArray &data, qint64 *skipped = nullptr)
+{
+    QBuffer buffer;
+    buffer.setData(data);
+    buffer.open(QIODevice::ReadOnly);
+    return history.importJsonl(&buffer, skipped);
+}
+
+} // namespace
+
+class TestHistoryJsonl final : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void exportsOldestFirst();
+    void importRefreshesExisting();
+    void skipsBlankAndMalformedLines();
+    void readsLinesLongerThanAChunk();
+    void readsLastLineWithoutNewline();
+    void rejectsNewerVersion();
+    void importRespectsMaxItems();
+};
+
+void TestHistoryJsonl::roundTrip()
+{
+    HistoryManager source;
+    source.setMaxItems(100);
+    const quint64 plain = source.addToHistory(QStringLiteral("plain text"), 1700000000000);
+    const quint64 favorite = source.addToHistory(QStringLiteral("избранное \"в кавычках\"\n\tс табом"),
+                                                 1700000001000);
+    const quint64 masked = source.addToHistory(QStringLiteral("secret"), 1700000002000);
+    source.incrementUsageCount(plain);
+    source.incrementUsageCount(plain);
+    source.toggleFavorite(favorite);
+    source.setColorIndex(favorite, 4);
+    source.setMasked(masked, true);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QCOMPARE(source.exportJsonl(&buffer), qint64(3));
+    buffer.close();
+
+    HistoryManager target;
+    target.setMaxItems(100);
+    qint64 skipped = -1;
+    QCOMPARE(importData(target, buffer.data(), &skipped), qint64(3));
+    QCOMPARE(skipped, qint64(0));
+    QCOMPARE(target.size(), 3);
+
+    for (quint64 id : {plain, favorite, masked}) {
+        const HistoryManager::HistoryItem *expected = source.item(id);
+        const HistoryManager::HistoryItem *actual = find(target, source.text(id));
+        QVERIFY(actual);
+        QCOMPARE(target.text(actual->id), source.text(id));
+        QCOMPARE(actual->usageCount, expected->usageCount);
+        QCOMPARE(actual->addedAtMs, expected->addedAtMs);
+        QCOMPARE(actual->isFavorite, expected->isFavorite);
+        QCOMPARE(actual->isMasked, expected->isMasked);
+        QCOMPARE(actual->colorIndex, expected->colorIndex);
+    }
+}
+
+void TestHistoryJsonl::exportsOldestFirst()
+{
+    HistoryManager history;
+    history.setMaxItems(100);
+    history.addToHistory(QStringLiteral("newer"), 2000);
+    history.addToHistory(QStringLiteral("older"), 1000);
+
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QCOMPARE(history.exportJsonl(&buffer), qint64(2));
+    const QList<QByteArray> lines = buffer.data().split('\n');
+    // Заголовок, две записи и пустой хвост после последнего перевода строки
+    QCOMPARE(lines.size(), 4);
+    QVERIFY(lines.at(0).contains("smartclip-history"));
+    QVERIFY(lines.at(1).contains("older"));
+    QVERIFY(lines.at(2).contains("newer"));
+    QVERIFY(lines.at(3).isEmpty());
+}
+
+void TestHistoryJsonl::importRefreshesExisting()
+{
+    HistoryManager history;
+    history.setMaxItems(100);
+    const quint64 id = history.addToHistory(QStringLiteral("same"), 1000);
+
+    const QByteArray data = header()
+        + "{\"text\":\"same\",\"usage_count\":9,\"added_at_ms\":5000,\"favorite\":true,\"color\":2}\n";
+    QCOMPARE(importData(history, data), qint64(1));
+    QCOMPARE(history.size(), 1);
+    const HistoryManager::HistoryItem *item = history.item(id);
+    QVERIFY(item);
+    QCOMPARE(item->usageCount, 9);
+    QCOMPARE(item->addedAtMs, qint64(5000));
+    QVERIFY(item->isFavorite);
+    QCOMPARE(item->colorIndex, 2);
+}
+
+void TestHistoryJsonl::skipsBlankAndMalformedLines()
+{
+    const QByteArray data = header()
+        + "\n"
+        + "   \n"
+        + "{not json\n"
+        + "[1,2,3]\n"
+        + "{\"text\":\"   \"}\n"
+        + "{\"text\":\"kept\",\"usage_count\":-4}\n";
+
+    HistoryManager history;
+    history.setMaxItems(100);
+    qint64 skipped = 0;
+    QCOMPARE(importData(history, data, &skipped), qint64(1));
+    QCOMPARE(skipped, qint64(3));
+    const HistoryManager::HistoryItem *kept = find(history, QStringLiteral("kept"));
+    QVERIFY(kept);
+    QCOMPARE(kept->usageCount, 0);
+    QVERIFY(kept->addedAtMs > 0);
+}
+
+void TestHistoryJsonl::readsLinesLongerThanAChunk()
+{
+    // Строка читается порциями по 64 КиБ: запись в несколько порций собирается целиком
+    const QString longText = QString(300 * 1024, QLatin1Char('a')) + QStringLiteral("end");
+    const QByteArray data = header() + "{\"text\":\"" + longText.toUtf8() + "\"}\n"
+        + "{\"text\":\"short\"}\n";
+
+    HistoryManager history;
+    history.setMaxItems(100);
+    qint64 skipped = -1;
+    QCOMPARE(importData(history, data, &skipped), qint64(2));
+    QCOMPARE(skipped, qint64(0));
+    const HistoryManager::HistoryItem *item = find(history, longText);
+    QVERIFY(item);
+    QCOMPARE(history.text(item->id), longText);
+    QVERIFY(find(history, QStringLiteral("short")));
+}
+
+void TestHistoryJsonl::readsLastLineWithoutNewline()
+{
+    HistoryManager history;
+    history.setMaxItems(100);
+    QCOMPARE(importData(history, header() + "{\"text\":\"tail\"}"), qint64(1));
+    QVERIFY(find(history, QStringLiteral("tail")));
+}
+
+void TestHistoryJsonl::rejectsNewerVersion()
+{
+    HistoryManager history;
+    history.setMaxItems(100);
+    QCOMPARE(importData(history, header(2) + "{\"text\":\"x\"}\n"), qint64(-1));
+    QCOMPARE(history.size(), 0);
+}
+
+void TestHistoryJsonl::importRespectsMaxItems()
+{
+    QByteArray data = header();
+    for (int i = 0; i < 10; ++i) {
+        data += "{\"text\":\"item " + QByteArray::number(i) + "\",\"added_at_ms\":" + QByteArray::number(1000 + i)
+            + "}\n";
+    }
+
+    HistoryManager history;
+    history.setMaxItems(4);
+    QCOMPARE(importData(history, data), qint64(10));
+    QCOMPARE(history.size(), 4);
+    // Вытесняются самые старые
+    QVERIFY(!find(history, QStringLiteral("item 5")));
+    QVERIFY(find(history, QStringLiteral("item 6")));
+    QVERIFY(find(history, QStringLiteral("item 9")));
+}
+
+QTEST_GUILESS_MAIN(TestHistoryJsonl)
+
+#include "tst_historyjsonl.moc"
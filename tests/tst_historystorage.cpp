@@ -0,0 +1,463 @@
+// history.bin round trips, the v3 and v4 layouts still accepted by open(),
+// and snapshots that must be rejected: newer version, damaged, cut-off,
+// reordered or extra chunks, a header that disagrees with them, another key.
+
+#include "../BlobStore.h"
+#include "../CryptoManager.h"
+#include "../HistoryStorage.h"
+#include "TestHome.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+#include <cstring>
+
+namespace {
+
+// Поля заголовка history.bin
+const int kVersionOffset = 4;
+const int kCountOffset = 8;
+const int kChunksOffset = 12;
+const int kSequenceOffset = 16;
+const int kHeaderSize = 32;
+
+HistoryManager::HistoryItem textItem(const QString &text, int usageCount, qint64 addedAtMs)
+{
+    HistoryManager::HistoryItem item;
+    item.digest = BlobStore::digest(text.toUtf8());
+    item.preview = HistoryManager::makePreview(text);
+    item.length = text.size();
+    item.usageCount = usageCount;
+    item.addedAtMs = addedAtMs;
+    return item;
+}
+
+QVector<HistoryManager::HistoryItem> sampleItems()
+{
+    QVector<HistoryManager::HistoryItem> items;
+    HistoryManager::HistoryItem favorite = textItem(QStringLiteral("favorite clip"), 7, 1700000000000);
+    favorite.isFavorite = true;
+    favorite.colorIndex = 3;
+    items.push_back(favorite);
+
+    HistoryManager::HistoryItem masked = textItem(QStringLiteral("hunter2"), 1, 1700000000500);
+    masked.isMasked = true;
+    items.push_back(masked);
+
+    items.push_back(textItem(QStringLiteral("Привет, мир: не только ASCII"), 0, 1700000001000));
+    return items;
+}
+
+HistoryManager::HistoryItem richItem()
+{
+    HistoryManager::HistoryItem item;
+    HistoryManager::Part html;
+    html.mimeType = QStringLiteral("text/html");
+    html.digest = BlobStore::digest("<b>rich</b>");
+    html.size = 11;
+    HistoryManager::Part plain;
+    plain.mimeType = QStringLiteral("text/plain");
+    plain.digest = BlobStore::digest("rich");
+    plain.size = 4;
+    item.parts = {html, plain};
+    item.digest = HistoryManager::partsDigest(item.parts);
+    item.preview = QStringLiteral("rich");
+    item.length = 4;
+    item.addedAtMs = 1700000002000;
+    return item;
+}
+
+void compareItems(const QVector<HistoryManager::HistoryItem> &actual,
+                  const QVector<HistoryManager::HistoryItem> &expected)
+{
+    QCOMPARE(actual.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        const HistoryManager::HistoryItem &a = actual.at(i);
+        const HistoryManager::HistoryItem &e = expected.at(i);
+        QCOMPARE(a.digest, e.digest);
+        QCOMPARE(a.preview, e.preview);
+        QCOMPARE(a.length, e.length);
+        QCOMPARE(a.usageCount, e.usageCount);
+        QCOMPARE(a.addedAtMs, e.addedAtMs);
+        QCOMPARE(a.isFavorite, e.isFavorite);
+        QCOMPARE(a.isMasked, e.isMasked);
+        QCOMPARE(a.colorIndex, e.colorIndex);
+        QCOMPARE(a.parts.size(), e.parts.size());
+        for (int p = 0; p < e.parts.size(); ++p) {
+            QCOMPARE(a.parts.at(p).mimeType, e.parts.at(p).mimeType);
+            QCOMPARE(a.parts.at(p).digest, e.parts.at(p).digest);
+            QCOMPARE(a.parts.at(p).size, e.parts.at(p).size);
+        }
+    }
+}
+
+// Правка файла на месте; false, если файл не открылся
+bool patchFile(const QString &path, qint64 offset, const QByteArray &bytes)
+{
+    QFile f(path);
+    return f.open(QIODevice::ReadWrite) && f.seek(offset) && f.write(bytes) == bytes.size();
+}
+
+template<typename T>
+QByteArray littleEndian(T value)
+{
+    QByteArray bytes(sizeof(T), Qt::Uninitialized);
+    qToLittleEndian<T>(value, bytes.data());
+    return bytes;
+}
+
+QByteArray version(quint16 value)
+{
+    return littleEndian<quint16>(value);
+}
+
+// Снимок v3/v4 без частей: один чанк без пролога и хвоста, как писали
+// прежние версии
+bool writeLegacy(const QString &path, const QVector<HistoryManager::HistoryItem> &items,
+                 const CryptoManager *crypto, quint16 formatVersion, quint64 journalSequence)
+{
+    QByteArray entries = littleEndian<quint32>(quint32(items.size()));
+    QByteArray previews;
+    for (const HistoryManager::HistoryItem &item : items) {
+        const QByteArray preview = item.preview.toUtf8();
+        uchar e[64] = {};
+        std::memcpy(e, item.digest.constData(), 32);
+        qToLittleEndian<qint64>(item.addedAtMs, e + 32);
+        qToLittleEndian<qint64>(item.length, e + 40);
+        qToLittleEndian<qint32>(item.usageCount, e + 48);
+        e[52] = (item.isFavorite ? 0x01 : 0) | (item.isMasked ? 0x02 : 0);
+        e[53] = uchar(qint8(item.colorIndex));
+        qToLittleEndian<quint32>(quint32(previews.size()), e + 56);
+        qToLittleEndian<quint32>(quint32(preview.size()), e + 60);
+        entries.append(reinterpret_cast<const char *>(e), sizeof(e));
+        previews.append(preview);
+    }
+    const QByteArray chunk = crypto->encrypt(entries + previews);
+
+    QByteArray header(kHeaderSize, '\0');
+    header.replace(0, 4, "SCHB");
+    header.replace(kVersionOffset, 2, version(formatVersion));
+    header.replace(kCountOffset, 4, littleEndian<quint32>(quint32(items.size())));
+    header.replace(kChunksOffset, 4, littleEndian<quint32>(1));
+    header.replace(kSequenceOffset, 8, littleEndian<quint64>(journalSequence));
+
+    QFile f(path);
+    const QByteArray data = header + littleEndian<quint32>(quint32(chunk.size())) + chunk;
+    return f.open(QIODevice::WriteOnly) && f.write(data) == data.size();
+}
+
+// Чанки файла вместе с префиксом длины, по порядку
+QVector<QByteArray> chunkFrames(const QByteArray &file)
+{
+    QVector<QByteArray> frames;
+    qsizetype pos = kHeaderSize;
+    while (pos + 4 <= file.size()) {
+        const quint32 length = qFromLittleEndian<quint32>(file.constData() + pos);
+        frames.push_back(file.mid(pos, 4 + qsizetype(length)));
+        pos += 4 + qsizetype(length);
+    }
+    return frames;
+}
+
+QByteArray readFile(const QString &path)
+{
+    QFile f(path);
+    return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+}
+
+bool writeFile(const QString &path, const QByteArray &data)
+{
+    QFile f(path);
+    return f.open(QIODevice::WriteOnly | QIODevice::Truncate) && f.write(data) == data.size();
+}
+
+// Снимок из нескольких чанков
+QVector<HistoryManager::HistoryItem> manyItems()
+{
+    QVector<HistoryManager::HistoryItem> items;
+    for (int i = 0; i < 2000; ++i) {
+        const QString text = QString::number(i) + QString(300, QLatin1Char('x'));
+        items.push_back(textItem(text, i % 5, 1700000000000 + i));
+    }
+    return items;
+}
+
+} // namespace
+
+class TestHistoryStorage final : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void roundTrip();
+    void roundTripRichClip();
+    void roundTripManyChunks();
+    void emptySnapshot();
+    void readsVersion3();
+    void readsVersion4();
+    void rejectsNewerVersion();
+    void rejectsBadMagic();
+    void rejectsCorruptChunk();
+    void rejectsTruncatedFile();
+    void rejectsTrailingBytes();
+    void rejectsLoweredCounts();
+    void rejectsDroppedChunk();
+    void rejectsSwappedChunks();
+    void rejectsEditedJournalSequence();
+    void rejectsLegacyCountMismatch();
+    void rejectsOtherKey();
+
+private:
+    QString path() const { return m_home.filePath(QStringLiteral("history.bin")); }
+
+    TestHome m_home;
+};
+
+void TestHistoryStorage::init()
+{
+    QVERIFY(m_home.init());
+}
+
+void TestHistoryStorage::cleanup()
+{
+    m_home.reset();
+}
+
+void TestHistoryStorage::roundTrip()
+{
+    const QVector<HistoryManager::HistoryItem> items = sampleItems();
+    QVERIFY(HistoryStorage::write(path(), items, m_home.crypto(), 42));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(storage.open());
+    QCOMPARE(storage.journalSequence(), quint64(42));
+    compareItems(storage.items(), items);
+}
+
+void TestHistoryStorage::roundTripRichClip()
+{
+    QVector<HistoryManager::HistoryItem> items = sampleItems();
+    items.insert(1, richItem());
+    QVERIFY(HistoryStorage::write(path(), items, m_home.crypto(), 1));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(storage.open());
+    compareItems(storage.items(), items);
+}
+
+void TestHistoryStorage::roundTripManyChunks()
+{
+    // Превью по 200 символов: несколько сотен записей не помещаются в один чанк
+    const QVector<HistoryManager::HistoryItem> items = manyItems();
+    QVERIFY(HistoryStorage::write(path(), items, m_home.crypto(), 7));
+    QVERIFY(QFileInfo(path()).size() > 2 * HistoryStorage::ChunkSize);
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(storage.open());
+    compareItems(storage.items(), items);
+}
+
+void TestHistoryStorage::emptySnapshot()
+{
+    QVERIFY(HistoryStorage::write(path(), {}, m_home.crypto(), 5));
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(storage.open());
+    QVERIFY(storage.items().isEmpty());
+    QCOMPARE(storage.journalSequence(), quint64(5));
+}
+
+void TestHistoryStorage::readsVersion3()
+{
+    // v3 отличается от v4 только отсутствием частей
+    const QVector<HistoryManager::HistoryItem> items = sampleItems();
+    QVERIFY(writeLegacy(path(), items, m_home.crypto(), 3, 3));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(storage.open());
+    QCOMPARE(storage.journalSequence(), quint64(3));
+    compareItems(storage.items(), items);
+}
+
+void TestHistoryStorage::readsVersion4()
+{
+    // Прежние версии записывали и записи с пустым превью: они входят в
+    // число записей заголовка, но в историю не попадают
+    QVector<HistoryManager::HistoryItem> items = sampleItems();
+    HistoryManager::HistoryItem blank = textItem(QStringLiteral("blank"), 0, 1700000003000);
+    blank.preview.clear();
+    QVERIFY(writeLegacy(path(), items + QVector<HistoryManager::HistoryItem>{blank}, m_home.crypto(), 4, 4));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(storage.open());
+    compareItems(storage.items(), items);
+}
+
+void TestHistoryStorage::rejectsNewerVersion()
+{
+    QVERIFY(HistoryStorage::write(path(), sampleItems(), m_home.crypto(), 1));
+    QVERIFY(patchFile(path(), kVersionOffset, version(6)));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+    QVERIFY(storage.items().isEmpty());
+}
+
+void TestHistoryStorage::rejectsBadMagic()
+{
+    QVERIFY(HistoryStorage::write(path(), sampleItems(), m_home.crypto(), 1));
+    QVERIFY(patchFile(path(), 0, QByteArrayLiteral("XXXX")));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+}
+
+void TestHistoryStorage::rejectsCorruptChunk()
+{
+    QVERIFY(HistoryStorage::write(path(), sampleItems(), m_home.crypto(), 1));
+    const qint64 size = QFileInfo(path()).size();
+    QFile f(path());
+    QVERIFY(f.open(QIODevice::ReadWrite));
+    QVERIFY(f.seek(size - 20));
+    char byte = 0;
+    QVERIFY(f.getChar(&byte));
+    QVERIFY(f.seek(size - 20));
+    QVERIFY(f.putChar(char(byte ^ 0x01)));
+    f.close();
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+    QVERIFY(storage.items().isEmpty());
+}
+
+void TestHistoryStorage::rejectsTruncatedFile()
+{
+    QVERIFY(HistoryStorage::write(path(), sampleItems(), m_home.crypto(), 1));
+    QVERIFY(QFile::resize(path(), QFileInfo(path()).size() - 1));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+
+    QVERIFY(QFile::resize(path(), 16));
+    QVERIFY(!storage.open());
+}
+
+void TestHistoryStorage::rejectsTrailingBytes()
+{
+    QVERIFY(HistoryStorage::write(path(), sampleItems(), m_home.crypto(), 1));
+    QFile f(path());
+    QVERIFY(f.open(QIODevice::Append));
+    QCOMPARE(f.write("tail"), qint64(4));
+    f.close();
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+}
+
+void TestHistoryStorage::rejectsLoweredCounts()
+{
+    // Заголовок не зашифрован: уменьшенные счётчики видны по хвосту последнего чанка
+    QVERIFY(HistoryStorage::write(path(), manyItems(), m_home.crypto(), 1));
+    const QByteArray original = readFile(path());
+    const quint32 chunks = qFromLittleEndian<quint32>(original.constData() + kChunksOffset);
+    const quint32 count = qFromLittleEndian<quint32>(original.constData() + kCountOffset);
+    QVERIFY(chunks > 2);
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(patchFile(path(), kChunksOffset, littleEndian<quint32>(chunks - 1)));
+    QVERIFY(!storage.open());
+    QVERIFY(storage.items().isEmpty());
+
+    QVERIFY(writeFile(path(), original));
+    QVERIFY(patchFile(path(), kCountOffset, littleEndian<quint32>(count - 1)));
+    QVERIFY(!storage.open());
+
+    QVERIFY(writeFile(path(), original));
+    QVERIFY(storage.open());
+}
+
+void TestHistoryStorage::rejectsDroppedChunk()
+{
+    // Без последнего чанка и с подогнанным заголовком: новый последний чанк
+    // не помечен последним и не несёт хвоста
+    QVERIFY(HistoryStorage::write(path(), manyItems(), m_home.crypto(), 1));
+    const QByteArray original = readFile(path());
+    const QVector<QByteArray> frames = chunkFrames(original);
+    QVERIFY(frames.size() > 2);
+
+    QByteArray dropped = original.left(original.size() - frames.last().size());
+    quint32 remaining = 0;
+    for (int i = 0; i + 1 < frames.size(); ++i) {
+        const QByteArray plain = m_home.crypto()->decrypt(frames.at(i).mid(4));
+        QVERIFY(!plain.isEmpty());
+        remaining += qFromLittleEndian<quint32>(plain.constData() + 8);
+    }
+    dropped.replace(kCountOffset, 4, littleEndian<quint32>(remaining));
+    dropped.replace(kChunksOffset, 4, littleEndian<quint32>(quint32(frames.size() - 1)));
+    QVERIFY(writeFile(path(), dropped));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+}
+
+void TestHistoryStorage::rejectsSwappedChunks()
+{
+    QVERIFY(HistoryStorage::write(path(), manyItems(), m_home.crypto(), 1));
+    const QByteArray original = readFile(path());
+    const QVector<QByteArray> frames = chunkFrames(original);
+    QVERIFY(frames.size() > 2);
+
+    QByteArray swapped = original.left(kHeaderSize) + frames.at(1) + frames.at(0);
+    for (int i = 2; i < frames.size(); ++i) {
+        swapped += frames.at(i);
+    }
+    QCOMPARE(swapped.size(), original.size());
+    QVERIFY(writeFile(path(), swapped));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+}
+
+void TestHistoryStorage::rejectsEditedJournalSequence()
+{
+    QVERIFY(HistoryStorage::write(path(), sampleItems(), m_home.crypto(), 10));
+    QVERIFY(patchFile(path(), kSequenceOffset, littleEndian<quint64>(100)));
+
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(!storage.open());
+}
+
+void TestHistoryStorage::rejectsLegacyCountMismatch()
+{
+    // В v4 хвоста нет, но число записей и конец файла всё равно сверяются
+    QVERIFY(writeLegacy(path(), sampleItems(), m_home.crypto(), 4, 1));
+    HistoryStorage storage(path(), m_home.crypto());
+    QVERIFY(storage.open());
+
+    QVERIFY(patchFile(path(), kCountOffset, littleEndian<quint32>(2)));
+    QVERIFY(!storage.open());
+    QVERIFY(patchFile(path(), kCountOffset, littleEndian<quint32>(4)));
+    QVERIFY(!storage.open());
+}
+
+void TestHistoryStorage::rejectsOtherKey()
+{
+    QVERIFY(HistoryStorage::write(path(), sampleItems(), m_home.crypto(), 1));
+
+    // Другой домашний каталог — другой ключ
+    QTemporaryDir otherHome;
+    QVERIFY(otherHome.isValid());
+    TestHome::setHome(otherHome.path());
+    const CryptoManager otherCrypto;
+    TestHome::setHome(m_home.path());
+
+    HistoryStorage storage(path(), &otherCrypto);
+    QVERIFY(!storage.open());
+}
+
+QTEST_GUILESS_MAIN(TestHistoryStorage)
+
+#include "tst_historystorage.moc"